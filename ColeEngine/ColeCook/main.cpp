@@ -0,0 +1,86 @@
+// colecook - offline asset cooker
+//
+// Usage: colecook [sourceDir] [-o cookedDir] [-j threads] [-f]
+//
+//   sourceDir   Folder to cook, defaults to assets
+//   -o          Output folder, defaults to cooked. The engine loads from cooked
+//   -j          Worker threads, defaults to every core
+//   -f          Cook everything again even if it is up to date
+//
+// Run from the engine's working directory so the manifest paths match what the engine asks for.
+// Exits with 1 if any asset failed to cook.
+
+#include <string>
+#include <cstdlib>
+#include <chrono>
+
+#include "AssetCooker.h"
+#include "Logging.h"
+
+
+static void printUsage()
+{
+    Log::msg("Usage: colecook [sourceDir] [-o cookedDir] [-j threads] [-f]");
+}
+
+
+int main(int argc, char** argv)
+{
+    std::string sourceDir = "assets";
+    std::string cookedDir = COOKED_DIR;
+    unsigned int threads = 0;
+    bool force = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+
+        if (arg == "-o" && i + 1 < argc)
+        {
+            cookedDir = argv[++i];
+        }
+        else if (arg == "-j" && i + 1 < argc)
+        {
+            threads = static_cast<unsigned int>(atoi(argv[++i]));
+        }
+        else if (arg == "-f")
+        {
+            force = true;
+        }
+        else if (arg == "-h" || arg == "--help")
+        {
+            printUsage();
+            return 0;
+        }
+        else if (!arg.empty() && arg[0] != '-')
+        {
+            sourceDir = arg;
+        }
+        else
+        {
+            Log::error("Unknown argument: " + arg);
+            printUsage();
+            return 1;
+        }
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    AssetCooker cooker(sourceDir, cookedDir);
+    unsigned int failed = cooker.run(threads, force);
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::string summary = "Cooked " + std::to_string(cooker.getCooked()) + ", up to date " + std::to_string(cooker.getUpToDate()) +
+        ", skipped " + std::to_string(cooker.getSkipped()) + ", failed " + std::to_string(failed) +
+        " in " + std::to_string(seconds) + "s";
+
+    if (failed > 0)
+    {
+        Log::error(summary);
+        return 1;
+    }
+
+    Log::info(summary);
+    return 0;
+}
@@ -0,0 +1,273 @@
+#include "AssetCooker.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <thread>
+#include <direct.h>
+
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+
+#include "Mesh.h"
+#include "CMesh.h"
+#include "CTexture.h"
+#include "MappedFile.h"
+#include "ThreadPool.h"
+#include "Logging.h"
+#include "Hash.h"
+
+
+static bool hashFile(const std::string& path, unsigned long long& hash)
+{
+    MappedFile file;
+
+    if (!file.open(path))
+        return false;
+
+    hash = hashBytes(FNV_OFFSET_BASIS, file.data(), file.size());
+
+    return true;
+}
+
+
+// Cooked file name, changes with the source contents, the cooker and the output format
+static std::string cookedName(const AssetRecord& record)
+{
+    bool isMesh = record.type == AssetType::MESH;
+
+    unsigned int versions[3] = { ASSET_COOKER_VERSION, static_cast<unsigned int>(record.type), isMesh ? CMESH_VERSION : CTEXTURE_VERSION };
+
+    unsigned long long key = hashBytes(FNV_OFFSET_BASIS, &record.contentHash, sizeof(record.contentHash));
+    key = hashBytes(key, versions, sizeof(versions));
+
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx%s", key, isMesh ? ".cmesh" : ".ctex");
+
+    return name;
+}
+
+
+AssetCooker::AssetCooker(std::string _sourceDir, std::string _cookedDir)
+    : sourceDir(_sourceDir), cookedDir(_cookedDir), nCooked(0), nUpToDate(0), nSkipped(0), nFailed(0)
+{
+}
+
+
+void AssetCooker::log(const std::string& msg, bool warning)
+{
+    std::lock_guard<std::mutex> lock(logMutex);
+
+    if (warning)
+        Log::warning(msg);
+    else
+        Log::msg(msg);
+}
+
+
+void AssetCooker::findAssets(const std::string& dir, std::vector<std::string>& out) const
+{
+    WIN32_FIND_DATAA data;
+    HANDLE find = FindFirstFileA((dir + "/*").c_str(), &data);
+
+    if (find == INVALID_HANDLE_VALUE)
+        return;
+
+    do
+    {
+        std::string name = data.cFileName;
+
+        if (name == "." || name == "..")
+            continue;
+
+        std::string path = dir + "/" + name;
+
+        if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+            findAssets(path, out);
+        else if (AssetManifest::typeOf(path) != AssetType::UNKNOWN)
+            out.push_back(path);
+
+    } while (FindNextFileA(find, &data));
+
+    FindClose(find);
+}
+
+
+unsigned int AssetCooker::run(unsigned int threads, bool force)
+{
+    nCooked = nUpToDate = nSkipped = nFailed = 0;
+
+    std::string manifestPath = cookedDir + "/" + ASSET_MANIFEST_FILE;
+
+    previous.load(manifestPath);
+
+    // Fails harmlessly if the folder already exists
+    _mkdir(cookedDir.c_str());
+
+    std::vector<std::string> sources;
+    findAssets(sourceDir, sources);
+    std::sort(sources.begin(), sources.end());
+
+    log("Found " + std::to_string(sources.size()) + " assets in " + sourceDir);
+
+    std::vector<AssetRecord> records(sources.size());
+    std::vector<CookResult> results(sources.size());
+
+    ThreadPool* pool = nullptr;
+
+    auto cookRange = [&](unsigned int begin, unsigned int end)
+    {
+        for (unsigned int i = begin; i < end; i++)
+        {
+            records[i].source = sources[i];
+            records[i].type = AssetManifest::typeOf(sources[i]);
+
+            results[i] = cookAsset(records[i], force, pool);
+        }
+    };
+
+    unsigned int count = static_cast<unsigned int>(sources.size());
+
+    if (threads == 1)
+    {
+        cookRange(0, count);
+    }
+    else
+    {
+        // The calling thread works too, so one less worker than requested
+        ThreadPool workers(threads > 1 ? threads - 1 : 0);
+        pool = &workers;
+
+        // Cook times vary a lot between assets, so hand them out one at a time
+        workers.parallelFor(count, 1, cookRange);
+    }
+
+    AssetManifest manifest;
+
+    for (size_t i = 0; i < records.size(); i++)
+    {
+        switch (results[i])
+        {
+        case CookResult::COOKED: nCooked++; break;
+        case CookResult::UP_TO_DATE: nUpToDate++; break;
+        case CookResult::SKIPPED: nSkipped++; break;
+        case CookResult::FAILED: nFailed++; break;
+        }
+
+        // Failed assets are left out so the runtime falls back to their source
+        if (results[i] != CookResult::FAILED)
+            manifest.set(records[i]);
+    }
+
+    if (!manifest.save(manifestPath))
+    {
+        log("Unable to write manifest: " + manifestPath, true);
+        nFailed++;
+    }
+
+    return nFailed;
+}
+
+
+AssetCooker::CookResult AssetCooker::cookAsset(AssetRecord& record, bool force, ThreadPool* pool)
+{
+    if (!AssetManifest::fileInfo(record.source, record.size, record.modified))
+    {
+        log("Unable to read " + record.source, true);
+        return CookResult::FAILED;
+    }
+
+    const AssetRecord* last = previous.find(record.source);
+
+    // Same size and modified time as last run, trust its hash instead of reading the file
+    if (!force && last && last->type == record.type && last->size == record.size && last->modified == record.modified)
+    {
+        record.contentHash = last->contentHash;
+
+        // Couldn't be cooked last time and hasn't changed since
+        if (last->cooked.empty())
+            return CookResult::SKIPPED;
+    }
+    else if (!hashFile(record.source, record.contentHash))
+    {
+        log("Unable to read " + record.source, true);
+        return CookResult::FAILED;
+    }
+
+    std::string cookedPath = cookedDir + "/" + cookedName(record);
+
+    unsigned long long size;
+    long long modified;
+
+    if (!force && AssetManifest::fileInfo(cookedPath, size, modified))
+    {
+        record.cooked = cookedPath;
+        return CookResult::UP_TO_DATE;
+    }
+
+    // Written under a per thread name and renamed, so an interrupted cook never leaves a partial file
+    // and two sources with the same contents don't write the same file
+    std::string tempPath = cookedPath + "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+
+    bool skipped = false;
+    bool cooked = false;
+
+    if (record.type == AssetType::MESH)
+        cooked = cookMeshAsset(record, tempPath, skipped);
+    else
+        cooked = cookTexture(record.source, tempPath, pool);
+
+    if (!cooked)
+    {
+        remove(tempPath.c_str());
+
+        if (skipped)
+        {
+            log("Skipped " + record.source + ", it has embedded textures");
+            record.cooked.clear();
+            return CookResult::SKIPPED;
+        }
+
+        log("Failed to cook " + record.source, true);
+        return CookResult::FAILED;
+    }
+
+    // Replacing is only needed when forced, rename won't overwrite on Windows
+    remove(cookedPath.c_str());
+
+    if (rename(tempPath.c_str(), cookedPath.c_str()) != 0)
+    {
+        remove(tempPath.c_str());
+
+        // Another thread may have just cooked the same contents
+        if (!AssetManifest::fileInfo(cookedPath, size, modified))
+        {
+            log("Unable to write " + cookedPath, true);
+            return CookResult::FAILED;
+        }
+    }
+
+    record.cooked = cookedPath;
+
+    log("Cooked " + record.source + " -> " + cookedPath);
+
+    return CookResult::COOKED;
+}
+
+
+bool AssetCooker::cookMeshAsset(const AssetRecord& record, const std::string& outPath, bool& skipped)
+{
+    // CPU side only, the cooker has no GL context. Files are already spread over the workers
+    MeshFBX mesh(record.source, true, false);
+
+    if (mesh.meshData.empty())
+        return false;
+
+    if (!canCookMesh(mesh))
+    {
+        skipped = true;
+        return false;
+    }
+
+    return cookMesh(mesh, outPath);
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#ifndef _ASSET_COOKER
+#define _ASSET_COOKER
+
+#include <string>
+#include <vector>
+#include <mutex>
+
+#include "AssetManifest.h"
+
+class ThreadPool;
+
+// Bump when a cook step changes its output so every asset is cooked again
+#define ASSET_COOKER_VERSION 1
+
+
+// Walks a source folder and cooks every mesh and texture into cookedDir.
+// Cooked files are named after a hash of the source contents and the cooker version, so a run only
+// cooks sources whose contents changed. Used by the colecook tool.
+class AssetCooker
+{
+public:
+	AssetCooker(std::string sourceDir, std::string cookedDir);
+
+	// Cook everything that changed and write the manifest. 0 threads uses every core.
+	// force cooks every asset even if its cooked file exists. Returns the number of assets that failed
+	unsigned int run(unsigned int threads, bool force);
+
+	unsigned int getCooked() const { return nCooked; }
+	unsigned int getUpToDate() const { return nUpToDate; }
+	unsigned int getSkipped() const { return nSkipped; } // Sources that can't be cooked, loaded from source at runtime
+	unsigned int getFailed() const { return nFailed; }
+
+private:
+	enum class CookResult
+	{
+		COOKED,
+		UP_TO_DATE,
+		SKIPPED,
+		FAILED
+	};
+
+	// Texture blocks are encoded on pool if given, so a few large textures still use every core
+	CookResult cookAsset(AssetRecord& record, bool force, ThreadPool* pool);
+
+	bool cookMeshAsset(const AssetRecord& record, const std::string& outPath, bool& skipped);
+
+	// Every cookable file under dir, recursively
+	void findAssets(const std::string& dir, std::vector<std::string>& out) const;
+
+	void log(const std::string& msg, bool warning = false);
+
+	std::string sourceDir;
+	std::string cookedDir;
+
+	AssetManifest previous; // From the last run, to reuse hashes of unchanged files
+
+	unsigned int nCooked, nUpToDate, nSkipped, nFailed;
+
+	std::mutex logMutex;
+};
+
+#endif
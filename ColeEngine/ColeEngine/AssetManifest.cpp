@@ -0,0 +1,169 @@
+#include "AssetManifest.h"
+
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cctype>
+#include <sys/stat.h>
+
+
+// First line of every manifest, bump the number when the layout changes
+static const char* MANIFEST_HEADER = "colecook-manifest 1";
+
+
+// Manifest keys always use forward slashes
+static std::string normalizePath(std::string path)
+{
+    std::replace(path.begin(), path.end(), '\\', '/');
+    return path;
+}
+
+
+static const char* typeName(AssetType type)
+{
+    switch (type)
+    {
+    case AssetType::MESH: return "mesh";
+    case AssetType::TEXTURE: return "texture";
+    default: return "unknown";
+    }
+}
+
+
+static AssetType typeFromName(const std::string& name)
+{
+    if (name == "mesh")
+        return AssetType::MESH;
+
+    if (name == "texture")
+        return AssetType::TEXTURE;
+
+    return AssetType::UNKNOWN;
+}
+
+
+bool AssetManifest::load(const std::string& path)
+{
+    records.clear();
+
+    std::ifstream file(path);
+
+    if (!file)
+        return false;
+
+    std::string line;
+
+    if (!std::getline(file, line) || line != MANIFEST_HEADER)
+        return false;
+
+    while (std::getline(file, line))
+    {
+        std::vector<std::string> fields;
+        std::stringstream stream(line);
+        std::string field;
+
+        while (std::getline(stream, field, '\t'))
+            fields.push_back(field);
+
+        // type, content hash, size, modified, source, cooked
+        if (fields.size() != 6)
+            continue;
+
+        AssetRecord record;
+        record.type = typeFromName(fields[0]);
+        record.contentHash = strtoull(fields[1].c_str(), nullptr, 16);
+        record.size = strtoull(fields[2].c_str(), nullptr, 10);
+        record.modified = strtoll(fields[3].c_str(), nullptr, 10);
+        record.source = fields[4];
+        record.cooked = fields[5] == "-" ? std::string() : fields[5];
+
+        if (record.type != AssetType::UNKNOWN)
+            records[record.source] = record;
+    }
+
+    return true;
+}
+
+
+bool AssetManifest::save(const std::string& path) const
+{
+    std::ofstream file(path);
+
+    if (!file)
+        return false;
+
+    // Sorted so manifests from different runs diff cleanly
+    std::vector<const AssetRecord*> sorted;
+
+    for (const auto& it : records)
+        sorted.push_back(&it.second);
+
+    std::sort(sorted.begin(), sorted.end(), [](const AssetRecord* a, const AssetRecord* b) { return a->source < b->source; });
+
+    file << MANIFEST_HEADER << "\n";
+
+    for (const AssetRecord* record : sorted)
+    {
+        char hash[17];
+        snprintf(hash, sizeof(hash), "%016llx", record->contentHash);
+
+        file << typeName(record->type) << "\t" << hash << "\t" << record->size << "\t" << record->modified << "\t"
+             << record->source << "\t" << (record->cooked.empty() ? "-" : record->cooked) << "\n";
+    }
+
+    return static_cast<bool>(file);
+}
+
+
+const AssetRecord* AssetManifest::find(const std::string& source) const
+{
+    auto it = records.find(normalizePath(source));
+
+    return it != records.end() ? &it->second : nullptr;
+}
+
+
+void AssetManifest::set(const AssetRecord& record)
+{
+    AssetRecord normalized = record;
+    normalized.source = normalizePath(record.source);
+    normalized.cooked = normalizePath(record.cooked);
+
+    records[normalized.source] = normalized;
+}
+
+
+bool AssetManifest::fileInfo(const std::string& path, unsigned long long& size, long long& modified)
+{
+    struct stat info;
+
+    if (stat(path.c_str(), &info) != 0)
+        return false;
+
+    size = static_cast<unsigned long long>(info.st_size);
+    modified = static_cast<long long>(info.st_mtime);
+
+    return true;
+}
+
+
+AssetType AssetManifest::typeOf(const std::string& path)
+{
+    size_t dot = path.find_last_of('.');
+
+    if (dot == std::string::npos)
+        return AssetType::UNKNOWN;
+
+    std::string ext = path.substr(dot + 1);
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return static_cast<char>(tolower(c)); });
+
+    if (ext == "fbx" || ext == "obj" || ext == "gltf" || ext == "glb")
+        return AssetType::MESH;
+
+    if (ext == "png" || ext == "jpg" || ext == "jpeg" || ext == "tga" || ext == "bmp" || ext == "hdr")
+        return AssetType::TEXTURE;
+
+    return AssetType::UNKNOWN;
+}
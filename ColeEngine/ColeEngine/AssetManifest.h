@@ -0,0 +1,62 @@
+#pragma once
+
+#ifndef _ASSET_MANIFEST
+#define _ASSET_MANIFEST
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+// Folder colecook writes to and the runtime loads cooked assets from, relative to the working directory
+#define COOKED_DIR "cooked"
+#define ASSET_MANIFEST_FILE "manifest.txt"
+
+
+enum class AssetType
+{
+	UNKNOWN,
+	MESH,
+	TEXTURE
+};
+
+// One cooked asset
+struct AssetRecord
+{
+	AssetType type = AssetType::UNKNOWN;
+
+	std::string source; // Path the engine asks for, e.g. assets/mesh/monkey.fbx
+	std::string cooked; // Cooked file, named after the content key so identical sources share it. Empty if it can't be cooked
+
+	unsigned long long contentHash = 0; // Of the source bytes
+
+	// Source size and modified time when it was hashed. Unchanged files skip re-hashing,
+	// and the runtime uses them to spot sources edited after the last cook
+	unsigned long long size = 0;
+	long long modified = 0;
+};
+
+
+// Source path to cooked file table written by colecook, a text file with one tab separated record per line
+class AssetManifest
+{
+public:
+	bool load(const std::string& path);
+	bool save(const std::string& path) const;
+
+	// Nullptr if the source was never cooked
+	const AssetRecord* find(const std::string& source) const;
+
+	void set(const AssetRecord& record);
+
+	size_t size() const { return records.size(); }
+
+	// Size and modified time of a file. False if it doesn't exist
+	static bool fileInfo(const std::string& path, unsigned long long& size, long long& modified);
+
+	static AssetType typeOf(const std::string& path);
+
+private:
+	std::unordered_map<std::string, AssetRecord> records;
+};
+
+#endif
@@ -0,0 +1,1099 @@
+#include "BVH.h"
+#include "Mesh.h"
+#include "Transform.h"
+
+#include <algorithm>
+#include <numeric>
+#include <cassert>
+
+// Number of bins used when evaluating split candidates
+#define BVH_BINS 12
+
+// Largest number of primitives a leaf may hold before a split is forced
+#define BVH_MAX_LEAF_SIZE 4
+
+// Traversal stack size. Deep enough for any tree built here
+#define BVH_STACK_SIZE 64
+
+// Nodes this deep become leaves whatever they hold. Traversal pushes at most one node more than the
+// depth, so this keeps the stack from overflowing on degenerate input (e.g. many coincident centroids)
+#define BVH_MAX_DEPTH (BVH_STACK_SIZE / 2)
+
+// Rebuild once refitted SAH cost grows past this factor of the cost at build time
+#define BVH_REBUILD_THRESHOLD 1.5f
+
+
+static float surfaceArea(const glm::vec3& boxMin, const glm::vec3& boxMax)
+{
+    glm::vec3 e = boxMax - boxMin;
+
+    // Empty boxes have no area
+    if (e.x < 0.0f || e.y < 0.0f || e.z < 0.0f)
+        return 0.0f;
+
+    return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+}
+
+
+// Recompute a node's bounds from the primitives it holds
+static void updateNodeBounds(BVHNode& node, const std::vector<BVHPrimitive>& prims, const std::vector<unsigned int>& indices)
+{
+    node.boxMin = glm::vec3(FLT_MAX);
+    node.boxMax = glm::vec3(-FLT_MAX);
+
+    for (unsigned int i = 0; i < node.count; i++)
+    {
+        const BVHPrimitive& p = prims[indices[node.leftFirst + i]];
+
+        node.boxMin = glm::min(node.boxMin, p.boxMin);
+        node.boxMax = glm::max(node.boxMax, p.boxMax);
+    }
+}
+
+
+// Find the cheapest split plane of a node using binned SAH. Returns the cost of the split.
+static float findBestSplit(const BVHNode& node, const std::vector<BVHPrimitive>& prims, const std::vector<unsigned int>& indices, int& axis, float& splitPos)
+{
+    float bestCost = FLT_MAX;
+
+    // Centroid bounds decide where the bins go
+    glm::vec3 cMin = glm::vec3(FLT_MAX);
+    glm::vec3 cMax = glm::vec3(-FLT_MAX);
+
+    for (unsigned int i = 0; i < node.count; i++)
+    {
+        const glm::vec3& c = prims[indices[node.leftFirst + i]].centroid;
+
+        cMin = glm::min(cMin, c);
+        cMax = glm::max(cMax, c);
+    }
+
+    for (int a = 0; a < 3; a++)
+    {
+        // All centroids on one plane, can't split on this axis
+        if (cMax[a] == cMin[a])
+            continue;
+
+        glm::vec3 binMin[BVH_BINS], binMax[BVH_BINS];
+        unsigned int binCount[BVH_BINS] = { 0 };
+
+        for (int b = 0; b < BVH_BINS; b++)
+        {
+            binMin[b] = glm::vec3(FLT_MAX);
+            binMax[b] = glm::vec3(-FLT_MAX);
+        }
+
+        float scale = BVH_BINS / (cMax[a] - cMin[a]);
+
+        // Drop every primitive into a bin
+        for (unsigned int i = 0; i < node.count; i++)
+        {
+            const BVHPrimitive& p = prims[indices[node.leftFirst + i]];
+
+            int b = std::min(BVH_BINS - 1, static_cast<int>((p.centroid[a] - cMin[a]) * scale));
+
+            binCount[b]++;
+            binMin[b] = glm::min(binMin[b], p.boxMin);
+            binMax[b] = glm::max(binMax[b], p.boxMax);
+        }
+
+        // Sweep from both sides to get the area and count left/right of every plane
+        float leftArea[BVH_BINS - 1], rightArea[BVH_BINS - 1];
+        unsigned int leftCount[BVH_BINS - 1], rightCount[BVH_BINS - 1];
+
+        glm::vec3 lMin = glm::vec3(FLT_MAX), lMax = glm::vec3(-FLT_MAX);
+        glm::vec3 rMin = glm::vec3(FLT_MAX), rMax = glm::vec3(-FLT_MAX);
+        unsigned int lSum = 0, rSum = 0;
+
+        for (int b = 0; b < BVH_BINS - 1; b++)
+        {
+            lSum += binCount[b];
+            lMin = glm::min(lMin, binMin[b]);
+            lMax = glm::max(lMax, binMax[b]);
+            leftCount[b] = lSum;
+            leftArea[b] = surfaceArea(lMin, lMax);
+
+            rSum += binCount[BVH_BINS - 1 - b];
+            rMin = glm::min(rMin, binMin[BVH_BINS - 1 - b]);
+            rMax = glm::max(rMax, binMax[BVH_BINS - 1 - b]);
+            rightCount[BVH_BINS - 2 - b] = rSum;
+            rightArea[BVH_BINS - 2 - b] = surfaceArea(rMin, rMax);
+        }
+
+        float binWidth = (cMax[a] - cMin[a]) / BVH_BINS;
+
+        for (int b = 0; b < BVH_BINS - 1; b++)
+        {
+            float cost = leftCount[b] * leftArea[b] + rightCount[b] * rightArea[b];
+
+            if (cost < bestCost)
+            {
+                bestCost = cost;
+                axis = a;
+                splitPos = cMin[a] + binWidth * (b + 1);
+            }
+        }
+    }
+
+    return bestCost;
+}
+
+
+// Build a flattened tree over a set of primitives. Children always come after their parent.
+static void buildNodes(const std::vector<BVHPrimitive>& prims, std::vector<BVHNode>& nodes, std::vector<unsigned int>& indices)
+{
+    unsigned int n = static_cast<unsigned int>(prims.size());
+
+    nodes.clear();
+    indices.resize(n);
+    std::iota(indices.begin(), indices.end(), 0);
+
+    if (n == 0)
+        return;
+
+    // A binary tree with n leaves at most has 2n - 1 nodes
+    nodes.reserve(2 * n - 1);
+
+    BVHNode root;
+    root.leftFirst = 0;
+    root.count = n;
+    updateNodeBounds(root, prims, indices);
+    nodes.push_back(root);
+
+    // Node index and depth
+    std::vector<std::pair<unsigned int, unsigned int>> stack;
+    stack.push_back({ 0, 0 });
+
+    while (!stack.empty())
+    {
+        unsigned int nodeIndex = stack.back().first;
+        unsigned int depth = stack.back().second;
+        stack.pop_back();
+
+        BVHNode node = nodes[nodeIndex];
+
+        if (node.count <= 1 || depth >= BVH_MAX_DEPTH)
+            continue;
+
+        int axis = 0;
+        float splitPos = 0.0f;
+        float splitCost = findBestSplit(node, prims, indices, axis, splitPos);
+
+        // Only split if it is cheaper than intersecting everything in this node
+        float leafCost = node.count * surfaceArea(node.boxMin, node.boxMax);
+
+        if (splitCost >= leafCost && node.count <= BVH_MAX_LEAF_SIZE)
+            continue;
+
+        // No valid split plane (every centroid in the same place)
+        if (splitCost == FLT_MAX)
+            continue;
+
+        // Partition primitives around the split plane
+        unsigned int first = node.leftFirst;
+        unsigned int last = first + node.count;
+
+        unsigned int* mid = std::partition(indices.data() + first, indices.data() + last,
+            [&](unsigned int i) { return prims[i].centroid[axis] < splitPos; });
+
+        unsigned int leftCount = static_cast<unsigned int>(mid - (indices.data() + first));
+
+        if (leftCount == 0 || leftCount == node.count)
+            continue;
+
+        unsigned int leftIndex = static_cast<unsigned int>(nodes.size());
+
+        BVHNode left;
+        left.leftFirst = first;
+        left.count = leftCount;
+        updateNodeBounds(left, prims, indices);
+
+        BVHNode right;
+        right.leftFirst = first + leftCount;
+        right.count = node.count - leftCount;
+        updateNodeBounds(right, prims, indices);
+
+        nodes.push_back(left);
+        nodes.push_back(right);
+
+        // Node becomes internal
+        nodes[nodeIndex].leftFirst = leftIndex;
+        nodes[nodeIndex].count = 0;
+
+        stack.push_back({ leftIndex, depth + 1 });
+        stack.push_back({ leftIndex + 1, depth + 1 });
+    }
+}
+
+
+// SAH cost of a tree relative to its root area. Traversal and intersection are weighted equally.
+static float treeCost(const std::vector<BVHNode>& nodes)
+{
+    if (nodes.empty())
+        return 0.0f;
+
+    float rootArea = surfaceArea(nodes[0].boxMin, nodes[0].boxMax);
+
+    if (rootArea <= 0.0f)
+        return 0.0f;
+
+    float cost = 0.0f;
+
+    for (const BVHNode& node : nodes)
+    {
+        float area = surfaceArea(node.boxMin, node.boxMax);
+
+        cost += node.isLeaf() ? area * node.count : area;
+    }
+
+    return cost / rootArea;
+}
+
+
+
+//---------------------------------------------------------------\\
+//                         BVH TREE                                \\
+//----------------------------------------------------------------\\
+
+void BVHTree::clear()
+{
+    // Wait out a background build, its result is no longer wanted
+    if (pending.valid())
+        pending.wait();
+
+    pending = std::future<Result>();
+
+    nodes.clear();
+    indices.clear();
+
+    buildCost = 0.0f;
+    cost = 0.0f;
+}
+
+
+void BVHTree::build(const std::vector<BVHPrimitive>& prims)
+{
+    // A full build makes any rebuild in flight stale
+    if (pending.valid())
+        pending.wait();
+
+    pending = std::future<Result>();
+
+    buildNodes(prims, nodes, indices);
+
+    buildCost = treeCost(nodes);
+    cost = buildCost;
+}
+
+
+void BVHTree::refit(const std::vector<BVHPrimitive>& prims)
+{
+    // Children always come after their parent, so walking backwards visits children first
+    for (int i = static_cast<int>(nodes.size()) - 1; i >= 0; i--)
+    {
+        BVHNode& node = nodes[i];
+
+        if (node.isLeaf())
+        {
+            updateNodeBounds(node, prims, indices);
+        }
+        else
+        {
+            const BVHNode& left = nodes[node.leftFirst];
+            const BVHNode& right = nodes[node.leftFirst + 1];
+
+            node.boxMin = glm::min(left.boxMin, right.boxMin);
+            node.boxMax = glm::max(left.boxMax, right.boxMax);
+        }
+    }
+
+    cost = treeCost(nodes);
+}
+
+
+bool BVHTree::isDegraded() const
+{
+    return buildCost > 0.0f && cost > buildCost * BVH_REBUILD_THRESHOLD;
+}
+
+
+void BVHTree::rebuildAsync(const std::vector<BVHPrimitive>& prims)
+{
+    if (pending.valid())
+        return;
+
+    pending = std::async(std::launch::async, [prims]()
+    {
+        Result result;
+        buildNodes(prims, result.nodes, result.indices);
+        result.cost = treeCost(result.nodes);
+
+        return result;
+    });
+}
+
+
+bool BVHTree::finishRebuild(const std::vector<BVHPrimitive>& prims)
+{
+    if (!pending.valid())
+        return false;
+
+    if (pending.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        return false;
+
+    Result result = pending.get();
+
+    // Primitives were added or removed while building, the result doesn't fit anymore
+    if (result.indices.size() != prims.size())
+        return false;
+
+    nodes = std::move(result.nodes);
+    indices = std::move(result.indices);
+
+    buildCost = result.cost;
+
+    // Geometry may have kept moving while the worker was building
+    refit(prims);
+
+    return true;
+}
+
+
+
+// Slab test against a node. Returns distance to the box or FLT_MAX on a miss.
+static inline float intersectBox(const glm::vec3& origin, const glm::vec3& invDir, const BVHNode& node, float tMax)
+{
+    glm::vec3 t0 = (node.boxMin - origin) * invDir;
+    glm::vec3 t1 = (node.boxMax - origin) * invDir;
+
+    glm::vec3 tSmall = glm::min(t0, t1);
+    glm::vec3 tBig = glm::max(t0, t1);
+
+    float tNear = glm::max(glm::max(tSmall.x, tSmall.y), tSmall.z);
+    float tFar = glm::min(glm::min(tBig.x, tBig.y), tBig.z);
+
+    if (tFar >= tNear && tFar > 0.0f && tNear < tMax)
+        return tNear;
+
+    return FLT_MAX;
+}
+
+
+// Moller-Trumbore ray/triangle test
+static inline bool intersectTriangle(const Ray3D& ray, const BVHTriangle& tri, float& t)
+{
+    glm::vec3 e1 = tri.v1 - tri.v0;
+    glm::vec3 e2 = tri.v2 - tri.v0;
+    glm::vec3 p = glm::cross(ray.direction, e2);
+
+    float d = glm::dot(e1, p);
+
+    // Ray is parallel to triangle
+    if (glm::abs(d) < 1e-12f)
+        return false;
+
+    float invD = 1.0f / d;
+    glm::vec3 s = ray.origin - tri.v0;
+
+    float u = glm::dot(s, p) * invD;
+
+    if (u < 0.0f || u > 1.0f)
+        return false;
+
+    glm::vec3 q = glm::cross(s, e1);
+
+    float v = glm::dot(ray.direction, q) * invD;
+
+    if (v < 0.0f || u + v > 1.0f)
+        return false;
+
+    t = glm::dot(e2, q) * invD;
+
+    return t > 0.0f;
+}
+
+
+static inline glm::vec3 safeInverse(const glm::vec3& d)
+{
+    return glm::vec3(
+        d.x != 0.0f ? 1.0f / d.x : FLT_MAX,
+        d.y != 0.0f ? 1.0f / d.y : FLT_MAX,
+        d.z != 0.0f ? 1.0f / d.z : FLT_MAX
+    );
+}
+
+
+// Slab test of every ray in mask against a node. Returns the mask of rays that hit it
+static inline unsigned int intersectBoxPacket(const Ray3D* rays, const glm::vec3* invDir, const RayHit* hits, unsigned int mask, const BVHNode& node)
+{
+    unsigned int result = 0;
+
+    for (unsigned int r = 0; r < BVH_PACKET_SIZE; r++)
+    {
+        if ((mask & (1u << r)) && intersectBox(rays[r].origin, invDir[r], node, hits[r].t) != FLT_MAX)
+            result |= 1u << r;
+    }
+
+    return result;
+}
+
+
+// Index of the first ray set in a packet mask
+static inline unsigned int leadingRay(unsigned int mask)
+{
+    unsigned int r = 0;
+
+    while (r < BVH_PACKET_SIZE - 1 && !(mask & (1u << r)))
+        r++;
+
+    return r;
+}
+
+
+
+//---------------------------------------------------------------\\
+//                    MESH BVH (BOTTOM LEVEL)                      \\
+//----------------------------------------------------------------\\
+
+MeshBVH::MeshBVH(Mesh* _mesh)
+    : mesh(_mesh)
+{
+
+}
+
+
+void MeshBVH::gatherTriangles()
+{
+    triangles.clear();
+
+    if (!mesh)
+        return;
+
+    for (unsigned int i = 0; i < mesh->meshData.size(); i++)
+    {
+        const std::vector<Vertex>& vertices = mesh->meshData[i].vertices;
+        const std::vector<unsigned int>& meshIndices = mesh->meshData[i].indices;
+
+        for (unsigned int j = 0; j + 2 < meshIndices.size(); j += 3)
+        {
+            BVHTriangle tri;
+            tri.v0 = vertices[meshIndices[j]].position;
+            tri.v1 = vertices[meshIndices[j + 1]].position;
+            tri.v2 = vertices[meshIndices[j + 2]].position;
+            tri.subMesh = i;
+            tri.index = j / 3;
+
+            triangles.push_back(tri);
+        }
+    }
+}
+
+
+// Copy current vertex positions into the existing triangle list. Returns false if the topology changed
+bool MeshBVH::updateTriangles()
+{
+    if (!mesh)
+        return false;
+
+    unsigned int count = 0;
+
+    for (const MeshData& data : mesh->meshData)
+        count += static_cast<unsigned int>(data.indices.size() / 3);
+
+    if (count != triangles.size())
+        return false;
+
+    for (BVHTriangle& tri : triangles)
+    {
+        if (tri.subMesh >= mesh->meshData.size())
+            return false;
+
+        const std::vector<Vertex>& vertices = mesh->meshData[tri.subMesh].vertices;
+        const std::vector<unsigned int>& meshIndices = mesh->meshData[tri.subMesh].indices;
+
+        unsigned int j = tri.index * 3;
+
+        tri.v0 = vertices[meshIndices[j]].position;
+        tri.v1 = vertices[meshIndices[j + 1]].position;
+        tri.v2 = vertices[meshIndices[j + 2]].position;
+    }
+
+    return true;
+}
+
+
+std::vector<BVHPrimitive> MeshBVH::getPrimitives() const
+{
+    std::vector<BVHPrimitive> prims(triangles.size());
+
+    for (unsigned int i = 0; i < triangles.size(); i++)
+    {
+        const BVHTriangle& tri = triangles[i];
+
+        prims[i].boxMin = glm::min(glm::min(tri.v0, tri.v1), tri.v2);
+        prims[i].boxMax = glm::max(glm::max(tri.v0, tri.v1), tri.v2);
+        prims[i].centroid = (tri.v0 + tri.v1 + tri.v2) * (1.0f / 3.0f);
+    }
+
+    return prims;
+}
+
+
+void MeshBVH::build()
+{
+    gatherTriangles();
+
+    tree.build(getPrimitives());
+
+    version++;
+}
+
+
+void MeshBVH::refit()
+{
+    if (!updateTriangles())
+    {
+        build();
+        return;
+    }
+
+    std::vector<BVHPrimitive> prims = getPrimitives();
+
+    tree.refit(prims);
+
+    // Deformed far enough that the old layout is costing more than a rebuild
+    if (tree.isDegraded() && !tree.isRebuilding())
+        tree.rebuildAsync(prims);
+
+    version++;
+}
+
+
+void MeshBVH::update()
+{
+    if (!tree.isRebuilding())
+        return;
+
+    if (tree.finishRebuild(getPrimitives()))
+        version++;
+}
+
+
+bool MeshBVH::intersect(const Ray3D& ray, RayHit& hit, RayQueryMode mode, RayQueryStats* stats) const
+{
+    const std::vector<BVHNode>& nodes = tree.nodes;
+    const std::vector<unsigned int>& indices = tree.indices;
+
+    if (nodes.empty())
+        return false;
+
+    glm::vec3 invDir = safeInverse(ray.direction);
+
+    bool found = false;
+
+    unsigned int stack[BVH_STACK_SIZE];
+    unsigned int stackPtr = 0;
+
+    unsigned long long nodesVisited = 1;
+    unsigned long long trianglesTested = 0;
+
+    if (intersectBox(ray.origin, invDir, nodes[0], hit.t) == FLT_MAX)
+    {
+        if (stats)
+            stats->nodesVisited += nodesVisited;
+
+        return false;
+    }
+
+    stack[stackPtr++] = 0;
+
+    while (stackPtr > 0)
+    {
+        const BVHNode& node = nodes[stack[--stackPtr]];
+
+        if (node.isLeaf())
+        {
+            trianglesTested += node.count;
+
+            for (unsigned int i = 0; i < node.count; i++)
+            {
+                const BVHTriangle& tri = triangles[indices[node.leftFirst + i]];
+
+                float t = 0.0f;
+                if (intersectTriangle(ray, tri, t) && t < hit.t)
+                {
+                    hit.t = t;
+                    hit.subMesh = tri.subMesh;
+                    hit.triangle = tri.index;
+                    hit.normal = glm::cross(tri.v1 - tri.v0, tri.v2 - tri.v0);
+                    found = true;
+
+                    // Any hit will do, stop traversing
+                    if (mode == RayQueryMode::ANY_HIT)
+                    {
+                        stackPtr = 0;
+                        break;
+                    }
+                }
+            }
+            continue;
+        }
+
+        // Visit the closer child first
+        unsigned int nearChild = node.leftFirst;
+        unsigned int farChild = node.leftFirst + 1;
+
+        float dNear = intersectBox(ray.origin, invDir, nodes[nearChild], hit.t);
+        float dFar = intersectBox(ray.origin, invDir, nodes[farChild], hit.t);
+
+        nodesVisited += 2;
+
+        if (dNear > dFar)
+        {
+            std::swap(nearChild, farChild);
+            std::swap(dNear, dFar);
+        }
+
+        // Can't fill up with the depth capped at build, a skipped child would lose hits
+        assert(stackPtr + 2 <= BVH_STACK_SIZE);
+
+        if (dFar != FLT_MAX && stackPtr < BVH_STACK_SIZE)
+            stack[stackPtr++] = farChild;
+
+        if (dNear != FLT_MAX && stackPtr < BVH_STACK_SIZE)
+            stack[stackPtr++] = nearChild;
+    }
+
+    if (stats)
+    {
+        stats->nodesVisited += nodesVisited;
+        stats->trianglesTested += trianglesTested;
+    }
+
+    return found;
+}
+
+
+unsigned int MeshBVH::intersectPacket(const Ray3D* rays, RayHit* hits, unsigned int mask, RayQueryMode mode, RayQueryStats* stats) const
+{
+    const std::vector<BVHNode>& nodes = tree.nodes;
+    const std::vector<unsigned int>& indices = tree.indices;
+
+    if (nodes.empty() || mask == 0)
+        return 0;
+
+    glm::vec3 invDir[BVH_PACKET_SIZE];
+
+    for (unsigned int r = 0; r < BVH_PACKET_SIZE; r++)
+    {
+        if (mask & (1u << r))
+            invDir[r] = safeInverse(rays[r].direction);
+    }
+
+    unsigned int hitMask = 0;
+
+    unsigned int stack[BVH_STACK_SIZE];
+    unsigned int stackPtr = 0;
+
+    unsigned long long nodesVisited = 0;
+    unsigned long long trianglesTested = 0;
+
+    stack[stackPtr++] = 0;
+
+    // Whole packet walks the tree together. A node is entered if any active ray hits it
+    while (stackPtr > 0 && mask != 0)
+    {
+        const BVHNode& node = nodes[stack[--stackPtr]];
+
+        nodesVisited++;
+
+        unsigned int nodeMask = intersectBoxPacket(rays, invDir, hits, mask, node);
+
+        if (nodeMask == 0)
+            continue;
+
+        if (node.isLeaf())
+        {
+            for (unsigned int i = 0; i < node.count; i++)
+            {
+                const BVHTriangle& tri = triangles[indices[node.leftFirst + i]];
+
+                for (unsigned int r = 0; r < BVH_PACKET_SIZE; r++)
+                {
+                    if (!(nodeMask & (1u << r)))
+                        continue;
+
+                    trianglesTested++;
+
+                    float t = 0.0f;
+                    if (intersectTriangle(rays[r], tri, t) && t < hits[r].t)
+                    {
+                        hits[r].t = t;
+                        hits[r].subMesh = tri.subMesh;
+                        hits[r].triangle = tri.index;
+                        hits[r].normal = glm::cross(tri.v1 - tri.v0, tri.v2 - tri.v0);
+                        hitMask |= 1u << r;
+
+                        // Ray is done in any hit mode
+                        if (mode == RayQueryMode::ANY_HIT)
+                        {
+                            nodeMask &= ~(1u << r);
+                            mask &= ~(1u << r);
+                        }
+                    }
+                }
+            }
+            continue;
+        }
+
+        // Rays share direction signs, so ordering children for one ray suits the whole packet
+        unsigned int nearChild = node.leftFirst;
+        unsigned int farChild = node.leftFirst + 1;
+
+        const Ray3D& lead = rays[leadingRay(nodeMask)];
+
+        float dNear = glm::dot((nodes[nearChild].boxMin + nodes[nearChild].boxMax) * 0.5f - lead.origin, lead.direction);
+        float dFar = glm::dot((nodes[farChild].boxMin + nodes[farChild].boxMax) * 0.5f - lead.origin, lead.direction);
+
+        if (dNear > dFar)
+            std::swap(nearChild, farChild);
+
+        // Can't fill up with the depth capped at build, a skipped child would lose hits
+        assert(stackPtr + 2 <= BVH_STACK_SIZE);
+
+        if (stackPtr + 2 <= BVH_STACK_SIZE)
+        {
+            stack[stackPtr++] = farChild;
+            stack[stackPtr++] = nearChild;
+        }
+    }
+
+    if (stats)
+    {
+        stats->nodesVisited += nodesVisited;
+        stats->trianglesTested += trianglesTested;
+    }
+
+    return hitMask;
+}
+
+
+
+//---------------------------------------------------------------\\
+//                    SCENE BVH (TOP LEVEL)                        \\
+//----------------------------------------------------------------\\
+
+void SceneBVH::clear()
+{
+    instances.clear();
+    tree.clear();
+}
+
+
+void SceneBVH::updateInstanceBounds(BVHInstance& instance)
+{
+    TransformAABB(instance.transform, instance.blas->getMin(), instance.blas->getMax(), instance.boxMin, instance.boxMax);
+
+    instance.blasVersion = instance.blas->getVersion();
+}
+
+
+std::vector<BVHPrimitive> SceneBVH::getPrimitives() const
+{
+    std::vector<BVHPrimitive> prims(instances.size());
+
+    for (unsigned int i = 0; i < instances.size(); i++)
+    {
+        prims[i].boxMin = instances[i].boxMin;
+        prims[i].boxMax = instances[i].boxMax;
+        prims[i].centroid = (instances[i].boxMin + instances[i].boxMax) * 0.5f;
+    }
+
+    return prims;
+}
+
+
+void SceneBVH::addInstance(Entity* entity, MeshBVH* blas, const glm::mat4& transform)
+{
+    if (!blas || blas->numNodes() == 0)
+        return;
+
+    BVHInstance instance;
+    instance.entity = entity;
+    instance.blas = blas;
+
+    instances.push_back(instance);
+
+    setTransform(static_cast<unsigned int>(instances.size() - 1), transform);
+}
+
+
+void SceneBVH::setTransform(unsigned int instance, const glm::mat4& transform)
+{
+    if (instance >= instances.size())
+        return;
+
+    BVHInstance& inst = instances[instance];
+    inst.transform = transform;
+
+    // Singular transforms (zero scale) can't be inverted to trace rays in object space
+    inst.enabled = glm::abs(glm::determinant(transform)) > 1e-12f;
+
+    if (inst.enabled)
+        inst.invTransform = glm::inverse(transform);
+
+    updateInstanceBounds(inst);
+}
+
+
+void SceneBVH::build()
+{
+    tree.build(getPrimitives());
+}
+
+
+void SceneBVH::refit()
+{
+    std::vector<BVHPrimitive> prims = getPrimitives();
+
+    tree.refit(prims);
+
+    if (tree.isDegraded() && !tree.isRebuilding())
+        tree.rebuildAsync(prims);
+}
+
+
+void SceneBVH::update()
+{
+    if (tree.isRebuilding())
+        tree.finishRebuild(getPrimitives());
+}
+
+
+bool SceneBVH::intersect(const Ray3D& ray, RayHit& hit, RayQueryMode mode, RayQueryStats* stats) const
+{
+    const std::vector<BVHNode>& nodes = tree.nodes;
+    const std::vector<unsigned int>& indices = tree.indices;
+
+    if (stats)
+        stats->rays++;
+
+    if (nodes.empty())
+        return false;
+
+    glm::vec3 invDir = safeInverse(ray.direction);
+
+    bool found = false;
+
+    unsigned int stack[BVH_STACK_SIZE];
+    unsigned int stackPtr = 0;
+
+    unsigned long long nodesVisited = 1;
+
+    if (intersectBox(ray.origin, invDir, nodes[0], hit.t) != FLT_MAX)
+        stack[stackPtr++] = 0;
+
+    while (stackPtr > 0)
+    {
+        const BVHNode& node = nodes[stack[--stackPtr]];
+
+        if (node.isLeaf())
+        {
+            for (unsigned int i = 0; i < node.count; i++)
+            {
+                const BVHInstance& instance = instances[indices[node.leftFirst + i]];
+
+                if (!instance.enabled)
+                    continue;
+
+                // Move the ray into object space. The direction is not normalized so t stays the same.
+                Ray3D localRay(
+                    glm::vec3(instance.invTransform * glm::vec4(ray.origin, 1.0f)),
+                    glm::mat3(instance.invTransform) * ray.direction
+                );
+
+                if (instance.blas->intersect(localRay, hit, mode, stats))
+                {
+                    // Normal back to world space
+                    hit.normal = glm::normalize(glm::transpose(glm::mat3(instance.invTransform)) * hit.normal);
+                    hit.entity = instance.entity;
+                    found = true;
+
+                    if (mode == RayQueryMode::ANY_HIT)
+                    {
+                        stackPtr = 0;
+                        break;
+                    }
+                }
+            }
+            continue;
+        }
+
+        unsigned int nearChild = node.leftFirst;
+        unsigned int farChild = node.leftFirst + 1;
+
+        float dNear = intersectBox(ray.origin, invDir, nodes[nearChild], hit.t);
+        float dFar = intersectBox(ray.origin, invDir, nodes[farChild], hit.t);
+
+        nodesVisited += 2;
+
+        if (dNear > dFar)
+        {
+            std::swap(nearChild, farChild);
+            std::swap(dNear, dFar);
+        }
+
+        // Can't fill up with the depth capped at build, a skipped child would lose hits
+        assert(stackPtr + 2 <= BVH_STACK_SIZE);
+
+        if (dFar != FLT_MAX && stackPtr < BVH_STACK_SIZE)
+            stack[stackPtr++] = farChild;
+
+        if (dNear != FLT_MAX && stackPtr < BVH_STACK_SIZE)
+            stack[stackPtr++] = nearChild;
+    }
+
+    if (found)
+    {
+        hit.hit = true;
+        hit.position = ray.lerp(hit.t);
+    }
+
+    if (stats)
+    {
+        stats->nodesVisited += nodesVisited;
+        stats->hits += found ? 1 : 0;
+    }
+
+    return found;
+}
+
+
+void SceneBVH::intersectPacket(const Ray3D* rays, RayHit* hits, unsigned int count, RayQueryMode mode, RayQueryStats* stats) const
+{
+    const std::vector<BVHNode>& nodes = tree.nodes;
+    const std::vector<unsigned int>& indices = tree.indices;
+
+    count = std::min(count, static_cast<unsigned int>(BVH_PACKET_SIZE));
+
+    if (stats)
+    {
+        stats->rays += count;
+        stats->packets++;
+    }
+
+    if (nodes.empty() || count == 0)
+        return;
+
+    glm::vec3 invDir[BVH_PACKET_SIZE];
+
+    for (unsigned int r = 0; r < count; r++)
+        invDir[r] = safeInverse(rays[r].direction);
+
+    unsigned int mask = (1u << count) - 1;
+    unsigned int foundMask = 0;
+
+    Ray3D localRays[BVH_PACKET_SIZE];
+
+    unsigned int stack[BVH_STACK_SIZE];
+    unsigned int stackPtr = 0;
+
+    unsigned long long nodesVisited = 0;
+
+    stack[stackPtr++] = 0;
+
+    while (stackPtr > 0 && mask != 0)
+    {
+        const BVHNode& node = nodes[stack[--stackPtr]];
+
+        nodesVisited++;
+
+        unsigned int nodeMask = intersectBoxPacket(rays, invDir, hits, mask, node);
+
+        if (nodeMask == 0)
+            continue;
+
+        if (node.isLeaf())
+        {
+            for (unsigned int i = 0; i < node.count && nodeMask != 0; i++)
+            {
+                const BVHInstance& instance = instances[indices[node.leftFirst + i]];
+
+                if (!instance.enabled)
+                    continue;
+
+                glm::mat3 invLinear = glm::mat3(instance.invTransform);
+
+                // Move the active rays into object space
+                for (unsigned int r = 0; r < count; r++)
+                {
+                    if (!(nodeMask & (1u << r)))
+                        continue;
+
+                    localRays[r].origin = glm::vec3(instance.invTransform * glm::vec4(rays[r].origin, 1.0f));
+                    localRays[r].direction = invLinear * rays[r].direction;
+                }
+
+                unsigned int instanceMask = instance.blas->intersectPacket(localRays, hits, nodeMask, mode, stats);
+
+                if (instanceMask == 0)
+                    continue;
+
+                glm::mat3 normalMatrix = glm::transpose(invLinear);
+
+                for (unsigned int r = 0; r < count; r++)
+                {
+                    if (!(instanceMask & (1u << r)))
+                        continue;
+
+                    hits[r].normal = glm::normalize(normalMatrix * hits[r].normal);
+                    hits[r].entity = instance.entity;
+                }
+
+                foundMask |= instanceMask;
+
+                if (mode == RayQueryMode::ANY_HIT)
+                {
+                    nodeMask &= ~instanceMask;
+                    mask &= ~instanceMask;
+                }
+            }
+            continue;
+        }
+
+        unsigned int nearChild = node.leftFirst;
+        unsigned int farChild = node.leftFirst + 1;
+
+        const Ray3D& lead = rays[leadingRay(nodeMask)];
+
+        float dNear = glm::dot((nodes[nearChild].boxMin + nodes[nearChild].boxMax) * 0.5f - lead.origin, lead.direction);
+        float dFar = glm::dot((nodes[farChild].boxMin + nodes[farChild].boxMax) * 0.5f - lead.origin, lead.direction);
+
+        if (dNear > dFar)
+            std::swap(nearChild, farChild);
+
+        // Can't fill up with the depth capped at build, a skipped child would lose hits
+        assert(stackPtr + 2 <= BVH_STACK_SIZE);
+
+        if (stackPtr + 2 <= BVH_STACK_SIZE)
+        {
+            stack[stackPtr++] = farChild;
+            stack[stackPtr++] = nearChild;
+        }
+    }
+
+    for (unsigned int r = 0; r < count; r++)
+    {
+        if (!(foundMask & (1u << r)))
+            continue;
+
+        hits[r].hit = true;
+        hits[r].position = rays[r].lerp(hits[r].t);
+
+        if (stats)
+            stats->hits++;
+    }
+
+    if (stats)
+        stats->nodesVisited += nodesVisited;
+}
@@ -0,0 +1,253 @@
+#pragma once
+
+#ifndef _BVH
+#define _BVH
+
+#include <vector>
+#include <cfloat>
+#include <future>
+
+#include <glm/glm.hpp>
+
+#include "geomlib.h"
+
+class Mesh;
+class Entity;
+
+// Max number of rays traced together as one packet
+#define BVH_PACKET_SIZE 16
+
+
+enum class RayQueryMode
+{
+	CLOSEST_HIT, // Nearest hit along the ray
+	ANY_HIT // Stop at the first hit found, for visibility tests
+};
+
+
+// Counters gathered while tracing rays
+struct RayQueryStats
+{
+	unsigned long long rays = 0;
+	unsigned long long hits = 0;
+	unsigned long long packets = 0; // Packets traced, rays in divergent packets are traced one by one
+	unsigned long long nodesVisited = 0;
+	unsigned long long trianglesTested = 0;
+
+	void add(const RayQueryStats& other)
+	{
+		rays += other.rays;
+		hits += other.hits;
+		packets += other.packets;
+		nodesVisited += other.nodesVisited;
+		trianglesTested += other.trianglesTested;
+	}
+};
+
+
+// Result of a ray query against a BVH
+struct RayHit
+{
+	bool hit = false;
+
+	float t = FLT_MAX; // Ray parameter of closest hit
+
+	glm::vec3 position = { 0.0f, 0.0f, 0.0f }; // World space hit position
+	glm::vec3 normal = { 0.0f, 0.0f, 1.0f }; // World space geometric normal
+
+	Entity* entity = nullptr; // Entity that was hit
+
+	unsigned int subMesh = 0; // Sub-mesh that was hit
+	unsigned int triangle = 0; // Triangle index within the sub-mesh
+};
+
+
+// Node of a flattened BVH. Children of an internal node are stored next to each other,
+// so only the index of the left child is kept. Leaves store a range of primitive indices.
+struct BVHNode
+{
+	glm::vec3 boxMin;
+	unsigned int leftFirst; // Left child index (internal) or first primitive (leaf)
+	glm::vec3 boxMax;
+	unsigned int count; // Number of primitives, 0 for internal nodes
+
+	bool isLeaf() const { return count > 0; }
+};
+
+
+// Bounds of a single primitive, used while building
+struct BVHPrimitive
+{
+	glm::vec3 boxMin;
+	glm::vec3 boxMax;
+	glm::vec3 centroid;
+};
+
+
+// Flattened tree plus refit and background rebuild support. Shared by both BVH levels.
+class BVHTree
+{
+public:
+	BVHTree() {}
+
+	void clear();
+
+	// Full build over a set of primitives
+	void build(const std::vector<BVHPrimitive>& prims);
+
+	// Recompute node bounds bottom-up. The tree layout is kept, so prims must match the last build
+	void refit(const std::vector<BVHPrimitive>& prims);
+
+	// True when refitted bounds are so loose that a rebuild would pay off
+	bool isDegraded() const;
+
+	// Build a new tree on a worker thread from a copy of prims
+	void rebuildAsync(const std::vector<BVHPrimitive>& prims);
+
+	// Swap in a finished background build and refit it to prims. Returns true if swapped
+	bool finishRebuild(const std::vector<BVHPrimitive>& prims);
+
+	bool isRebuilding() const { return pending.valid(); }
+
+	// SAH cost of the tree right after it was built and after the last refit
+	float getBuildCost() const { return buildCost; }
+	float getCost() const { return cost; }
+
+	std::vector<BVHNode> nodes;
+	std::vector<unsigned int> indices; // Leaf ranges index into this, which indexes primitives
+
+private:
+	struct Result
+	{
+		std::vector<BVHNode> nodes;
+		std::vector<unsigned int> indices;
+		float cost = 0.0f;
+	};
+
+	float buildCost = 0.0f;
+	float cost = 0.0f;
+
+	std::future<Result> pending;
+};
+
+
+// Object space triangle referenced by a bottom level BVH
+struct BVHTriangle
+{
+	glm::vec3 v0, v1, v2;
+
+	unsigned int subMesh; // Sub-mesh this triangle came from
+	unsigned int index; // Triangle index within the sub-mesh
+};
+
+
+// Bottom level acceleration structure. Built once per Mesh over all of its sub-meshes in object space.
+class MeshBVH
+{
+public:
+	explicit MeshBVH(Mesh* _mesh);
+
+	// Gather triangles from the mesh and build the tree
+	void build();
+
+	// Re-read vertex positions and refit. Falls back to build() if the triangle count changed
+	void refit();
+
+	// Swap in a finished background rebuild. Call once per frame
+	void update();
+
+	// Single ray. hit.t is used as the max distance and updated on a closer hit
+	bool intersect(const Ray3D& ray, RayHit& hit, RayQueryMode mode = RayQueryMode::CLOSEST_HIT, RayQueryStats* stats = nullptr) const;
+
+	// Up to BVH_PACKET_SIZE rays that share direction signs. Only rays set in mask are traced.
+	// Returns the mask of rays that hit this mesh
+	unsigned int intersectPacket(const Ray3D* rays, RayHit* hits, unsigned int mask, RayQueryMode mode, RayQueryStats* stats) const;
+
+	// Object space bounds of the whole mesh
+	glm::vec3 getMin() const { return tree.nodes.empty() ? glm::vec3(0.0f) : tree.nodes[0].boxMin; }
+	glm::vec3 getMax() const { return tree.nodes.empty() ? glm::vec3(0.0f) : tree.nodes[0].boxMax; }
+
+	unsigned int numNodes() const { return static_cast<unsigned int>(tree.nodes.size()); }
+	unsigned int numTriangles() const { return static_cast<unsigned int>(triangles.size()); }
+
+	const std::vector<BVHNode>& getNodes() const { return tree.nodes; }
+	const BVHTree& getTree() const { return tree; }
+
+	// Bumped every time the bounds change, so instances know to update
+	unsigned int getVersion() const { return version; }
+
+private:
+	void gatherTriangles();
+	bool updateTriangles();
+	std::vector<BVHPrimitive> getPrimitives() const;
+
+	Mesh* mesh;
+
+	BVHTree tree;
+	std::vector<BVHTriangle> triangles;
+
+	unsigned int version = 0;
+};
+
+
+// Entity instance referenced by the top level acceleration structure
+struct BVHInstance
+{
+	Entity* entity = nullptr;
+	MeshBVH* blas = nullptr;
+
+	glm::mat4 transform = glm::mat4(1.0f); // Object to world
+	glm::mat4 invTransform = glm::mat4(1.0f); // World to object
+
+	glm::vec3 boxMin, boxMax; // World space bounds of the instance
+
+	unsigned int blasVersion = 0; // Mesh BVH version the bounds were computed from
+
+	bool enabled = true; // False while the transform can't be inverted
+};
+
+
+// Top level acceleration structure over entity instances. Rays are moved into
+// object space at the leaves and traced against the instance's mesh BVH.
+class SceneBVH
+{
+public:
+	SceneBVH() {}
+
+	void clear();
+
+	// Add an instance of a mesh BVH with an object to world transform
+	void addInstance(Entity* entity, MeshBVH* blas, const glm::mat4& transform);
+
+	// Change an instance transform and recompute its bounds. Call refit() after moving instances
+	void setTransform(unsigned int instance, const glm::mat4& transform);
+
+	// Build the tree over all instances
+	void build();
+
+	// Refit after instances moved. Starts a background rebuild once the tree degrades too far
+	void refit();
+
+	// Swap in a finished background rebuild. Call once per frame
+	void update();
+
+	// Single ray against all instances
+	bool intersect(const Ray3D& ray, RayHit& hit, RayQueryMode mode = RayQueryMode::CLOSEST_HIT, RayQueryStats* stats = nullptr) const;
+
+	// Packet of up to BVH_PACKET_SIZE rays that share direction signs
+	void intersectPacket(const Ray3D* rays, RayHit* hits, unsigned int count, RayQueryMode mode, RayQueryStats* stats) const;
+
+	std::vector<BVHInstance>& getInstances() { return instances; }
+	const std::vector<BVHNode>& getNodes() const { return tree.nodes; }
+	const BVHTree& getTree() const { return tree; }
+
+private:
+	void updateInstanceBounds(BVHInstance& instance);
+	std::vector<BVHPrimitive> getPrimitives() const;
+
+	std::vector<BVHInstance> instances;
+
+	BVHTree tree;
+};
+
+#endif
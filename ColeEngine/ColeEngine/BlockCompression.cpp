@@ -0,0 +1,578 @@
+#include "BlockCompression.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "CTexture.h"
+#include "ThreadPool.h"
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define BLOCK_COMPRESSION_SSE2
+#include <emmintrin.h>
+#endif
+
+// Rows of blocks handed to each job
+#define BLOCK_ROWS_PER_JOB 4
+
+// Largest finite half float
+#define HALF_MAX 0x7BFF
+
+
+uint16_t floatToHalf(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    uint32_t sign = (bits >> 16) & 0x8000;
+    uint32_t mantissa = bits & 0x7FFFFF;
+    int exponent = static_cast<int>((bits >> 23) & 0xFF);
+
+    // Infinity and NaN
+    if (exponent == 0xFF)
+        return static_cast<uint16_t>(sign | 0x7C00 | (mantissa ? 0x200 : 0));
+
+    exponent = exponent - 127 + 15;
+
+    if (exponent >= 31)
+        return static_cast<uint16_t>(sign | 0x7C00);
+
+    // Denormal or too small for a half
+    if (exponent <= 0)
+    {
+        if (exponent < -10)
+            return static_cast<uint16_t>(sign);
+
+        mantissa |= 0x800000;
+
+        uint32_t shift = static_cast<uint32_t>(14 - exponent);
+        uint32_t half = mantissa >> shift;
+
+        if ((mantissa >> (shift - 1)) & 1)
+            half++;
+
+        return static_cast<uint16_t>(sign | half);
+    }
+
+    uint32_t half = sign | (static_cast<uint32_t>(exponent) << 10) | (mantissa >> 13);
+
+    // A carry into the exponent is still the right answer
+    if (mantissa & 0x1000)
+        half++;
+
+    return static_cast<uint16_t>(half);
+}
+
+
+// Ends of the segment through colors along their principal axis
+static void principalEndpoints(const float colors[16][3], float lo[3], float hi[3])
+{
+    float mean[3] = {};
+
+    for (int i = 0; i < 16; i++)
+    {
+        for (int c = 0; c < 3; c++)
+            mean[c] += colors[i][c];
+    }
+
+    for (int c = 0; c < 3; c++)
+        mean[c] /= 16.0f;
+
+    // xx, xy, xz, yy, yz, zz
+    float cov[6] = {};
+
+    for (int i = 0; i < 16; i++)
+    {
+        float d[3] = { colors[i][0] - mean[0], colors[i][1] - mean[1], colors[i][2] - mean[2] };
+
+        cov[0] += d[0] * d[0];
+        cov[1] += d[0] * d[1];
+        cov[2] += d[0] * d[2];
+        cov[3] += d[1] * d[1];
+        cov[4] += d[1] * d[2];
+        cov[5] += d[2] * d[2];
+    }
+
+    // Power iteration, starting from the channel that varies most
+    float axis[3] = { 0.0f, 0.0f, 0.0f };
+
+    if (cov[0] >= cov[3] && cov[0] >= cov[5])
+        axis[0] = 1.0f;
+    else if (cov[3] >= cov[5])
+        axis[1] = 1.0f;
+    else
+        axis[2] = 1.0f;
+
+    for (int i = 0; i < 8; i++)
+    {
+        float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+        float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+        float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+
+        float scale = std::max(std::fabs(x), std::max(std::fabs(y), std::fabs(z)));
+
+        // Flat block, every color is the mean
+        if (scale < 1e-12f)
+        {
+            memcpy(lo, mean, sizeof(mean));
+            memcpy(hi, mean, sizeof(mean));
+            return;
+        }
+
+        axis[0] = x / scale;
+        axis[1] = y / scale;
+        axis[2] = z / scale;
+    }
+
+    float length = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+
+    for (int c = 0; c < 3; c++)
+        axis[c] /= length;
+
+    float minT = 0.0f, maxT = 0.0f;
+
+    for (int i = 0; i < 16; i++)
+    {
+        float t = (colors[i][0] - mean[0]) * axis[0] + (colors[i][1] - mean[1]) * axis[1] + (colors[i][2] - mean[2]) * axis[2];
+
+        minT = std::min(minT, t);
+        maxT = std::max(maxT, t);
+    }
+
+    for (int c = 0; c < 3; c++)
+    {
+        lo[c] = mean[c] + axis[c] * minT;
+        hi[c] = mean[c] + axis[c] * maxT;
+    }
+}
+
+
+// 4x4 RGBA8 pixels starting at block (bx, by)
+static void loadBlock(const unsigned char* pixels, uint32_t width, uint32_t height, uint32_t bx, uint32_t by, unsigned char block[64])
+{
+    for (uint32_t y = 0; y < 4; y++)
+    {
+        uint32_t sy = std::min(by * 4 + y, height - 1);
+
+        for (uint32_t x = 0; x < 4; x++)
+        {
+            uint32_t sx = std::min(bx * 4 + x, width - 1);
+
+            memcpy(block + (y * 4 + x) * 4, pixels + (sy * width + sx) * 4, 4);
+        }
+    }
+}
+
+
+// 4x4 RGB of a RGBA float image, as half float bits
+static void loadBlockHalf(const float* pixels, uint32_t width, uint32_t height, uint32_t bx, uint32_t by, float block[16][3])
+{
+    for (uint32_t y = 0; y < 4; y++)
+    {
+        uint32_t sy = std::min(by * 4 + y, height - 1);
+
+        for (uint32_t x = 0; x < 4; x++)
+        {
+            uint32_t sx = std::min(bx * 4 + x, width - 1);
+
+            const float* src = pixels + (sy * width + sx) * 4;
+
+            for (int c = 0; c < 3; c++)
+            {
+                // Also catches NaN
+                uint16_t half = src[c] > 0.0f ? floatToHalf(src[c]) : 0;
+
+                block[y * 4 + x][c] = static_cast<float>(std::min<uint16_t>(half, HALF_MAX));
+            }
+        }
+    }
+}
+
+
+static uint16_t to565(const float color[3])
+{
+    int r = static_cast<int>(std::min(std::max(color[0], 0.0f), 255.0f) * 31.0f / 255.0f + 0.5f);
+    int g = static_cast<int>(std::min(std::max(color[1], 0.0f), 255.0f) * 63.0f / 255.0f + 0.5f);
+    int b = static_cast<int>(std::min(std::max(color[2], 0.0f), 255.0f) * 31.0f / 255.0f + 0.5f);
+
+    return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+}
+
+
+static void from565(uint16_t color, int out[3])
+{
+    int r = (color >> 11) & 31;
+    int g = (color >> 5) & 63;
+    int b = color & 31;
+
+    out[0] = (r << 3) | (r >> 2);
+    out[1] = (g << 2) | (g >> 4);
+    out[2] = (b << 3) | (b >> 2);
+}
+
+
+// Nearest of four colors for each pixel, 2 bits per pixel
+static uint32_t matchColors(const unsigned char block[64], const int palette[4][3])
+{
+    uint32_t indices = 0;
+
+#ifdef BLOCK_COMPRESSION_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i rgbMask = _mm_set1_epi32(0x00FFFFFF);
+
+    __m128i colors[4];
+
+    for (int i = 0; i < 4; i++)
+    {
+        colors[i] = _mm_setr_epi16(static_cast<short>(palette[i][0]), static_cast<short>(palette[i][1]), static_cast<short>(palette[i][2]), 0,
+                                   static_cast<short>(palette[i][0]), static_cast<short>(palette[i][1]), static_cast<short>(palette[i][2]), 0);
+    }
+
+    // Four pixels at a time, widened to 16 bits two per register
+    for (int i = 0; i < 16; i += 4)
+    {
+        __m128i pixels = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(block + i * 4)), rgbMask);
+
+        __m128i lo = _mm_unpacklo_epi8(pixels, zero);
+        __m128i hi = _mm_unpackhi_epi8(pixels, zero);
+
+        __m128i best = zero;
+        __m128i bestIndex = zero;
+
+        for (int c = 0; c < 4; c++)
+        {
+            __m128i dLo = _mm_sub_epi16(lo, colors[c]);
+            __m128i dHi = _mm_sub_epi16(hi, colors[c]);
+
+            // r*r + g*g and b*b per pixel, then summed to one distance per pixel
+            dLo = _mm_madd_epi16(dLo, dLo);
+            dHi = _mm_madd_epi16(dHi, dHi);
+
+            __m128i even = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(dLo), _mm_castsi128_ps(dHi), _MM_SHUFFLE(2, 0, 2, 0)));
+            __m128i odd = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(dLo), _mm_castsi128_ps(dHi), _MM_SHUFFLE(3, 1, 3, 1)));
+            __m128i distance = _mm_add_epi32(even, odd);
+
+            if (c == 0)
+            {
+                best = distance;
+                continue;
+            }
+
+            __m128i closer = _mm_cmplt_epi32(distance, best);
+
+            best = _mm_or_si128(_mm_and_si128(closer, distance), _mm_andnot_si128(closer, best));
+            bestIndex = _mm_or_si128(_mm_and_si128(closer, _mm_set1_epi32(c)), _mm_andnot_si128(closer, bestIndex));
+        }
+
+        uint32_t found[4];
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(found), bestIndex);
+
+        for (int j = 0; j < 4; j++)
+            indices |= found[j] << ((i + j) * 2);
+    }
+#else
+    for (int i = 0; i < 16; i++)
+    {
+        int best = 0x7FFFFFFF;
+        uint32_t bestIndex = 0;
+
+        for (uint32_t c = 0; c < 4; c++)
+        {
+            int dr = block[i * 4 + 0] - palette[c][0];
+            int dg = block[i * 4 + 1] - palette[c][1];
+            int db = block[i * 4 + 2] - palette[c][2];
+            int distance = dr * dr + dg * dg + db * db;
+
+            if (distance < best)
+            {
+                best = distance;
+                bestIndex = c;
+            }
+        }
+
+        indices |= bestIndex << (i * 2);
+    }
+#endif
+
+    return indices;
+}
+
+
+static void encodeBC1(const unsigned char block[64], unsigned char* out)
+{
+    float colors[16][3];
+
+    for (int i = 0; i < 16; i++)
+    {
+        for (int c = 0; c < 3; c++)
+            colors[i][c] = block[i * 4 + c];
+    }
+
+    float lo[3], hi[3];
+    principalEndpoints(colors, lo, hi);
+
+    // Pull the ends in a little, extremes are usually outliers and the interpolated colors cover more
+    for (int c = 0; c < 3; c++)
+    {
+        float inset = (hi[c] - lo[c]) / 16.0f;
+        hi[c] -= inset;
+        lo[c] += inset;
+    }
+
+    uint16_t color0 = to565(hi);
+    uint16_t color1 = to565(lo);
+
+    // color0 > color1 selects four colors instead of three and transparent black
+    if (color0 < color1)
+        std::swap(color0, color1);
+
+    uint32_t indices = 0;
+
+    if (color0 != color1)
+    {
+        int palette[4][3];
+        from565(color0, palette[0]);
+        from565(color1, palette[1]);
+
+        for (int c = 0; c < 3; c++)
+        {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+
+        indices = matchColors(block, palette);
+    }
+
+    out[0] = static_cast<unsigned char>(color0 & 0xFF);
+    out[1] = static_cast<unsigned char>(color0 >> 8);
+    out[2] = static_cast<unsigned char>(color1 & 0xFF);
+    out[3] = static_cast<unsigned char>(color1 >> 8);
+
+    for (int i = 0; i < 4; i++)
+        out[4 + i] = static_cast<unsigned char>(indices >> (i * 8));
+}
+
+
+// One channel, the alpha half of BC3 and each half of BC5
+static void encodeBC4(const unsigned char block[64], int channel, unsigned char* out)
+{
+    int lo = 255, hi = 0;
+
+    for (int i = 0; i < 16; i++)
+    {
+        lo = std::min<int>(lo, block[i * 4 + channel]);
+        hi = std::max<int>(hi, block[i * 4 + channel]);
+    }
+
+    // hi > lo selects eight evenly spaced values, hi first and lo second
+    out[0] = static_cast<unsigned char>(hi);
+    out[1] = static_cast<unsigned char>(lo);
+
+    uint64_t indices = 0;
+
+    if (hi > lo)
+    {
+        // Steps from lo to their index
+        static const uint64_t order[8] = { 1, 7, 6, 5, 4, 3, 2, 0 };
+
+        int range = hi - lo;
+
+        for (int i = 0; i < 16; i++)
+        {
+            int step = ((block[i * 4 + channel] - lo) * 14 + range) / (2 * range);
+
+            indices |= order[step] << (i * 3);
+        }
+    }
+
+    for (int i = 0; i < 6; i++)
+        out[2 + i] = static_cast<unsigned char>(indices >> (i * 8));
+}
+
+
+// BC6H endpoints are unquantized to 16 bits, interpolated, then scaled into half float range
+static int unquantizeBC6H(int value)
+{
+    if (value == 0)
+        return 0;
+
+    if (value == 1023)
+        return 0xFFFF;
+
+    return ((value << 16) + 0x8000) >> 10;
+}
+
+
+static int finishBC6H(int value)
+{
+    return (value * 31) >> 6;
+}
+
+
+// Closest 10 bit endpoint to a half float
+static int quantizeBC6H(float half)
+{
+    int q = std::min(static_cast<int>(half * 64.0f / 31.0f) >> 6, 1023);
+
+    if (q < 1023 && std::fabs(finishBC6H(unquantizeBC6H(q + 1)) - half) < std::fabs(finishBC6H(unquantizeBC6H(q)) - half))
+        q++;
+
+    return q;
+}
+
+
+// Writes fields LSB first across the 16 bytes of a block
+struct BlockWriter
+{
+    unsigned char* out;
+    unsigned int bit;
+
+    void write(uint32_t value, unsigned int bits)
+    {
+        for (unsigned int i = 0; i < bits; i++, bit++)
+        {
+            if ((value >> i) & 1)
+                out[bit >> 3] |= static_cast<unsigned char>(1 << (bit & 7));
+        }
+    }
+};
+
+
+// Mode 11 only: one region, 10 bit endpoints and 4 bit indices. It handles the smooth gradients of
+// sky images well, the two region modes would mostly help hard edges
+static void encodeBC6H(const float block[16][3], unsigned char* out)
+{
+    static const int weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+    float lo[3], hi[3];
+    principalEndpoints(block, lo, hi);
+
+    int endpoints[2][3];
+
+    for (int c = 0; c < 3; c++)
+    {
+        endpoints[0][c] = quantizeBC6H(std::min(std::max(lo[c], 0.0f), static_cast<float>(HALF_MAX)));
+        endpoints[1][c] = quantizeBC6H(std::min(std::max(hi[c], 0.0f), static_cast<float>(HALF_MAX)));
+    }
+
+    // Exactly what the decoder will produce for each index
+    float palette[16][3];
+
+    for (int i = 0; i < 16; i++)
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            int a = unquantizeBC6H(endpoints[0][c]);
+            int b = unquantizeBC6H(endpoints[1][c]);
+
+            palette[i][c] = static_cast<float>(finishBC6H((a * (64 - weights[i]) + b * weights[i] + 32) >> 6));
+        }
+    }
+
+    int indices[16];
+
+    for (int i = 0; i < 16; i++)
+    {
+        float best = 0.0f;
+
+        for (int p = 0; p < 16; p++)
+        {
+            float dr = block[i][0] - palette[p][0];
+            float dg = block[i][1] - palette[p][1];
+            float db = block[i][2] - palette[p][2];
+            float distance = dr * dr + dg * dg + db * db;
+
+            if (p == 0 || distance < best)
+            {
+                best = distance;
+                indices[i] = p;
+            }
+        }
+    }
+
+    // The first index only has 3 bits, so its top bit must be clear. Weights are symmetric, swapping ends flips them
+    if (indices[0] >= 8)
+    {
+        for (int c = 0; c < 3; c++)
+            std::swap(endpoints[0][c], endpoints[1][c]);
+
+        for (int i = 0; i < 16; i++)
+            indices[i] = 15 - indices[i];
+    }
+
+    memset(out, 0, 16);
+
+    BlockWriter writer = { out, 0 };
+
+    writer.write(0x03, 5);
+
+    for (int e = 0; e < 2; e++)
+    {
+        for (int c = 0; c < 3; c++)
+            writer.write(static_cast<uint32_t>(endpoints[e][c]), 10);
+    }
+
+    writer.write(static_cast<uint32_t>(indices[0]), 3);
+
+    for (int i = 1; i < 16; i++)
+        writer.write(static_cast<uint32_t>(indices[i]), 4);
+}
+
+
+bool compressLevel(uint32_t format, const void* pixels, uint32_t width, uint32_t height, std::vector<unsigned char>& out, ThreadPool* pool)
+{
+    const CTextureFormat* info = getTextureFormat(format);
+
+    if (!info || !info->compressed || width == 0 || height == 0)
+        return false;
+
+    uint32_t blocksX = (width + 3) / 4;
+    uint32_t blocksY = (height + 3) / 4;
+
+    out.resize(textureLevelSize(format, width, height));
+
+    auto encodeRows = [&](unsigned int begin, unsigned int end)
+    {
+        unsigned char block[64];
+        float hdrBlock[16][3];
+
+        for (uint32_t by = begin; by < end; by++)
+        {
+            for (uint32_t bx = 0; bx < blocksX; bx++)
+            {
+                unsigned char* dst = out.data() + (static_cast<size_t>(by) * blocksX + bx) * info->blockBytes;
+
+                if (format == CTEXTURE_FORMAT_BC6H)
+                {
+                    loadBlockHalf(static_cast<const float*>(pixels), width, height, bx, by, hdrBlock);
+                    encodeBC6H(hdrBlock, dst);
+                    continue;
+                }
+
+                loadBlock(static_cast<const unsigned char*>(pixels), width, height, bx, by, block);
+
+                switch (format)
+                {
+                case CTEXTURE_FORMAT_BC1:
+                    encodeBC1(block, dst);
+                    break;
+                case CTEXTURE_FORMAT_BC3:
+                    encodeBC4(block, 3, dst);
+                    encodeBC1(block, dst + 8);
+                    break;
+                case CTEXTURE_FORMAT_BC5:
+                    encodeBC4(block, 0, dst);
+                    encodeBC4(block, 1, dst + 8);
+                    break;
+                }
+            }
+        }
+    };
+
+    if (pool)
+        pool->parallelFor(blocksY, BLOCK_ROWS_PER_JOB, encodeRows);
+    else
+        encodeRows(0, blocksY);
+
+    return true;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#ifndef _BLOCK_COMPRESSION
+#define _BLOCK_COMPRESSION
+
+#include <cstdint>
+#include <vector>
+
+class ThreadPool;
+
+// CPU encoders for the BC texture formats, used by colecook. Each 4x4 block is encoded on its own,
+// with endpoints along the principal axis of its colors and SSE2 for the index search.
+//
+//   BC1  - RGBA8 in, RGB out
+//   BC3  - RGBA8 in
+//   BC5  - RGBA8 in, red and green out
+//   BC6H - RGBA float in, RGB out. Negative values are clamped to 0
+//
+// Blocks past the right or bottom edge repeat the last row and column.
+
+
+// Encode one level into out, resized to textureLevelSize. Rows of blocks are spread over pool if given.
+// False if the format isn't a block compressed one
+bool compressLevel(uint32_t format, const void* pixels, uint32_t width, uint32_t height, std::vector<unsigned char>& out, ThreadPool* pool);
+
+// IEEE half float bits, rounded to nearest
+uint16_t floatToHalf(float value);
+
+#endif
@@ -0,0 +1,304 @@
+#include "CMesh.h"
+
+#include <fstream>
+#include <cstring>
+
+#include "glew.h"
+#include "Mesh.h"
+#include "MappedFile.h"
+#include "Logging.h"
+
+
+static uint64_t alignOffset(uint64_t offset)
+{
+    return (offset + CMESH_ALIGNMENT - 1) & ~static_cast<uint64_t>(CMESH_ALIGNMENT - 1);
+}
+
+
+// Append a string to the table and return where it went
+static CMeshString addString(std::string& table, const std::string& str)
+{
+    CMeshString entry;
+    entry.offset = static_cast<uint32_t>(table.size());
+    entry.length = static_cast<uint32_t>(str.size());
+
+    table += str;
+
+    return entry;
+}
+
+
+static std::string readString(const MappedFile& file, const CMeshHeader& header, const CMeshString& entry)
+{
+    uint64_t start = header.stringOffset + entry.offset;
+
+    if (start + entry.length > file.size())
+        return std::string();
+
+    return std::string(reinterpret_cast<const char*>(file.data() + start), entry.length);
+}
+
+
+static bool inFile(const MappedFile& file, uint64_t offset, uint64_t size)
+{
+    return offset <= file.size() && size <= file.size() - offset;
+}
+
+
+bool canCookMesh(const Mesh& mesh)
+{
+    for (const MaterialData& mat : mesh.matData)
+    {
+        if (mat.diffuseTexture.isEmbedded || mat.normalTexture.isEmbedded || mat.specularTexture.isEmbedded)
+            return false;
+    }
+
+    return true;
+}
+
+
+bool cookMesh(const Mesh& mesh, const std::string& path)
+{
+    if (mesh.meshData.empty() || !canCookMesh(mesh))
+        return false;
+
+    CMeshHeader header = {};
+    header.magic = CMESH_MAGIC;
+    header.version = CMESH_VERSION;
+    header.vertexSize = sizeof(Vertex);
+    header.nSubMeshes = static_cast<uint32_t>(mesh.meshData.size());
+    header.nMaterials = static_cast<uint32_t>(mesh.matData.size());
+
+    header.subMeshOffset = sizeof(CMeshHeader);
+    header.materialOffset = header.subMeshOffset + header.nSubMeshes * sizeof(CMeshSubMesh);
+    header.stringOffset = header.materialOffset + header.nMaterials * sizeof(CMeshMaterial);
+
+    std::string strings;
+    std::vector<CMeshMaterial> materials(mesh.matData.size());
+
+    for (size_t i = 0; i < mesh.matData.size(); i++)
+    {
+        const MaterialData& src = mesh.matData[i];
+        CMeshMaterial& dst = materials[i];
+
+        dst.name = addString(strings, src.name);
+        dst.diffuseTexture = addString(strings, src.diffuseTexture.texturePath);
+        dst.normalTexture = addString(strings, src.normalTexture.texturePath);
+        dst.specularTexture = addString(strings, src.specularTexture.texturePath);
+
+        dst.flags = 0;
+        if (src.hasDiffuse) dst.flags |= CMESH_HAS_DIFFUSE;
+        if (src.hasNormals) dst.flags |= CMESH_HAS_NORMALS;
+        if (src.hasSpecular) dst.flags |= CMESH_HAS_SPECULAR;
+
+        dst.shininess = src.shininess;
+        dst.reflectivity = src.reflectivity;
+
+        memcpy(dst.diffuseColor, &src.diffuseColor[0], sizeof(dst.diffuseColor));
+        memcpy(dst.specularColor, &src.specularColor[0], sizeof(dst.specularColor));
+    }
+
+    // Vertex and index blobs follow the string table
+    uint64_t offset = header.stringOffset + strings.size();
+    std::vector<CMeshSubMesh> subMeshes(mesh.meshData.size());
+
+    for (size_t i = 0; i < mesh.meshData.size(); i++)
+    {
+        const MeshData& src = mesh.meshData[i];
+        CMeshSubMesh& dst = subMeshes[i];
+
+        dst.nVertices = static_cast<uint32_t>(src.vertices.size());
+        dst.nIndices = static_cast<uint32_t>(src.indices.size());
+        dst.materialIndex = src.materialIndex;
+        dst.pad = 0;
+
+        memcpy(dst.boundsMin, &src.boundsMin[0], sizeof(dst.boundsMin));
+        memcpy(dst.boundsMax, &src.boundsMax[0], sizeof(dst.boundsMax));
+
+        dst.vertexOffset = alignOffset(offset);
+        offset = dst.vertexOffset + src.vertices.size() * sizeof(Vertex);
+
+        dst.indexOffset = alignOffset(offset);
+        offset = dst.indexOffset + src.indices.size() * sizeof(uint32_t);
+    }
+
+    header.fileSize = offset;
+
+    std::ofstream file(path, std::ios::binary);
+
+    if (!file)
+    {
+        Log::warning("Unable to write cooked mesh: " + path);
+        return false;
+    }
+
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(subMeshes.data()), subMeshes.size() * sizeof(CMeshSubMesh));
+    file.write(reinterpret_cast<const char*>(materials.data()), materials.size() * sizeof(CMeshMaterial));
+    file.write(strings.data(), strings.size());
+
+    static const char padding[CMESH_ALIGNMENT] = {};
+    uint64_t written = header.stringOffset + strings.size();
+
+    for (size_t i = 0; i < mesh.meshData.size(); i++)
+    {
+        const MeshData& src = mesh.meshData[i];
+
+        file.write(padding, subMeshes[i].vertexOffset - written);
+        file.write(reinterpret_cast<const char*>(src.vertices.data()), src.vertices.size() * sizeof(Vertex));
+        written = subMeshes[i].vertexOffset + src.vertices.size() * sizeof(Vertex);
+
+        file.write(padding, subMeshes[i].indexOffset - written);
+        file.write(reinterpret_cast<const char*>(src.indices.data()), src.indices.size() * sizeof(uint32_t));
+        written = subMeshes[i].indexOffset + src.indices.size() * sizeof(uint32_t);
+    }
+
+    if (!file)
+    {
+        Log::warning("Failed writing cooked mesh: " + path);
+        return false;
+    }
+
+    return true;
+}
+
+
+MeshCooked::MeshCooked(std::string path, bool upload)
+    : valid(false)
+{
+    if (!file.open(path))
+    {
+        Log::warning("Unable to open cooked mesh: " + path);
+        return;
+    }
+
+    if (file.size() < sizeof(CMeshHeader))
+    {
+        Log::warning("Cooked mesh is truncated: " + path);
+        return;
+    }
+
+    CMeshHeader header;
+    memcpy(&header, file.data(), sizeof(header));
+
+    if (header.magic != CMESH_MAGIC || header.version != CMESH_VERSION || header.vertexSize != sizeof(Vertex))
+    {
+        Log::info("Cooked mesh is from another version: " + path);
+        return;
+    }
+
+    if (header.fileSize != file.size() ||
+        !inFile(file, header.subMeshOffset, header.nSubMeshes * sizeof(CMeshSubMesh)) ||
+        !inFile(file, header.materialOffset, header.nMaterials * sizeof(CMeshMaterial)))
+    {
+        Log::warning("Cooked mesh is damaged: " + path);
+        return;
+    }
+
+    const CMeshSubMesh* subMeshes = reinterpret_cast<const CMeshSubMesh*>(file.data() + header.subMeshOffset);
+    const CMeshMaterial* materials = reinterpret_cast<const CMeshMaterial*>(file.data() + header.materialOffset);
+
+    // Check every blob, material index and vertex index before using any of them
+    for (uint32_t i = 0; i < header.nSubMeshes; i++)
+    {
+        const CMeshSubMesh& sub = subMeshes[i];
+
+        if (!inFile(file, sub.vertexOffset, static_cast<uint64_t>(sub.nVertices) * sizeof(Vertex)) ||
+            !inFile(file, sub.indexOffset, static_cast<uint64_t>(sub.nIndices) * sizeof(uint32_t)) ||
+            sub.materialIndex >= header.nMaterials || sub.nIndices % 3 != 0)
+        {
+            Log::warning("Cooked mesh is damaged: " + path);
+            return;
+        }
+
+        // The BVH and glDrawElements would read past the vertices
+        const uint32_t* indices = reinterpret_cast<const uint32_t*>(file.data() + sub.indexOffset);
+
+        for (uint32_t j = 0; j < sub.nIndices; j++)
+        {
+            if (indices[j] >= sub.nVertices)
+            {
+                Log::warning("Cooked mesh is damaged: " + path);
+                return;
+            }
+        }
+    }
+
+    meshData.resize(header.nSubMeshes);
+
+    for (uint32_t i = 0; i < header.nSubMeshes; i++)
+    {
+        const CMeshSubMesh& sub = subMeshes[i];
+        MeshData& data = meshData[i];
+
+        const Vertex* vertices = reinterpret_cast<const Vertex*>(file.data() + sub.vertexOffset);
+        const unsigned int* indices = reinterpret_cast<const unsigned int*>(file.data() + sub.indexOffset);
+
+        // CPU copies are still needed for the BVH and picking
+        data.vertices.assign(vertices, vertices + sub.nVertices);
+        data.indices.assign(indices, indices + sub.nIndices);
+        data.materialIndex = sub.materialIndex;
+
+        data.boundsMin = glm::vec3(sub.boundsMin[0], sub.boundsMin[1], sub.boundsMin[2]);
+        data.boundsMax = glm::vec3(sub.boundsMax[0], sub.boundsMax[1], sub.boundsMax[2]);
+
+        // Uploaded straight from the mapping in createBuffers()
+        blobs.push_back(std::make_pair(vertices, indices));
+    }
+
+    matData.resize(header.nMaterials);
+
+    for (uint32_t i = 0; i < header.nMaterials; i++)
+    {
+        const CMeshMaterial& src = materials[i];
+        MaterialData& dst = matData[i];
+
+        dst.name = readString(file, header, src.name);
+
+        dst.hasDiffuse = (src.flags & CMESH_HAS_DIFFUSE) != 0;
+        dst.hasNormals = (src.flags & CMESH_HAS_NORMALS) != 0;
+        dst.hasSpecular = (src.flags & CMESH_HAS_SPECULAR) != 0;
+
+        dst.diffuseTexture.texturePath = readString(file, header, src.diffuseTexture);
+        dst.normalTexture.texturePath = readString(file, header, src.normalTexture);
+        dst.specularTexture.texturePath = readString(file, header, src.specularTexture);
+
+        dst.shininess = src.shininess;
+        dst.reflectivity = src.reflectivity;
+
+        dst.diffuseColor = glm::vec4(src.diffuseColor[0], src.diffuseColor[1], src.diffuseColor[2], src.diffuseColor[3]);
+        dst.specularColor = glm::vec4(src.specularColor[0], src.specularColor[1], src.specularColor[2], src.specularColor[3]);
+    }
+
+    nMeshes = header.nSubMeshes;
+    nMaterials = header.nMaterials;
+
+    // Bounds were cooked in, only the BVH is built at load
+    boundsVersion++;
+    buildBVH();
+
+    valid = true;
+
+    if (upload)
+        createBuffers();
+}
+
+
+void MeshCooked::createBuffers()
+{
+    // Already uploaded and unmapped, fill in anything missing from the CPU copies
+    if (!file.isOpen())
+    {
+        Mesh::createBuffers();
+        return;
+    }
+
+    for (size_t i = 0; i < meshData.size(); i++)
+    {
+        if (meshData[i].VAO == 0)
+            uploadSubMesh(meshData[i], blobs[i].first, blobs[i].second);
+    }
+
+    blobs.clear();
+    file.close();
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#ifndef _CMESH
+#define _CMESH
+
+#include <cstdint>
+#include <string>
+
+class Mesh;
+
+// Cooked mesh file (.cmesh). Laid out so a mapped file can be handed to GL without parsing:
+//
+//   CMeshHeader
+//   CMeshSubMesh[nSubMeshes]
+//   CMeshMaterial[nMaterials]
+//   string table
+//   per sub-mesh: Vertex[nVertices], uint32 index[nIndices], each starting on CMESH_ALIGNMENT
+//
+// Offsets are from the start of the file.
+
+#define CMESH_MAGIC 0x48534D43 // "CMSH"
+#define CMESH_VERSION 1
+#define CMESH_ALIGNMENT 16
+
+// CMeshMaterial flags
+#define CMESH_HAS_DIFFUSE 0x1
+#define CMESH_HAS_NORMALS 0x2
+#define CMESH_HAS_SPECULAR 0x4
+
+
+struct CMeshHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t vertexSize; // sizeof(Vertex) of the cooker, must match the loader
+	uint32_t nSubMeshes;
+	uint32_t nMaterials;
+	uint32_t pad;
+
+	uint64_t subMeshOffset;
+	uint64_t materialOffset;
+	uint64_t stringOffset;
+	uint64_t fileSize; // Catches truncated files
+};
+
+// Range in the string table, not null terminated
+struct CMeshString
+{
+	uint32_t offset;
+	uint32_t length;
+};
+
+struct CMeshSubMesh
+{
+	uint64_t vertexOffset;
+	uint64_t indexOffset;
+
+	uint32_t nVertices;
+	uint32_t nIndices;
+	uint32_t materialIndex;
+
+	float boundsMin[3];
+	float boundsMax[3];
+
+	uint32_t pad;
+};
+
+struct CMeshMaterial
+{
+	CMeshString name;
+	CMeshString diffuseTexture;
+	CMeshString normalTexture;
+	CMeshString specularTexture;
+
+	uint32_t flags;
+
+	float shininess;
+	float reflectivity;
+
+	float diffuseColor[4];
+	float specularColor[4];
+};
+
+
+// Embedded texels only live in the Assimp scene, so meshes using them have to be imported from source
+bool canCookMesh(const Mesh& mesh);
+
+// Write a loaded mesh as a .cmesh file. False if it can't be cooked or the write failed
+bool cookMesh(const Mesh& mesh, const std::string& path);
+
+#endif
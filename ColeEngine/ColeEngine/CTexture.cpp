@@ -0,0 +1,282 @@
+#include "CTexture.h"
+
+#include <fstream>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cctype>
+
+#include "glew.h"
+#include "stb_image.h"
+#include "Logging.h"
+#include "MappedFile.h"
+#include "BlockCompression.h"
+
+
+// Indexed by CTEXTURE_FORMAT_*
+static const CTextureFormat formats[CTEXTURE_FORMAT_COUNT] =
+{
+    { 1, 4, false, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE },
+    { 4, 8, true, GL_COMPRESSED_RGB_S3TC_DXT1_EXT, 0, 0 },
+    { 4, 16, true, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, 0, 0 },
+    { 4, 16, true, GL_COMPRESSED_RG_RGTC2, 0, 0 },
+    { 4, 16, true, GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT, 0, 0 },
+    { 1, 8, false, GL_RGBA16F, GL_RGBA, GL_HALF_FLOAT },
+};
+
+
+const CTextureFormat* getTextureFormat(uint32_t format)
+{
+    return format < CTEXTURE_FORMAT_COUNT ? &formats[format] : nullptr;
+}
+
+
+uint32_t textureLevelSize(uint32_t format, uint32_t width, uint32_t height)
+{
+    const CTextureFormat* info = getTextureFormat(format);
+
+    if (!info)
+        return 0;
+
+    return ((width + info->blockSize - 1) / info->blockSize) * ((height + info->blockSize - 1) / info->blockSize) * info->blockBytes;
+}
+
+
+static uint64_t alignOffset(uint64_t offset)
+{
+    return (offset + CTEXTURE_ALIGNMENT - 1) & ~static_cast<uint64_t>(CTEXTURE_ALIGNMENT - 1);
+}
+
+
+static unsigned char average(unsigned char a, unsigned char b, unsigned char c, unsigned char d)
+{
+    return static_cast<unsigned char>((a + b + c + d + 2) / 4);
+}
+
+static float average(float a, float b, float c, float d)
+{
+    return (a + b + c + d) * 0.25f;
+}
+
+
+// Half size RGBA level with a 2x2 box filter. Odd edges reuse the last texel
+template<typename T>
+static std::vector<T> downsample(const std::vector<T>& src, uint32_t width, uint32_t height, uint32_t& outWidth, uint32_t& outHeight)
+{
+    outWidth = std::max(width / 2, 1u);
+    outHeight = std::max(height / 2, 1u);
+
+    std::vector<T> dst(outWidth * outHeight * 4);
+
+    for (uint32_t y = 0; y < outHeight; y++)
+    {
+        uint32_t y0 = std::min(y * 2, height - 1);
+        uint32_t y1 = std::min(y * 2 + 1, height - 1);
+
+        for (uint32_t x = 0; x < outWidth; x++)
+        {
+            uint32_t x0 = std::min(x * 2, width - 1);
+            uint32_t x1 = std::min(x * 2 + 1, width - 1);
+
+            for (uint32_t c = 0; c < 4; c++)
+            {
+                dst[(y * outWidth + x) * 4 + c] = average(src[(y0 * width + x0) * 4 + c], src[(y0 * width + x1) * 4 + c],
+                                                          src[(y1 * width + x0) * 4 + c], src[(y1 * width + x1) * 4 + c]);
+            }
+        }
+    }
+
+    return dst;
+}
+
+
+// Full mip chain, largest first, along with each level's size
+template<typename T>
+static void buildMips(std::vector<std::vector<T>>& levels, std::vector<CTextureLevel>& table, uint32_t width, uint32_t height)
+{
+    while (true)
+    {
+        CTextureLevel level = {};
+        level.width = width;
+        level.height = height;
+        table.push_back(level);
+
+        if (width == 1 && height == 1)
+            break;
+
+        levels.push_back(downsample(levels.back(), width, height, width, height));
+    }
+}
+
+
+static bool endsWith(const std::string& text, const std::string& suffix)
+{
+    if (text.size() < suffix.size())
+        return false;
+
+    return std::equal(suffix.begin(), suffix.end(), text.end() - suffix.size(), [](char a, char b)
+    {
+        return tolower(static_cast<unsigned char>(a)) == tolower(static_cast<unsigned char>(b));
+    });
+}
+
+
+// Normal maps are named *_NRM, like concrete_1_NRM.png
+static bool isNormalMap(const std::string& path)
+{
+    size_t dot = path.find_last_of('.');
+    std::string stem = dot == std::string::npos ? path : path.substr(0, dot);
+
+    return endsWith(stem, "_NRM");
+}
+
+
+bool cookTexture(const std::string& sourcePath, const std::string& path, ThreadPool* pool)
+{
+    int width = 0, height = 0, channels = 0;
+
+    std::vector<std::vector<unsigned char>> levels;
+    std::vector<CTextureLevel> table;
+    uint32_t format;
+
+    if (endsWith(sourcePath, ".hdr"))
+    {
+        // Stays linear, stbi_load would tone map it down to 8 bits
+        float* pixels = stbi_loadf(sourcePath.c_str(), &width, &height, &channels, 4);
+
+        if (!pixels)
+        {
+            Log::warning("Unable to decode texture: " + sourcePath);
+            return false;
+        }
+
+        std::vector<std::vector<float>> hdrLevels;
+        hdrLevels.emplace_back(pixels, pixels + width * height * 4);
+        stbi_image_free(pixels);
+
+        buildMips(hdrLevels, table, width, height);
+
+        format = CTEXTURE_FORMAT_BC6H;
+        levels.resize(hdrLevels.size());
+
+        for (size_t i = 0; i < hdrLevels.size(); i++)
+            compressLevel(format, hdrLevels[i].data(), table[i].width, table[i].height, levels[i], pool);
+    }
+    else
+    {
+        // Always expand to RGBA, the encoders work on whole pixels
+        unsigned char* pixels = stbi_load(sourcePath.c_str(), &width, &height, &channels, 4);
+
+        if (!pixels)
+        {
+            Log::warning("Unable to decode texture: " + sourcePath);
+            return false;
+        }
+
+        std::vector<std::vector<unsigned char>> rgbaLevels;
+        rgbaLevels.emplace_back(pixels, pixels + width * height * 4);
+        stbi_image_free(pixels);
+
+        if (isNormalMap(sourcePath))
+        {
+            format = CTEXTURE_FORMAT_BC5;
+        }
+        else
+        {
+            const std::vector<unsigned char>& base = rgbaLevels[0];
+            bool hasAlpha = false;
+
+            for (size_t i = 3; i < base.size() && !hasAlpha; i += 4)
+                hasAlpha = base[i] != 255;
+
+            format = hasAlpha ? CTEXTURE_FORMAT_BC3 : CTEXTURE_FORMAT_BC1;
+        }
+
+        buildMips(rgbaLevels, table, width, height);
+
+        levels.resize(rgbaLevels.size());
+
+        for (size_t i = 0; i < rgbaLevels.size(); i++)
+            compressLevel(format, rgbaLevels[i].data(), table[i].width, table[i].height, levels[i], pool);
+    }
+
+    for (size_t i = 0; i < table.size(); i++)
+        table[i].size = static_cast<uint32_t>(levels[i].size());
+
+    CTextureHeader header = {};
+    header.magic = CTEXTURE_MAGIC;
+    header.version = CTEXTURE_VERSION;
+    header.width = static_cast<uint32_t>(width);
+    header.height = static_cast<uint32_t>(height);
+    header.channels = static_cast<uint32_t>(channels);
+    header.format = format;
+    header.nLevels = static_cast<uint32_t>(table.size());
+
+    uint64_t offset = sizeof(CTextureHeader) + table.size() * sizeof(CTextureLevel);
+
+    for (CTextureLevel& level : table)
+    {
+        level.offset = alignOffset(offset);
+        offset = level.offset + level.size;
+    }
+
+    header.fileSize = offset;
+
+    std::ofstream file(path, std::ios::binary);
+
+    if (!file)
+    {
+        Log::warning("Unable to write cooked texture: " + path);
+        return false;
+    }
+
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(table.data()), table.size() * sizeof(CTextureLevel));
+
+    static const char padding[CTEXTURE_ALIGNMENT] = {};
+    uint64_t written = sizeof(CTextureHeader) + table.size() * sizeof(CTextureLevel);
+
+    for (size_t i = 0; i < table.size(); i++)
+    {
+        file.write(padding, table[i].offset - written);
+        file.write(reinterpret_cast<const char*>(levels[i].data()), table[i].size);
+        written = table[i].offset + table[i].size;
+    }
+
+    if (!file)
+    {
+        Log::warning("Failed writing cooked texture: " + path);
+        return false;
+    }
+
+    return true;
+}
+
+
+bool readCookedTexture(const MappedFile& file, CTextureHeader& header, const CTextureLevel*& levels)
+{
+    if (file.size() < sizeof(CTextureHeader))
+        return false;
+
+    memcpy(&header, file.data(), sizeof(header));
+
+    if (header.magic != CTEXTURE_MAGIC || header.version != CTEXTURE_VERSION || !getTextureFormat(header.format) ||
+        header.fileSize != file.size() || header.nLevels == 0 ||
+        sizeof(CTextureHeader) + header.nLevels * sizeof(CTextureLevel) > file.size())
+    {
+        return false;
+    }
+
+    levels = reinterpret_cast<const CTextureLevel*>(file.data() + sizeof(CTextureHeader));
+
+    for (uint32_t i = 0; i < header.nLevels; i++)
+    {
+        if (levels[i].offset > file.size() || levels[i].size > file.size() - levels[i].offset ||
+            levels[i].size != textureLevelSize(header.format, levels[i].width, levels[i].height))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
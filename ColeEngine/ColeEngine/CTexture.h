@@ -0,0 +1,85 @@
+#pragma once
+
+#ifndef _CTEXTURE
+#define _CTEXTURE
+
+#include <cstdint>
+#include <string>
+
+class MappedFile;
+class ThreadPool;
+
+// Cooked texture file (.ctex). Every mip level is stored ready for glTexImage2D, or
+// glCompressedTexImage2D for the block compressed formats:
+//
+//   CTextureHeader
+//   CTextureLevel[nLevels], largest first
+//   level data, each starting on CTEXTURE_ALIGNMENT
+//
+// Offsets are from the start of the file.
+
+#define CTEXTURE_MAGIC 0x58455443 // "CTEX"
+#define CTEXTURE_VERSION 2
+#define CTEXTURE_ALIGNMENT 16
+
+// Pixel formats
+#define CTEXTURE_FORMAT_RGBA8 0
+#define CTEXTURE_FORMAT_BC1 1     // Opaque color
+#define CTEXTURE_FORMAT_BC3 2     // Color with alpha
+#define CTEXTURE_FORMAT_BC5 3     // Normal maps, x and y only. Shaders rebuild z
+#define CTEXTURE_FORMAT_BC6H 4    // HDR images, unsigned half float RGB
+#define CTEXTURE_FORMAT_RGBA16F 5 // HDR images loaded uncooked, never written to .ctex
+#define CTEXTURE_FORMAT_COUNT 6
+
+
+struct CTextureHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t width;
+	uint32_t height;
+	uint32_t channels; // Of the source image, levels are always stored in format
+	uint32_t format;
+	uint32_t nLevels;
+	uint32_t pad;
+
+	uint64_t fileSize; // Catches truncated files
+};
+
+struct CTextureLevel
+{
+	uint64_t offset;
+	uint32_t width;
+	uint32_t height;
+	uint32_t size;
+	uint32_t pad;
+};
+
+struct CTextureFormat
+{
+	uint32_t blockSize;  // Pixels along each side of a block, 1 if uncompressed
+	uint32_t blockBytes;
+	bool compressed;
+
+	uint32_t glInternalFormat;
+	uint32_t glFormat; // Uncompressed only
+	uint32_t glType;   // Uncompressed only
+};
+
+
+// Layout and GL enums of a format, nullptr if it isn't one
+const CTextureFormat* getTextureFormat(uint32_t format);
+
+// Bytes in one level, compressed levels are whole blocks
+uint32_t textureLevelSize(uint32_t format, uint32_t width, uint32_t height);
+
+
+// Decode an image and write it with a full mip chain as a .ctex file. The format is picked from the
+// image: BC6H for .hdr, BC5 for normal maps (*_NRM), BC3 if any alpha is used and BC1 otherwise.
+// Blocks are encoded on pool if given
+bool cookTexture(const std::string& sourcePath, const std::string& path, ThreadPool* pool = nullptr);
+
+// Check a mapped .ctex file and find its level table. False if it is damaged or from another version
+bool readCookedTexture(const MappedFile& file, CTextureHeader& header, const CTextureLevel*& levels);
+
+#endif
@@ -10,6 +10,17 @@ class Material;
 
 
 
+glm::mat4 TransformComponent::getModelMatrix() const
+{
+	glm::mat4 modelMatrix(1.0f);
+	modelMatrix = glm::translate(modelMatrix, pos);
+	modelMatrix = glm::rotate(modelMatrix, angle, rot);
+	modelMatrix = glm::scale(modelMatrix, scl * glm::vec3(0.01f, 0.01f, 0.01f));
+
+	return modelMatrix;
+}
+
+
 void RenderComponent::setMaterial(Material* _material, Entity* _entity, unsigned int index)
 {
 
@@ -42,7 +53,7 @@ void RenderComponent::setMaterialsFromMesh(ResourceManager* resource)
 		// Fill material slots with references to the materials in model
 		for (unsigned int i = 0; i < nMaterials; i++)
 		{
-			materials.push_back(resource->getMaterial(mesh->matData[i].name));
+			materials.push_back(resource->getMaterial(StringID(mesh->matData[i].name)));
 		}
 	}
 }
\ No newline at end of file
@@ -91,6 +91,12 @@ public:
 	float angle = 0.0f;
 
 	bool needsUpdate = true;
+
+	// Rarely moves. Static entities are cached in point light shadow maps
+	bool isStatic = false;
+
+	// Object to world matrix, built the same way as the render passes
+	glm::mat4 getModelMatrix() const;
 };
 
 	
@@ -103,12 +109,12 @@ public:
 
 	// object mesh
 	Shape* mesh2 = nullptr;
-	Mesh* mesh = nullptr;
+	Handle<Mesh> mesh;
 
 	bool isSky = false;
 
 	// Object material slots
-	std::vector<Material*> materials;
+	std::vector<Handle<Material>> materials;
 
 	// Set a slot's material
 	void setMaterial(Material* _material, Entity* _entity, unsigned int index);
@@ -150,7 +156,7 @@ public:
 	// Light color
 	glm::vec3 color = { 1.0f, 1.0f, 1.0f };
 
-	// Shadowmap resolution
+	// Largest shadow atlas tile per cube face, only x is used
 	glm::ivec2 resolution = { 1024, 1024 };
 
 	// Light strength
@@ -180,6 +186,17 @@ public:
 
 	Box3D* box = nullptr;
 
+	// World space bounds of every sub-mesh. Cached until the transform or mesh bounds change
+	std::vector<glm::vec3> subMin, subMax;
+	std::vector<unsigned char> subVisible;
+
+	glm::mat4 modelMatrix = glm::mat4(0.0f); // Matrix the cached bounds were made with
+	unsigned int boundsVersion = 0; // Mesh bounds version the cached bounds were made with
+
+	// Set for the frame the bounds were recomputed. prevMin/prevMax are the entity bounds before that
+	bool changed = false;
+	glm::vec3 prevMin = { 0.0f, 0.0f, 0.0f };
+	glm::vec3 prevMax = { 0.0f, 0.0f, 0.0f };
 };
 
 class TerrainComponent : public Component
@@ -195,14 +212,6 @@ public:
 
 };
 
-/*
-RenderComponent& operator=(Entity* _entity)
-{
-	material->addReference(_entity);
-
-	return *this;
-}
-*/
 
 
 
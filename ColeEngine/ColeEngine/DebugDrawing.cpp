@@ -136,7 +136,7 @@ void DebugAABB::draw(glm::vec3 pos, glm::vec3 scale, ShaderProgram* program)
     transform = glm::scale(transform, scale * glm::vec3(0.01f, 0.01f, 0.01f));
 
     // Set transformation for vertex shader
-    int loc = glGetUniformLocation(program->programId, "ModelTr");
+    int loc = program->getUniformLocation("ModelTr"_sid);
     glUniformMatrix4fv(loc, 1, GL_FALSE, Pntr(transform));
 
     // Draw
@@ -159,11 +159,11 @@ void DebugAABB::draw(Entity* entity, ShaderProgram* program)
 
 
         // Set lines color for fragment shader
-        int loc = glGetUniformLocation(program->programId, "diffuse");
+        int loc = program->getUniformLocation("diffuse"_sid);
         glUniform3fv(loc, 1, &color[0]);
 
         // Set transformation for vertex shader
-        loc = glGetUniformLocation(program->programId, "ModelTr");
+        loc = program->getUniformLocation("ModelTr"_sid);
         glUniformMatrix4fv(loc, 1, GL_FALSE, Pntr(transform));
 
 
@@ -200,10 +200,10 @@ void DebugGimbal::drawLine(glm::vec3 from, glm::vec3 to, ShaderProgram* program)
 {
     transform = Translate(from) * Scale(to - from);
 
-    int loc = glGetUniformLocation(program->programId, "ModelTr");
+    int loc = program->getUniformLocation("ModelTr"_sid);
     glUniformMatrix4fv(loc, 1, GL_FALSE, Pntr(transform));
 
-    loc = glGetUniformLocation(program->programId, "diffuse");
+    loc = program->getUniformLocation("diffuse"_sid);
     glUniform3f(loc, 0.0f, 0.0f, 1.0f);
 
     glBindVertexArray(vaoID);
@@ -225,10 +225,10 @@ void DebugGimbal::draw(Entity* entity, ShaderProgram* program)
 
             transform = Translate(A) * Scale(B - A);
 
-            int loc = glGetUniformLocation(program->programId, "ModelTr");
+            int loc = program->getUniformLocation("ModelTr"_sid);
             glUniformMatrix4fv(loc, 1, GL_FALSE, Pntr(transform));
 
-            loc = glGetUniformLocation(program->programId, "diffuse");
+            loc = program->getUniformLocation("diffuse"_sid);
             glUniform3f(loc, 0.0f, 0.0f, 1.0f);
 
 
@@ -244,10 +244,10 @@ void DebugGimbal::draw(Entity* entity, ShaderProgram* program)
 
             transform = Translate(A) * Scale(B - A);
 
-            loc = glGetUniformLocation(program->programId, "ModelTr");
+            loc = program->getUniformLocation("ModelTr"_sid);
             glUniformMatrix4fv(loc, 1, GL_FALSE, Pntr(transform));
 
-            loc = glGetUniformLocation(program->programId, "diffuse");
+            loc = program->getUniformLocation("diffuse"_sid);
             glUniform3f(loc, 0.0f, 1.0f, 0.0f);
 
 
@@ -263,10 +263,10 @@ void DebugGimbal::draw(Entity* entity, ShaderProgram* program)
 
             transform = Translate(A) * Scale(B - A);
 
-            loc = glGetUniformLocation(program->programId, "ModelTr");
+            loc = program->getUniformLocation("ModelTr"_sid);
             glUniformMatrix4fv(loc, 1, GL_FALSE, Pntr(transform));
 
-            loc = glGetUniformLocation(program->programId, "diffuse");
+            loc = program->getUniformLocation("diffuse"_sid);
             glUniform3f(loc, 1.0f, 0.0f, 0.0f);
 
 
@@ -288,10 +288,10 @@ void DebugGimbal::draw(glm::vec3 pos, ShaderProgram* program)
 
     transform = Translate(A) * Scale(B - A);
 
-    int loc = glGetUniformLocation(program->programId, "ModelTr");
+    int loc = program->getUniformLocation("ModelTr"_sid);
     glUniformMatrix4fv(loc, 1, GL_FALSE, Pntr(transform));
 
-    loc = glGetUniformLocation(program->programId, "diffuse");
+    loc = program->getUniformLocation("diffuse"_sid);
     glUniform3f(loc, 0.0f, 0.0f, 1.0f);
 
 
@@ -307,10 +307,10 @@ void DebugGimbal::draw(glm::vec3 pos, ShaderProgram* program)
 
     transform = Translate(A) * Scale(B - A);
 
-    loc = glGetUniformLocation(program->programId, "ModelTr");
+    loc = program->getUniformLocation("ModelTr"_sid);
     glUniformMatrix4fv(loc, 1, GL_FALSE, Pntr(transform));
 
-    loc = glGetUniformLocation(program->programId, "diffuse");
+    loc = program->getUniformLocation("diffuse"_sid);
     glUniform3f(loc, 0.0f, 1.0f, 0.0f);
 
 
@@ -326,10 +326,10 @@ void DebugGimbal::draw(glm::vec3 pos, ShaderProgram* program)
 
     transform = Translate(A) * Scale(B - A);
 
-    loc = glGetUniformLocation(program->programId, "ModelTr");
+    loc = program->getUniformLocation("ModelTr"_sid);
     glUniformMatrix4fv(loc, 1, GL_FALSE, Pntr(transform));
 
-    loc = glGetUniformLocation(program->programId, "diffuse");
+    loc = program->getUniformLocation("diffuse"_sid);
     glUniform3f(loc, 1.0f, 0.0f, 0.0f);
 
 
@@ -458,17 +458,17 @@ void DebugSphere::draw(Entity* entity, glm::vec3 eye, ShaderProgram* program)
 
 
     // Set lines color for fragment shader
-    int loc = glGetUniformLocation(program->programId, "diffuse");
+    int loc = program->getUniformLocation("diffuse"_sid);
     glUniform3fv(loc, 1, &color[0]);
 
     // Its a debug object
-    loc = glGetUniformLocation(program->programId, "objectId");
+    loc = program->getUniformLocation("objectId"_sid);
     glUniform1i(loc, 5);
 
     glBindVertexArray(vaoID);
 
     // Z circle
-    loc = glGetUniformLocation(program->programId, "ModelTr");
+    loc = program->getUniformLocation("ModelTr"_sid);
     glUniformMatrix4fv(loc, 1, GL_FALSE, Pntr(trZ));
     glDrawElements(GL_LINE_LOOP, count, GL_UNSIGNED_INT, 0);
 
@@ -520,15 +520,15 @@ void DebugTriangles::draw(Entity* entity, ShaderProgram* program)
         if (rc && tc)
         {
             // Set lines color for fragment shader
-            int loc = glGetUniformLocation(program->programId, "diffuse");
+            int loc = program->getUniformLocation("diffuse"_sid);
             glUniform3fv(loc, 1, &color[0]);
 
             // Its a debug object
-            loc = glGetUniformLocation(program->programId, "objectId");
+            loc = program->getUniformLocation("objectId"_sid);
             glUniform1i(loc, 5);
 
             // Setting model transform
-            loc = glGetUniformLocation(program->programId, "ModelTr");
+            loc = program->getUniformLocation("ModelTr"_sid);
 
             glBindVertexArray(vaoID);
 
@@ -17,5 +17,37 @@ Engine::Engine(Platform& _platform, World& _world, ResourceManager& _resource)
 
 
 
+void Engine::addSystem(System* system)
+{
+	systems.push_back(system);
+}
+
+
+
+void Engine::removeEntity(Entity* entity)
+{
+	if (!entity)
+		return;
+
+	if (selectedEntity == entity)
+	{
+		selectedEntity = nullptr;
+		onSelect = true;
+	}
+
+	if (selectedEntityPrevious == entity)
+		selectedEntityPrevious = nullptr;
+
+	if (playerEntity == entity)
+		playerEntity = nullptr;
+
+	for (System* system : systems)
+		system->entityRemoved(entity);
+
+	world.removeEntity(entity);
+}
+
+
+
 
 
@@ -9,6 +9,8 @@
 
 #include "System.h"
 
+#include <vector>
+
 
 //#include "Logging.h"
 
@@ -27,6 +29,27 @@ struct DebugValues
 	float float2 = 0.0f;
 	bool drawDebugLines = false;
 	bool basicShading = false;
+	unsigned int readbackLatency = 0; // Frames for G-buffer readbacks to arrive
+	int shadowFaceBudget = 12; // Point light cube faces drawn per frame, forced faces go over it
+};
+
+// Per frame counters from the render system
+struct RenderStats
+{
+	unsigned int drawCalls = 0; // Sub-mesh draws in the geometry pass
+	unsigned int subMeshesCulled = 0; // Sub-meshes outside the view frustum
+	unsigned int entitiesCulled = 0; // Entities with every sub-mesh outside the view frustum
+	unsigned int shadowDraws = 0; // Sub-mesh draws over all point light shadow maps
+	unsigned int shadowCastersCulled = 0; // Entities outside a light's range, counted per light
+	unsigned int staticShadowUpdates = 0; // Lights whose static shadow cache was redrawn
+	unsigned int shadowFacesUpdated = 0; // Cube faces drawn over all point lights
+	unsigned int shadowFacesForced = 0; // Faces drawn because their casters changed
+	float shadowAtlasOccupancy = 0.0f; // Fraction of the shadow atlas handed out
+	unsigned long long shadowAtlasBytes = 0; // Memory held by the shadow atlas
+	unsigned int clusterLightRefs = 0; // Light references over all lighting clusters
+	unsigned int maxClusterLights = 0; // Most lights touching one cluster
+	unsigned int materialUploads = 0; // Material blocks uploaded because they changed
+	unsigned int materialBinds = 0; // Material binds in the geometry pass, repeats are skipped
 };
 
 class Engine
@@ -40,8 +63,16 @@ public:
 
 	ResourceManager& Resource() { return resource; }
 
+	// Systems told about removed entities
+	void addSystem(System* system);
+
+	// Clears the selection and systems' references to the entity, then deletes it from the world
+	void removeEntity(Entity* entity);
+
 	DebugValues debug;
 
+	RenderStats stats;
+
 	Entity* selectedEntity;
 	Entity* selectedEntityPrevious;
 	Entity* playerEntity;
@@ -56,6 +87,8 @@ private:
 	World& world;
 	ResourceManager& resource;
 
+	std::vector<System*> systems;
+
 };
 
 #endif
\ No newline at end of file
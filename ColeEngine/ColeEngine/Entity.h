@@ -26,7 +26,7 @@ public:
 	
 	}
 	Entity(std::string _name);
-	~Entity();
+	virtual ~Entity();
 
 	void addComponent(Component* comp);
 	void setName(std::string _name) { name = _name; }
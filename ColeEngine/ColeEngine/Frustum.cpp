@@ -0,0 +1,98 @@
+#include "Frustum.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE__)
+#define FRUSTUM_SSE
+#include <xmmintrin.h>
+#endif
+
+
+void Frustum::extract(const glm::mat4& viewProj)
+{
+    // Rows of the matrix (glm is column major)
+    glm::vec4 row0 = glm::vec4(viewProj[0][0], viewProj[1][0], viewProj[2][0], viewProj[3][0]);
+    glm::vec4 row1 = glm::vec4(viewProj[0][1], viewProj[1][1], viewProj[2][1], viewProj[3][1]);
+    glm::vec4 row2 = glm::vec4(viewProj[0][2], viewProj[1][2], viewProj[2][2], viewProj[3][2]);
+    glm::vec4 row3 = glm::vec4(viewProj[0][3], viewProj[1][3], viewProj[2][3], viewProj[3][3]);
+
+    planes[0] = row3 + row0; // Left
+    planes[1] = row3 - row0; // Right
+    planes[2] = row3 + row1; // Bottom
+    planes[3] = row3 - row1; // Top
+    planes[4] = row3 + row2; // Near
+    planes[5] = row3 - row2; // Far
+
+    // Normalize so distances are in world units
+    for (glm::vec4& plane : planes)
+    {
+        float len = glm::length(glm::vec3(plane));
+
+        if (len > 0.0f)
+            plane /= len;
+    }
+}
+
+
+bool Frustum::testAABB(const glm::vec3& boxMin, const glm::vec3& boxMax) const
+{
+    for (const glm::vec4& plane : planes)
+    {
+        // Corner furthest along the plane normal
+        glm::vec3 p = glm::vec3(
+            plane.x > 0.0f ? boxMax.x : boxMin.x,
+            plane.y > 0.0f ? boxMax.y : boxMin.y,
+            plane.z > 0.0f ? boxMax.z : boxMin.z
+        );
+
+        if (glm::dot(glm::vec3(plane), p) + plane.w < 0.0f)
+            return false;
+    }
+
+    return true;
+}
+
+
+void Frustum::testAABBs(const glm::vec3* boxMin, const glm::vec3* boxMax, unsigned int count, unsigned char* visible) const
+{
+    unsigned int i = 0;
+
+#ifdef FRUSTUM_SSE
+    for (; i + 4 <= count; i += 4)
+    {
+        // Load four boxes as structure of arrays
+        __m128 minX = _mm_setr_ps(boxMin[i].x, boxMin[i + 1].x, boxMin[i + 2].x, boxMin[i + 3].x);
+        __m128 minY = _mm_setr_ps(boxMin[i].y, boxMin[i + 1].y, boxMin[i + 2].y, boxMin[i + 3].y);
+        __m128 minZ = _mm_setr_ps(boxMin[i].z, boxMin[i + 1].z, boxMin[i + 2].z, boxMin[i + 3].z);
+        __m128 maxX = _mm_setr_ps(boxMax[i].x, boxMax[i + 1].x, boxMax[i + 2].x, boxMax[i + 3].x);
+        __m128 maxY = _mm_setr_ps(boxMax[i].y, boxMax[i + 1].y, boxMax[i + 2].y, boxMax[i + 3].y);
+        __m128 maxZ = _mm_setr_ps(boxMax[i].z, boxMax[i + 1].z, boxMax[i + 2].z, boxMax[i + 3].z);
+
+        __m128 outside = _mm_setzero_ps();
+
+        for (const glm::vec4& plane : planes)
+        {
+            // Furthest corner along the normal is picked per plane, the same for all four boxes
+            __m128 px = plane.x > 0.0f ? maxX : minX;
+            __m128 py = plane.y > 0.0f ? maxY : minY;
+            __m128 pz = plane.z > 0.0f ? maxZ : minZ;
+
+            __m128 dist = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(plane.x)), _mm_mul_ps(py, _mm_set1_ps(plane.y))),
+                _mm_add_ps(_mm_mul_ps(pz, _mm_set1_ps(plane.z)), _mm_set1_ps(plane.w))
+            );
+
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(dist, _mm_setzero_ps()));
+        }
+
+        int mask = _mm_movemask_ps(outside);
+
+        visible[i] = (mask & 1) ? 0 : 1;
+        visible[i + 1] = (mask & 2) ? 0 : 1;
+        visible[i + 2] = (mask & 4) ? 0 : 1;
+        visible[i + 3] = (mask & 8) ? 0 : 1;
+    }
+#endif
+
+    // Remaining boxes
+    for (; i < count; i++)
+        visible[i] = testAABB(boxMin[i], boxMax[i]) ? 1 : 0;
+}
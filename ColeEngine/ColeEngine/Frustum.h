@@ -0,0 +1,31 @@
+#pragma once
+
+#ifndef _FRUSTUM
+#define _FRUSTUM
+
+#include <glm/glm.hpp>
+
+
+// View frustum as six planes facing inwards. Used to cull bounding boxes before drawing.
+class Frustum
+{
+public:
+	Frustum() {}
+
+	// Extract planes from a projection * view matrix
+	explicit Frustum(const glm::mat4& viewProj) { extract(viewProj); }
+
+	void extract(const glm::mat4& viewProj);
+
+	// True if the box is at least partly inside
+	bool testAABB(const glm::vec3& boxMin, const glm::vec3& boxMax) const;
+
+	// Test count boxes stored as separate min/max arrays. Writes 1 to visible for boxes inside.
+	// Four boxes are tested at a time with SSE where available
+	void testAABBs(const glm::vec3* boxMin, const glm::vec3* boxMax, unsigned int count, unsigned char* visible) const;
+
+	// Plane equations (normal, distance). Points with dot(n, p) + d < 0 are outside
+	glm::vec4 planes[6];
+};
+
+#endif
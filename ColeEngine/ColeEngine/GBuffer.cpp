@@ -2,7 +2,7 @@
 #include "Logging.h"
 
 GBuffer::GBuffer(unsigned int _width, unsigned int _height)
-	: width(_width), height(_height), quad(nullptr), nBuffers(0)
+	: frame(0), readbackLatency(0), nBuffers(0), width(_width), height(_height), quad(nullptr)
 {
 
 	// Create full screen quad to render G-Buffer to
@@ -73,6 +73,8 @@ void GBuffer::addBuffer(BufferType type)
 		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + nBuffers, GL_TEXTURE_2D, tex->get(), 0);
 		glBindTexture(GL_TEXTURE_2D, 0);
 
+		attachments[type] = nBuffers;
+
 		nBuffers++;
 
 		// Add to list of textures
@@ -82,13 +84,13 @@ void GBuffer::addBuffer(BufferType type)
 		glBindFramebuffer(GL_FRAMEBUFFER, gBuffer);
 
 		// Set which color attachments are used for rendering on this framebuffer
-		std::vector<unsigned int> attachments;
+		std::vector<unsigned int> drawBuffers;
 		for (unsigned int i = 0; i < nBuffers; i++)
 		{
-			attachments.push_back(GL_COLOR_ATTACHMENT0 + i);
+			drawBuffers.push_back(GL_COLOR_ATTACHMENT0 + i);
 		}
 
-		glDrawBuffers(nBuffers, attachments.data());
+		glDrawBuffers(nBuffers, drawBuffers.data());
 
 		// Check if framebuffer is complete
 		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
@@ -100,8 +102,150 @@ void GBuffer::addBuffer(BufferType type)
 
 
 
+bool GBuffer::requestRead(BufferType type, int x, int y, int w, int h)
+{
+	auto it = attachments.find(type);
+	if (it == attachments.end())
+		return false;
+
+	// Clip region to the buffer
+	int x0 = glm::max(x, 0);
+	int y0 = glm::max(y, 0);
+	int x1 = glm::min(x + w, static_cast<int>(width));
+	int y1 = glm::min(y + h, static_cast<int>(height));
+
+	if (x1 <= x0 || y1 <= y0)
+		return false;
+
+	// Find a free slot. If none are free the GPU is behind, drop the request
+	ReadbackSlot* slot = nullptr;
+	for (ReadbackSlot& s : readbackSlots)
+	{
+		if (!s.busy)
+		{
+			slot = &s;
+			break;
+		}
+	}
+
+	if (!slot)
+		return false;
+
+	unsigned int size = static_cast<unsigned int>((x1 - x0) * (y1 - y0)) * sizeof(glm::vec4);
+
+	if (!slot->pbo)
+		glGenBuffers(1, &slot->pbo);
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot->pbo);
+
+	// Grow PBO if the region is bigger than last time
+	if (size > slot->size)
+	{
+		glBufferData(GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_READ);
+		slot->size = size;
+	}
+
+	// Copy into the PBO. With a pack buffer bound glReadPixels returns right away
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, gBuffer);
+	glReadBuffer(GL_COLOR_ATTACHMENT0 + it->second);
+	glReadPixels(x0, y0, x1 - x0, y1 - y0, GL_RGBA, GL_FLOAT, 0);
+
+	slot->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+
+	slot->busy = true;
+	slot->request.frame = frame;
+	slot->request.type = type;
+	slot->request.x = x0;
+	slot->request.y = y0;
+	slot->request.width = x1 - x0;
+	slot->request.height = y1 - y0;
+
+	return true;
+}
+
+
+
+void GBuffer::updateReadbacks()
+{
+	frame++;
+
+	for (ReadbackSlot& slot : readbackSlots)
+	{
+		if (!slot.busy)
+			continue;
+
+		// Poll the fence without waiting
+		GLenum status = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+			continue;
+
+		glDeleteSync(slot.fence);
+		slot.fence = nullptr;
+
+		ReadbackResult& result = readResults[slot.request.type];
+
+		// Keep the newest read if several finish at once
+		if (result.valid && result.frame > slot.request.frame)
+		{
+			slot.busy = false;
+			continue;
+		}
+
+		unsigned int count = slot.request.width * slot.request.height;
+
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+
+		void* data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, count * sizeof(glm::vec4), GL_MAP_READ_BIT);
+
+		if (data)
+		{
+			result = slot.request;
+			result.texels.assign(static_cast<glm::vec4*>(data), static_cast<glm::vec4*>(data) + count);
+			result.latency = static_cast<unsigned int>(frame - slot.request.frame);
+			result.valid = true;
+
+			readbackLatency = result.latency;
+
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		}
+
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+		slot.busy = false;
+	}
+}
+
+
+
+bool GBuffer::getReadResult(BufferType type, ReadbackResult& result)
+{
+	auto it = readResults.find(type);
+	if (it == readResults.end() || !it->second.valid)
+		return false;
+
+	result = it->second;
+
+	return true;
+}
+
+
+
 GBuffer::~GBuffer()
 {
+	// Release readback buffers
+	for (ReadbackSlot& slot : readbackSlots)
+	{
+		if (slot.fence)
+			glDeleteSync(slot.fence);
+
+		if (slot.pbo)
+			glDeleteBuffers(1, &slot.pbo);
+	}
+
 	// Delete textures attached to FBO
 	for (const auto& pair : textures) 
 	{
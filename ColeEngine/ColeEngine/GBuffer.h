@@ -6,6 +6,9 @@
 
 #include<unordered_map>
 #include<string>
+#include<vector>
+
+#include <glm/glm.hpp>
 
 #include "Shapes.h"
 #include "Texture.h"
@@ -20,6 +23,44 @@ enum class BufferType
 	VIEW
 };
 
+// Number of readbacks that can be in flight at once
+#define GBUFFER_READBACK_SLOTS 4
+
+
+// Texels copied back from a G-buffer attachment
+struct ReadbackResult
+{
+	bool valid = false;
+
+	BufferType type = BufferType::POSITION;
+
+	// Region in buffer pixels, origin bottom left
+	int x = 0, y = 0;
+	int width = 0, height = 0;
+
+	// RGBA texels, row by row from the bottom
+	std::vector<glm::vec4> texels;
+
+	// Frame the read was requested, and frames until the data was available
+	unsigned long long frame = 0;
+	unsigned int latency = 0;
+
+	glm::vec4 texel(int u, int v) const { return texels[v * width + u]; }
+};
+
+
+// In flight readback. Data is copied into a PBO and mapped once the fence signals
+struct ReadbackSlot
+{
+	unsigned int pbo = 0;
+	unsigned int size = 0; // PBO size in bytes
+	GLsync fence = nullptr;
+
+	bool busy = false;
+
+	ReadbackResult request;
+};
+
 
 class GBuffer
 {
@@ -43,11 +84,37 @@ public:
 	unsigned int getWidth() { return width; }
 	unsigned int getHeight() { return height; }
 
+	// Queue a copy of a region of an attachment. Call after the geometry pass.
+	// Returns false if every slot is busy or the region is outside the buffer
+	bool requestRead(BufferType type, int x, int y, int w, int h);
+
+	// Single texel read, e.g. under the mouse
+	bool requestPixel(BufferType type, int x, int y) { return requestRead(type, x, y, 1, 1); }
+
+	// Advance the frame counter and collect finished reads. Never waits on the GPU. Call once per frame
+	void updateReadbacks();
+
+	// Latest finished read of an attachment. Returns false if none has arrived yet
+	bool getReadResult(BufferType type, ReadbackResult& result);
+
+	// Latency of the last finished read in frames
+	unsigned int getReadbackLatency() { return readbackLatency; }
+
 private:
 	
 	// Texture attackments for FBO
 	std::unordered_map<BufferType, Texture*> textures;
 
+	// Color attachment index of each texture
+	std::unordered_map<BufferType, unsigned int> attachments;
+
+	// Async readback ring
+	ReadbackSlot readbackSlots[GBUFFER_READBACK_SLOTS];
+	std::unordered_map<BufferType, ReadbackResult> readResults;
+
+	unsigned long long frame;
+	unsigned int readbackLatency;
+
 	unsigned int nBuffers; // Number of textures on this FBO
 	unsigned int gBuffer; // FBO ID
 	unsigned int width, height; // Buffer width/height
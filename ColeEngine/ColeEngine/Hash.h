@@ -0,0 +1,41 @@
+#pragma once
+
+#ifndef _HASH
+#define _HASH
+
+#include <cstddef>
+
+// 64 bit FNV-1a
+#define FNV_OFFSET_BASIS 14695981039346656037ull
+#define FNV_PRIME 1099511628211ull
+
+
+// Continue a hash over more bytes. Start from FNV_OFFSET_BASIS
+inline unsigned long long hashBytes(unsigned long long hash, const void* data, size_t size)
+{
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= FNV_PRIME;
+	}
+
+	return hash;
+}
+
+// Same hash of a string, usable in constant expressions
+constexpr unsigned long long hashString(const char* str, size_t length)
+{
+	unsigned long long hash = FNV_OFFSET_BASIS;
+
+	for (size_t i = 0; i < length; i++)
+	{
+		hash ^= static_cast<unsigned char>(str[i]);
+		hash *= FNV_PRIME;
+	}
+
+	return hash;
+}
+
+#endif
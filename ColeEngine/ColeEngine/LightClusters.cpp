@@ -0,0 +1,273 @@
+#include "LightClusters.h"
+
+#include "glew.h"
+
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
+
+#include "Engine.h"
+#include "PointLight.h"
+
+
+// Distance along the view direction where slice k starts
+static float sliceDepth(unsigned int k, float front, float back)
+{
+    if (k == 0)
+        return front;
+
+    if (k >= CLUSTER_Z)
+        return back;
+
+    return CLUSTER_NEAR * std::pow(CLUSTER_FAR / CLUSTER_NEAR, static_cast<float>(k) / CLUSTER_Z);
+}
+
+// Slice holding a view depth. Must match the lighting shader
+static int depthSlice(float depth)
+{
+    if (depth <= CLUSTER_NEAR)
+        return 0;
+
+    int k = static_cast<int>(std::log(depth / CLUSTER_NEAR) / std::log(CLUSTER_FAR / CLUSTER_NEAR) * CLUSTER_Z);
+
+    return std::min(std::max(k, 0), CLUSTER_Z - 1);
+}
+
+static bool sphereTouchesBox(const glm::vec3& center, float radius, const glm::vec3& boxMin, const glm::vec3& boxMax)
+{
+    glm::vec3 closest = glm::clamp(center, boxMin, boxMax);
+    glm::vec3 d = center - closest;
+
+    return glm::dot(d, d) <= radius * radius;
+}
+
+
+LightClusters::LightClusters()
+{
+    createTable(lightData, GL_RGBA32F);
+    createTable(clusterGrid, GL_RG32UI);
+    createTable(lightIndices, GL_R32UI);
+
+    grid.resize(CLUSTER_X * CLUSTER_Y * CLUSTER_Z * 2);
+}
+
+
+LightClusters::~LightClusters()
+{
+    BufferTable* tables[] = { &lightData, &clusterGrid, &lightIndices };
+
+    for (BufferTable* table : tables)
+    {
+        glDeleteTextures(1, &table->texture);
+        glDeleteBuffers(1, &table->buffer);
+    }
+}
+
+
+void LightClusters::createTable(BufferTable& table, unsigned int format)
+{
+    glGenBuffers(1, &table.buffer);
+    glBindBuffer(GL_TEXTURE_BUFFER, table.buffer);
+    glBufferData(GL_TEXTURE_BUFFER, 16, NULL, GL_STREAM_DRAW);
+
+    glGenTextures(1, &table.texture);
+    glBindTexture(GL_TEXTURE_BUFFER, table.texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, format, table.buffer);
+
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+
+void LightClusters::upload(BufferTable& table, const void* data, size_t bytes)
+{
+    glBindBuffer(GL_TEXTURE_BUFFER, table.buffer);
+
+    // Orphan last frame's storage so the driver doesn't wait on the previous lighting pass
+    glBufferData(GL_TEXTURE_BUFFER, std::max(bytes, size_t(16)), NULL, GL_STREAM_DRAW);
+
+    if (bytes > 0)
+        glBufferSubData(GL_TEXTURE_BUFFER, 0, bytes, data);
+
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+
+void LightClusters::buildBounds(const glm::mat4& proj, float front, float back)
+{
+    boundsProj = proj;
+
+    clusterMin.resize(CLUSTER_X * CLUSTER_Y * CLUSTER_Z);
+    clusterMax.resize(CLUSTER_X * CLUSTER_Y * CLUSTER_Z);
+
+    for (unsigned int k = 0; k < CLUSTER_Z; k++)
+    {
+        float d0 = sliceDepth(k, front, back);
+        float d1 = sliceDepth(k + 1, front, back);
+
+        for (unsigned int j = 0; j < CLUSTER_Y; j++)
+        {
+            for (unsigned int i = 0; i < CLUSTER_X; i++)
+            {
+                float x0 = -1.0f + 2.0f * i / CLUSTER_X;
+                float x1 = -1.0f + 2.0f * (i + 1) / CLUSTER_X;
+                float y0 = -1.0f + 2.0f * j / CLUSTER_Y;
+                float y1 = -1.0f + 2.0f * (j + 1) / CLUSTER_Y;
+
+                glm::vec3 boxMin(FLT_MAX);
+                glm::vec3 boxMax(-FLT_MAX);
+
+                // Tile corners at both ends of the slice, back through the projection
+                float depths[2] = { d0, d1 };
+                for (float d : depths)
+                {
+                    float xs[2] = { x0, x1 };
+                    float ys[2] = { y0, y1 };
+
+                    for (float x : xs)
+                    {
+                        for (float y : ys)
+                        {
+                            glm::vec3 p((x + proj[2][0]) * d / proj[0][0], (y + proj[2][1]) * d / proj[1][1], -d);
+
+                            boxMin = glm::min(boxMin, p);
+                            boxMax = glm::max(boxMax, p);
+                        }
+                    }
+                }
+
+                unsigned int index = (k * CLUSTER_Y + j) * CLUSTER_X + i;
+                clusterMin[index] = boxMin;
+                clusterMax[index] = boxMax;
+            }
+        }
+    }
+}
+
+
+void LightClusters::update(Engine& engine)
+{
+    World& world = engine.getWorld();
+
+    if (world.worldProj != boundsProj)
+        buildBounds(world.worldProj, world.front, world.back);
+
+    const glm::mat4& view = world.worldView;
+    const glm::mat4& proj = world.worldProj;
+
+    lightTexels.clear();
+    refCluster.clear();
+    refLight.clear();
+
+    lightCount = 0;
+
+    for (PointLight* light : world.pointLights)
+    {
+        TransformComponent* trn = light->getComponent<TransformComponent>();
+        PointLightComponent* plc = light->getComponent<PointLightComponent>();
+
+        if (!trn || !plc)
+            continue;
+
+        unsigned int lightIndex = lightCount++;
+
+        lightTexels.push_back(glm::vec4(trn->pos, plc->farPlane));
+        lightTexels.push_back(glm::vec4(plc->color, plc->strength));
+        lightTexels.push_back(glm::vec4(plc->falloff, 0.0f, 0.0f, 0.0f));
+
+        // Zero size tile means no shadows
+        for (unsigned int f = 0; f < 6; f++)
+        {
+            const ShadowTile& tile = light->shadowTiles[f];
+            lightTexels.push_back(glm::vec4(tile.x, tile.y, tile.valid() ? tile.size : 0, tile.layer));
+        }
+
+        glm::vec3 center = glm::vec3(view * glm::vec4(trn->pos, 1.0f));
+        float radius = plc->farPlane;
+        float depth = -center.z;
+
+        // Behind the camera
+        if (depth + radius < world.front)
+            continue;
+
+        int kMin = depthSlice(depth - radius);
+        int kMax = depthSlice(depth + radius);
+
+        // Screen rect of the sphere's box. A box reaching the near plane covers the whole screen
+        int iMin = 0, iMax = CLUSTER_X - 1;
+        int jMin = 0, jMax = CLUSTER_Y - 1;
+
+        if (depth - radius > world.front)
+        {
+            glm::vec2 ndcMin(FLT_MAX);
+            glm::vec2 ndcMax(-FLT_MAX);
+
+            for (unsigned int c = 0; c < 8; c++)
+            {
+                glm::vec3 p = center + glm::vec3(c & 1 ? radius : -radius, c & 2 ? radius : -radius, c & 4 ? radius : -radius);
+                glm::vec4 clip = proj * glm::vec4(p, 1.0f);
+                glm::vec2 ndc = glm::vec2(clip) / clip.w;
+
+                ndcMin = glm::min(ndcMin, ndc);
+                ndcMax = glm::max(ndcMax, ndc);
+            }
+
+            iMin = std::max(static_cast<int>(std::floor((ndcMin.x + 1.0f) * 0.5f * CLUSTER_X)), 0);
+            iMax = std::min(static_cast<int>(std::floor((ndcMax.x + 1.0f) * 0.5f * CLUSTER_X)), CLUSTER_X - 1);
+            jMin = std::max(static_cast<int>(std::floor((ndcMin.y + 1.0f) * 0.5f * CLUSTER_Y)), 0);
+            jMax = std::min(static_cast<int>(std::floor((ndcMax.y + 1.0f) * 0.5f * CLUSTER_Y)), CLUSTER_Y - 1);
+        }
+
+        // Exact sphere test against each candidate cluster
+        for (int k = kMin; k <= kMax; k++)
+        {
+            for (int j = jMin; j <= jMax; j++)
+            {
+                for (int i = iMin; i <= iMax; i++)
+                {
+                    unsigned int cluster = (k * CLUSTER_Y + j) * CLUSTER_X + i;
+
+                    if (sphereTouchesBox(center, radius, clusterMin[cluster], clusterMax[cluster]))
+                    {
+                        refCluster.push_back(cluster);
+                        refLight.push_back(lightIndex);
+                    }
+                }
+            }
+        }
+    }
+
+    // Counting sort the references by cluster
+    unsigned int nClusters = CLUSTER_X * CLUSTER_Y * CLUSTER_Z;
+
+    std::fill(grid.begin(), grid.end(), 0u);
+
+    for (unsigned int cluster : refCluster)
+        grid[cluster * 2 + 1]++;
+
+    unsigned int offset = 0;
+    maxLights = 0;
+
+    for (unsigned int c = 0; c < nClusters; c++)
+    {
+        grid[c * 2] = offset;
+        offset += grid[c * 2 + 1];
+
+        maxLights = std::max(maxLights, grid[c * 2 + 1]);
+
+        // Used as a write cursor below, restored after
+        grid[c * 2 + 1] = 0;
+    }
+
+    indices.resize(refCluster.size());
+
+    for (unsigned int r = 0; r < refCluster.size(); r++)
+    {
+        unsigned int cluster = refCluster[r];
+        indices[grid[cluster * 2] + grid[cluster * 2 + 1]++] = refLight[r];
+    }
+
+    upload(lightData, lightTexels.data(), lightTexels.size() * sizeof(glm::vec4));
+    upload(clusterGrid, grid.data(), grid.size() * sizeof(unsigned int));
+    upload(lightIndices, indices.data(), indices.size() * sizeof(unsigned int));
+}
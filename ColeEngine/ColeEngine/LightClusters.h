@@ -0,0 +1,79 @@
+#pragma once
+
+#ifndef _LIGHT_CLUSTERS
+#define _LIGHT_CLUSTERS
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+class Engine;
+
+// Froxel grid, screen tiles by exponential depth slices
+#define CLUSTER_X 16
+#define CLUSTER_Y 9
+#define CLUSTER_Z 24
+
+// View depths the exponential slices are spread between. The first and last slice
+// stretch to the camera's near and far planes
+#define CLUSTER_NEAR 1.0f
+#define CLUSTER_FAR 1000.0f
+
+// RGBA32F texels per light in the light data table
+#define CLUSTER_LIGHT_TEXELS 9
+
+
+// Bins point lights into view space clusters on the CPU each frame. The lighting shader looks up
+// its cluster and loops over just the lights touching it. Tables are uploaded as buffer textures:
+// light data (position/range, color/strength, falloff, 6 shadow tiles), per cluster offset/count,
+// and the flat light index list the offsets point into.
+class LightClusters
+{
+public:
+	LightClusters();
+	~LightClusters();
+
+	// Bin every point light for the current view and upload the tables
+	void update(Engine& engine);
+
+	unsigned int getLightData() const { return lightData.texture; }
+	unsigned int getClusterGrid() const { return clusterGrid.texture; }
+	unsigned int getLightIndices() const { return lightIndices.texture; }
+
+	unsigned int numLights() const { return lightCount; }
+
+	// Light references over all clusters and the most lights in one cluster, last update
+	unsigned int numReferences() const { return static_cast<unsigned int>(indices.size()); }
+	unsigned int maxClusterLights() const { return maxLights; }
+
+private:
+	// Buffer object and the texture that views it
+	struct BufferTable
+	{
+		unsigned int buffer = 0;
+		unsigned int texture = 0;
+	};
+
+	void createTable(BufferTable& table, unsigned int format);
+	void upload(BufferTable& table, const void* data, size_t bytes);
+
+	// View space bounds of every cluster, only rebuilt when the projection changes
+	void buildBounds(const glm::mat4& proj, float front, float back);
+
+	BufferTable lightData, clusterGrid, lightIndices;
+
+	glm::mat4 boundsProj = glm::mat4(0.0f);
+	std::vector<glm::vec3> clusterMin, clusterMax;
+
+	// CPU copies of the tables, reused every frame
+	std::vector<glm::vec4> lightTexels;
+	std::vector<unsigned int> grid; // offset, count per cluster
+	std::vector<unsigned int> indices;
+
+	std::vector<unsigned int> refCluster, refLight; // Cluster/light pairs gathered before sorting
+
+	unsigned int lightCount = 0;
+	unsigned int maxLights = 0;
+};
+
+#endif
@@ -0,0 +1,80 @@
+#include "MappedFile.h"
+
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+
+
+MappedFile::MappedFile()
+    : view(nullptr), length(0), file(nullptr), mapping(nullptr)
+{
+}
+
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+
+bool MappedFile::open(const std::string& path)
+{
+    close();
+
+    HANDLE fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+
+    if (fileHandle == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER fileSize;
+
+    // Empty files can't be mapped
+    if (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0)
+    {
+        CloseHandle(fileHandle);
+        return false;
+    }
+
+    HANDLE mappingHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+
+    if (!mappingHandle)
+    {
+        CloseHandle(fileHandle);
+        return false;
+    }
+
+    void* address = MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+
+    if (!address)
+    {
+        CloseHandle(mappingHandle);
+        CloseHandle(fileHandle);
+        return false;
+    }
+
+    file = fileHandle;
+    mapping = mappingHandle;
+    view = static_cast<const unsigned char*>(address);
+    length = static_cast<size_t>(fileSize.QuadPart);
+
+    return true;
+}
+
+
+void MappedFile::close()
+{
+    if (view)
+        UnmapViewOfFile(view);
+
+    if (mapping)
+        CloseHandle(mapping);
+
+    if (file)
+        CloseHandle(file);
+
+    view = nullptr;
+    length = 0;
+    file = nullptr;
+    mapping = nullptr;
+}
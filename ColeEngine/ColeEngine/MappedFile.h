@@ -0,0 +1,38 @@
+#pragma once
+
+#ifndef _MAPPED_FILE
+#define _MAPPED_FILE
+
+#include <string>
+#include <cstddef>
+
+
+// Read only view of a whole file mapped into memory. Pages are loaded by the OS on first touch,
+// so data can go straight to the GPU without being read into a buffer first.
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool open(const std::string& path);
+	void close();
+
+	bool isOpen() const { return view != nullptr; }
+
+	const unsigned char* data() const { return view; }
+	size_t size() const { return length; }
+
+private:
+	const unsigned char* view;
+	size_t length;
+
+	// OS handles, kept opaque to avoid pulling windows.h into every includer
+	void* file;
+	void* mapping;
+};
+
+#endif
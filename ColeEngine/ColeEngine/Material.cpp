@@ -1,17 +1,25 @@
 #include "Material.h"
 #include "Logging.h"
+#include "MaterialLayout.h"
 
 #include <iostream>
-#include <sstream>
+#include <cstring>
+#include <algorithm>
 
 Material::Material(std::string _name, ShaderProgram* _shader)
-	: name(_name), shader(_shader), vFloat(0), vInt(0), vVec3(0), vTexture(0), vColor(0),
-	hasDiffuseTexture(false), hasNormalsTexture(false), hasSpecularTexture(false)
+	: Resource(ResourceType::MATERIAL), name(_name), shader(_shader), baseShader(_shader), variantFeatures(0), vFloat(0), vInt(0), vVec3(0), vTexture(0), vColor(0),
+	hasDiffuseTexture(false), hasNormalsTexture(false), hasSpecularTexture(false), uniformBlock(nullptr)
 {
 	
 	
 }
 
+Material::~Material()
+{
+	// Texture slots release their textures with the map
+	delete uniformBlock;
+}
+
 
 
 void Material::setShader(ShaderProgram* _shader)
@@ -19,6 +27,11 @@ void Material::setShader(ShaderProgram* _shader)
 	if (_shader)
 	{
 		shader = _shader;
+		baseShader = _shader;
+		variantFeatures = _shader->getFeatures();
+
+		// Block layout comes from the shader
+		markDirty();
 	}
 	else
 	{
@@ -29,87 +42,173 @@ void Material::setShader(ShaderProgram* _shader)
 
 
 
-void Material::addReference(Entity* _entity)
+unsigned int Material::getShaderFeatures() const
 {
-	if (_entity)
-	{
-		entityRefs.push_back(_entity);
-	}
+	unsigned int features = 0;
+
+	if (hasDiffuseTexture)
+		features |= SHADER_DIFFUSE_MAP;
+
+	if (hasNormalsTexture)
+		features |= SHADER_NORMAL_MAP;
+
+	return features;
 }
 
 
-void Material::removeReference(Entity* _entity)
+void Material::setVariant(ShaderProgram* variant)
 {
-	entityRefs.erase(std::remove(entityRefs.begin(), entityRefs.end(), _entity), entityRefs.end());
+	// Keep drawing with the current shader instead of asking again every frame
+	if (!variant || !variant->isLinked())
+	{
+		variantFeatures = getShaderFeatures();
+		return;
+	}
+
+	shader = variant;
+	variantFeatures = variant->getFeatures();
+
+	// Texture slots and offsets come from the variant
+	markDirty();
 }
 
+
+
 void Material::registerUniforms()
 {
-	if (shader)
+	if (!shader)
+		return;
+
+	// Every MaterialBlock member the program uses becomes an editable parameter with a default value
+	for (const MaterialParam& param : shader->getMaterialLayout()->getParams())
 	{
-		bool worldMode = false, noRegister = false;
+		switch (param.type)
+		{
+		case MaterialParamType::FLOAT:
+			if (!vFloat.count(param.name))
+				vFloat[param.name] = FloatParam(1.0f, 0.0f, 1.0f);
+			break;
+
+		case MaterialParamType::INT:
+			if (!vInt.count(param.name))
+				vInt[param.name] = 0;
+			break;
+
+		case MaterialParamType::VEC2:
+			if (!vVec2.count(param.name))
+				vVec2[param.name] = Vec2Param(glm::vec2(1., 1.), glm::vec2(0., 0.), glm::vec2(0., 0.));
+			break;
+
+		case MaterialParamType::VEC3:
+			if (!vVec3.count(param.name))
+				vVec3[param.name] = Vec3Param(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 0.0f));
+			break;
+
+		case MaterialParamType::COLOR:
+			if (!vColor.count(param.name))
+				vColor[param.name] = glm::vec4(1.0f, 1.0f, 1.0f, 1.0f);
+			break;
+		}
+	}
+}
+
+
+bool Material::updateUniformBlock()
+{
+	if (!shader)
+		return false;
+
+	if (version == uploadedVersion && shader->getLinkCount() == uploadedLink)
+		return false;
+
+	uploadedVersion = version;
+	uploadedLink = shader->getLinkCount();
+
+	MaterialLayout* layout = shader->getMaterialLayout();
 
-		std::istringstream iss(shader->shaderSrc);
+	blockData.assign(layout->getBlockSize(), 0);
 
-		std::string word;
-		while (iss >> word)
+	for (const MaterialParam& param : layout->getParams())
+	{
+		unsigned char* dst = &blockData[param.offset];
+
+		switch (param.type)
+		{
+		case MaterialParamType::FLOAT:
+		{
+			auto found = vFloat.find(param.name);
+			if (found != vFloat.end())
+				memcpy(dst, &found->second.val, sizeof(float));
+			break;
+		}
+		case MaterialParamType::INT:
+		{
+			auto found = vInt.find(param.name);
+			if (found != vInt.end())
+				memcpy(dst, &found->second, sizeof(int));
+			break;
+		}
+		case MaterialParamType::VEC2:
 		{
-			if (word == "uniform")
-			{
-				if (!worldMode && !noRegister)
-				{
-					iss >> word;
-					std::string type = word;
-
-					iss >> word;
-					std::string name = word;
-					name.pop_back();
-
-					//std::cout << "\nUniform of type: " << type << " with name: " << name << "\n";
-
-					if (type == "sampler2D")
-					{
-						//vTexture[name] = nullptr;
-					}
-					else if (type == "vec3")
-					{
-						vVec3[name] = Vec3Param(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 0.0f));
-					}
-					else if (type == "vec2")
-					{
-						vVec2[name] = Vec2Param(glm::vec2(1., 1.), glm::vec2(0., 0.), glm::vec2(0., 0.));
-					}
-					else if (type == "float")
-					{
-						vFloat[name] = FloatParam(1.0f, 0.0f, 1.0f);
-					}
-					else if (type == "Color4")
-					{
-						vColor[name] = glm::vec4(1.0f, 1.0f, 1.0f, 1.0f);
-					}
-				}
-			}
-			else if (word == "//WORLD")
-			{
-				worldMode = true;
-			}
-			else if (word == "//WORLD_END")
-			{
-				worldMode = false;
-			}
-			else if (word == "//NO_REGISTER")
-			{
-				noRegister = true;
-			}
-			else if (word == "//END_NO_REGISTER")
-			{
-				noRegister = false;
-			}
-
-			
+			auto found = vVec2.find(param.name);
+			if (found != vVec2.end())
+				memcpy(dst, &found->second.val[0], sizeof(glm::vec2));
+			break;
 		}
+		case MaterialParamType::VEC3:
+		{
+			auto found = vVec3.find(param.name);
+			if (found != vVec3.end())
+				memcpy(dst, &found->second.val[0], sizeof(glm::vec3));
+			break;
+		}
+		case MaterialParamType::COLOR:
+		{
+			auto found = vColor.find(param.name);
+			if (found != vColor.end())
+				memcpy(dst, &found->second[0], sizeof(Color4));
+			break;
+		}
+		}
+	}
 
+	// Texture for each of the program's sampler slots
+	const std::vector<MaterialTextureSlot>& slots = layout->getTextureSlots();
+	textureSlots.assign(slots.size(), 0);
+
+	for (unsigned int i = 0; i < slots.size(); i++)
+	{
+		auto found = vTexture.find(slots[i].name);
+		if (found != vTexture.end() && found->second)
+			textureSlots[i] = found->second->get();
 	}
 
+	if (blockData.empty())
+		return true;
+
+	if (!uniformBlock)
+		uniformBlock = new UniformBuffer();
+
+	uniformBlock->upload(blockData.data(), blockData.size());
+
+	return true;
 }
 
+
+void Material::bind()
+{
+	if (!shader)
+		return;
+
+	if (uniformBlock)
+		uniformBlock->bind(MATERIAL_BLOCK_BINDING);
+
+	// Samplers were pointed at their units when the layout was read
+	const std::vector<MaterialTextureSlot>& slots = shader->getMaterialLayout()->getTextureSlots();
+
+	for (unsigned int i = 0; i < slots.size() && i < textureSlots.size(); i++)
+	{
+		glActiveTexture(GL_TEXTURE0 + slots[i].unit);
+		glBindTexture(GL_TEXTURE_2D, textureSlots[i]);
+	}
+}
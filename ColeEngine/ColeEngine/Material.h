@@ -13,6 +13,9 @@
 #include "Texture.h"
 #include "Entity.h"
 #include "Shader.h"
+#include "UniformBuffer.h"
+#include "Resource.h"
+#include "StringID.h"
 
 class Entity;
 
@@ -80,38 +83,70 @@ struct Vec2Param
 };
 
 
-class Material
+class Material : public Resource
 {
 public:
 	Material(std::string name, ShaderProgram* _shader);
-	
+	~Material();
+
 
 	void setShader(ShaderProgram* _shader);
 
+	// Variant of the shader the material draws with
 	ShaderProgram* getShader() { return shader; }
 
-	void addReference(Entity* _entity);
-	void removeReference(Entity* _entity);
+	// Shader the material was created with, variants are compiled from it
+	ShaderProgram* getBaseShader() { return baseShader; }
+
+	// Features the material's textures need (specular maps aren't sampled yet), and whether the current variant matches them
+	unsigned int getShaderFeatures() const;
+	bool needsVariant() const { return getShaderFeatures() != variantFeatures; }
+
+	// A missing or unlinked variant leaves the current shader in place and stops the material asking for it
+	void setVariant(ShaderProgram* variant);
 
+	// Add parameters for every member of the shader's material block
 	void registerUniforms();
 
-	std::string getName() { return name; }
+	// Write parameters into the block layout of the shader and upload it. Does nothing
+	// unless the material or its shader changed since the last upload. Returns true if uploaded
+	bool updateUniformBlock();
 
+	// Call after editing parameters or textures
+	void markDirty() { version++; }
+	unsigned int getVersion() const { return version; }
 
-	std::unordered_map<std::string, Texture*> vTexture; // Texture slots
-	std::unordered_map<std::string, FloatParam> vFloat; // Float parameters
-	std::unordered_map<std::string, int> vInt; // Integer parameters
-	std::unordered_map<std::string, Vec3Param> vVec3; // Vec3 parameters
-	std::unordered_map<std::string, Vec2Param> vVec2; // Vec2 parameters
-	std::unordered_map<std::string, Color4> vColor; // Color parameters
+	// Bind the block and the texture slots for drawing
+	void bind();
 
-	std::vector<Entity*> entityRefs; // References to all entities using this material
+	std::string getName() { return name; }
+
+
+	// Parameters by name, e.g. vFloat["shininess"_sid]
+	std::unordered_map<StringID, Handle<Texture>> vTexture; // Texture slots, each keeps its texture loaded
+	std::unordered_map<StringID, FloatParam> vFloat; // Float parameters
+	std::unordered_map<StringID, int> vInt; // Integer parameters
+	std::unordered_map<StringID, Vec3Param> vVec3; // Vec3 parameters
+	std::unordered_map<StringID, Vec2Param> vVec2; // Vec2 parameters
+	std::unordered_map<StringID, Color4> vColor; // Color parameters
 
 	bool hasDiffuseTexture, hasNormalsTexture, hasSpecularTexture;
 private:
+	// std140 copy of MaterialBlock, laid out by the shader's MaterialLayout
+	UniformBuffer* uniformBlock;
+	std::vector<unsigned char> blockData;
+
+	// GL texture for each texture slot of the layout
+	std::vector<unsigned int> textureSlots;
+
+	unsigned int version = 1;
+	unsigned int uploadedVersion = 0; // Version in the uniform block
+	unsigned int uploadedLink = 0; // Shader link the block was laid out for
 
 	// Shader that the material uses
 	ShaderProgram* shader;
+	ShaderProgram* baseShader;
+	unsigned int variantFeatures;
 
 	// Name of material
 	std::string name;
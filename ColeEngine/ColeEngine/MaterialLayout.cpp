@@ -0,0 +1,88 @@
+#include "MaterialLayout.h"
+
+#include "glew.h"
+
+
+MaterialLayout::MaterialLayout(unsigned int program)
+    : blockSize(0)
+{
+    GLuint materialBlock = glGetUniformBlockIndex(program, "MaterialBlock");
+
+    if (materialBlock != GL_INVALID_INDEX)
+    {
+        GLint size = 0;
+        glGetActiveUniformBlockiv(program, materialBlock, GL_UNIFORM_BLOCK_DATA_SIZE, &size);
+        blockSize = size;
+    }
+
+    // Sampler units are assigned here, so the program has to be current
+    GLint previous = 0;
+    glGetIntegerv(GL_CURRENT_PROGRAM, &previous);
+    glUseProgram(program);
+
+    GLint nUniforms = 0;
+    glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &nUniforms);
+
+    for (GLint i = 0; i < nUniforms; i++)
+    {
+        GLuint index = static_cast<GLuint>(i);
+
+        char name[256];
+        GLint arraySize = 0;
+        GLenum type = 0;
+        glGetActiveUniform(program, index, sizeof(name), NULL, &arraySize, &type, name);
+
+        GLint block = -1;
+        glGetActiveUniformsiv(program, 1, &index, GL_UNIFORM_BLOCK_INDEX, &block);
+
+        // Plain sampler uniforms are texture slots
+        if (block == -1)
+        {
+            if (type == GL_SAMPLER_2D)
+            {
+                MaterialTextureSlot slot;
+                slot.name = StringID(name);
+                slot.unit = static_cast<int>(textureSlots.size());
+
+                glUniform1i(glGetUniformLocation(program, name), slot.unit);
+
+                textureSlots.push_back(slot);
+            }
+
+            continue;
+        }
+
+        if (static_cast<GLuint>(block) != materialBlock)
+            continue;
+
+        MaterialParam param;
+
+        switch (type)
+        {
+        case GL_FLOAT:      param.type = MaterialParamType::FLOAT; break;
+        case GL_INT:
+        case GL_BOOL:       param.type = MaterialParamType::INT; break;
+        case GL_FLOAT_VEC2: param.type = MaterialParamType::VEC2; break;
+        case GL_FLOAT_VEC3: param.type = MaterialParamType::VEC3; break;
+        case GL_FLOAT_VEC4: param.type = MaterialParamType::COLOR; break;
+        default:
+            continue; // No parameter map holds this type
+        }
+
+        // Color4 members show up as "diffuse.c"
+        std::string member = name;
+        size_t dot = member.find('.');
+        if (dot != std::string::npos)
+            member = member.substr(0, dot);
+
+        param.name = StringID(member);
+
+        GLint offset = 0;
+        glGetActiveUniformsiv(program, 1, &index, GL_UNIFORM_OFFSET, &offset);
+        param.offset = offset;
+
+        params.push_back(param);
+    }
+
+    glUseProgram(previous);
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#ifndef _MATERIAL_LAYOUT
+#define _MATERIAL_LAYOUT
+
+#include <string>
+#include <vector>
+
+#include "StringID.h"
+
+
+// Which parameter map a block member is read from
+enum class MaterialParamType
+{
+	FLOAT,
+	INT, // int and bool members, bools are 4 bytes in std140
+	VEC2,
+	VEC3,
+	COLOR
+};
+
+
+// Member of MaterialBlock
+struct MaterialParam
+{
+	StringID name; // Color4 members are named without the ".c"
+	MaterialParamType type;
+	int offset; // Byte offset in the block
+};
+
+
+// Sampler uniform outside of any block
+struct MaterialTextureSlot
+{
+	StringID name;
+	int unit; // Texture unit the sampler is set to read
+};
+
+
+// Where a shader program expects each material parameter. Read from program reflection once
+// per link, so materials can write a flat block and bind textures by slot without name lookups.
+// Names are interned here, the parameter maps are searched by ID
+class MaterialLayout
+{
+public:
+	explicit MaterialLayout(unsigned int program);
+
+	const std::vector<MaterialParam>& getParams() const { return params; }
+	const std::vector<MaterialTextureSlot>& getTextureSlots() const { return textureSlots; }
+
+	// Bytes in MaterialBlock, 0 if the program has none
+	int getBlockSize() const { return blockSize; }
+
+private:
+	std::vector<MaterialParam> params;
+	std::vector<MaterialTextureSlot> textureSlots;
+
+	int blockSize;
+};
+
+#endif
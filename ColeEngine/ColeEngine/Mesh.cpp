@@ -5,9 +5,8 @@
 #include "glew.h"
 #include "Mesh.h"
 #include "Texture.h"
-
-std::vector<Vertex> vertexTemp;
-std::vector<unsigned int> indexTemp;
+#include "BVH.h"
+#include "ThreadPool.h"
 
 
 static glm::mat4 aiMatrix4x4ToGlm(const aiMatrix4x4& from) 
@@ -49,11 +48,11 @@ static void copyToImportFolder(std::string sourcePath, std::string destPath)
 
 
 
-MeshFBX::MeshFBX(std::string path, bool importMaterial)
+MeshFBX::MeshFBX(std::string path, bool importMaterial, bool upload, ThreadPool* pool)
     : materialImported(importMaterial)
 {
     
-    // Load the model with  ASSIMP
+    // Load the model with  ASSIMP. The importer is local, so files can be imported on several threads at once
     Assimp::Importer importer;
     const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs);
 
@@ -63,58 +62,162 @@ MeshFBX::MeshFBX(std::string path, bool importMaterial)
     }
     else
     {
-        // Process the loaded model
-        processNode(scene->mRootNode, scene, glm::mat4(1.0f));
+        // Find every mesh instance and its transform
+        std::vector<MeshInstance> instances;
+        processNode(scene->mRootNode, glm::mat4(1.0f), instances);
 
         // Set number of meshes and number of materials asscoiated with model
-        nMeshes = scene->mNumMeshes;
+        nMeshes = static_cast<unsigned int>(instances.size());
         nMaterials = scene->mNumMaterials;
 
-        //meshData.resize(nMeshes);
+        meshData.resize(nMeshes);
 
-        // For every mesh in scene, create VAO and VBO 
-        for (int i = 0; i < nMeshes; i++)
+        // One job per sub-mesh, plus one for the materials after them
+        auto processRange = [&](unsigned int begin, unsigned int end)
         {
-            glGenVertexArrays(1, &meshData[i].VAO);
+            for (unsigned int i = begin; i < end; i++)
+            {
+                if (i < nMeshes)
+                    processMesh(scene->mMeshes[instances[i].meshIndex], instances[i].transform, meshData[i]);
+                else if (materialImported)
+                    loadMaterials(scene);
+            }
+        };
 
-            // Bind VAO
-            glBindVertexArray(meshData[i].VAO);
+        if (pool)
+            pool->parallelFor(nMeshes + 1, 1, processRange);
+        else
+            processRange(0, nMeshes + 1);
 
-            GLuint VBO;
-            glGenBuffers(1, &VBO);
-            glBindBuffer(GL_ARRAY_BUFFER, VBO);
-            glBufferData(GL_ARRAY_BUFFER, meshData[i].vertices.size() * sizeof(Vertex), meshData[i].vertices.data(), GL_STATIC_DRAW);
+        // Object space bounds and BVH
+        computeBounds();
+        buildBVH();
 
-            // Specify the vertex attribute pointers
-            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, position));
-            glEnableVertexAttribArray(0);
+        // For every mesh in scene, create VAO and VBO 
+        if (upload)
+            createBuffers();
+      
+    }
 
-            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
-            glEnableVertexAttribArray(1);
+}
 
-            glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, texCoords));
-            glEnableVertexAttribArray(2);
 
-            // Generate index buffer
-            glGenBuffers(1, &meshData[i].EBO);
-            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, meshData[i].EBO);
-            glBufferData(GL_ELEMENT_ARRAY_BUFFER, meshData[i].indices.size() * sizeof(unsigned int), meshData[i].indices.data(), GL_STATIC_DRAW);
+Mesh::~Mesh()
+{
+    delete bvh;
 
-            // Unbind VAO to prevent accidental changes
-            glBindVertexArray(0);
-        }
+    // Sub-meshes imported on a worker but never uploaded have nothing to delete, and no GL context
+    for (MeshData& data : meshData)
+    {
+        if (data.VAO == 0)
+            continue;
 
-        // Create materials from FBX scene
-        if (materialImported)
-        {
-            std::cout << "Number of materials : " << scene->mNumMaterials << "\n\n";
+        glDeleteVertexArrays(1, &data.VAO);
+        glDeleteBuffers(1, &data.VBO);
+        glDeleteBuffers(1, &data.EBO);
+    }
+}
 
-            loadMaterials(scene);
 
-        }
-      
+unsigned long long Mesh::getMemoryUsage() const
+{
+    unsigned long long bytes = 0;
+
+    for (const MeshData& data : meshData)
+        bytes += data.vertices.size() * sizeof(Vertex) + data.indices.size() * sizeof(unsigned int);
+
+    return bytes * 2;
+}
+
+
+void Mesh::uploadSubMesh(MeshData& data, const void* vertices, const void* indices)
+{
+    glGenVertexArrays(1, &data.VAO);
+
+    // Bind VAO
+    glBindVertexArray(data.VAO);
+
+    glGenBuffers(1, &data.VBO);
+    glBindBuffer(GL_ARRAY_BUFFER, data.VBO);
+    glBufferData(GL_ARRAY_BUFFER, data.vertices.size() * sizeof(Vertex), vertices, GL_STATIC_DRAW);
+
+    // Specify the vertex attribute pointers
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, position));
+    glEnableVertexAttribArray(0);
+
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
+    glEnableVertexAttribArray(1);
+
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, texCoords));
+    glEnableVertexAttribArray(2);
+
+    // Generate index buffer
+    glGenBuffers(1, &data.EBO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, data.EBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, data.indices.size() * sizeof(unsigned int), indices, GL_STATIC_DRAW);
+
+    // Unbind VAO to prevent accidental changes
+    glBindVertexArray(0);
+}
+
+
+void Mesh::createBuffers()
+{
+    for (MeshData& data : meshData)
+    {
+        if (data.VAO == 0)
+            uploadSubMesh(data, data.vertices.data(), data.indices.data());
+    }
+}
+
+
+void Mesh::buildBVH()
+{
+    if (!bvh)
+        bvh = new MeshBVH(this);
+
+    bvh->build();
+}
+
+
+void MeshData::computeBounds()
+{
+    if (vertices.empty())
+    {
+        boundsMin = glm::vec3(0.0f);
+        boundsMax = glm::vec3(0.0f);
+        return;
+    }
+
+    boundsMin = vertices[0].position;
+    boundsMax = vertices[0].position;
+
+    for (const Vertex& v : vertices)
+    {
+        boundsMin = glm::min(boundsMin, v.position);
+        boundsMax = glm::max(boundsMax, v.position);
+    }
+}
+
+
+void Mesh::computeBounds()
+{
+    for (MeshData& data : meshData)
+        data.computeBounds();
+
+    boundsVersion++;
+}
+
+
+void Mesh::refitBVH()
+{
+    if (!bvh)
+    {
+        buildBVH();
+        return;
     }
 
+    bvh->refit();
 }
 
 
@@ -133,38 +236,38 @@ void Mesh::drawVAO()
     }
 }
 
-void MeshFBX::processNode(const aiNode* node, const aiScene* scene, const glm::mat4& parentTransform)
+void MeshFBX::processNode(const aiNode* node, const glm::mat4& parentTransform, std::vector<MeshInstance>& instances)
 {
     // Apply the current node's transformation
     glm::mat4 currentTransform = parentTransform * aiMatrix4x4ToGlm(node->mTransformation);
 
 
-    // Process all the node's meshes
+    // Queue all the node's meshes
     for (unsigned int i = 0; i < node->mNumMeshes; ++i)
     {
-        const aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-
-        processMesh(mesh, scene, currentTransform);
+        instances.push_back({ node->mMeshes[i], currentTransform });
     }
 
     // Recursively process each of the node's children
     for (unsigned int i = 0; i < node->mNumChildren; ++i)
     {
-        processNode(node->mChildren[i], scene, currentTransform);
+        processNode(node->mChildren[i], currentTransform, instances);
     }
 }
 
 
-void MeshFBX::processMesh(const aiMesh* mesh, const aiScene* scene, const glm::mat4& parentTransform)
+void MeshFBX::processMesh(const aiMesh* mesh, const glm::mat4& parentTransform, MeshData& out)
 {
-    vertexTemp.clear();
-    indexTemp.clear();
+    out.vertices.resize(mesh->mNumVertices);
 
     // Process each vertex
     for (unsigned int i = 0; i < mesh->mNumVertices; ++i) 
     {
-        Vertex vertex;
-        vertex.position = glm::vec3(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z);
+        Vertex& vertex = out.vertices[i];
+
+        // Apply the parent transformation to the position
+        glm::vec4 pos = parentTransform * glm::vec4(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z, 1.0f);
+        vertex.position = glm::vec3(pos);
 
         // Check if the mesh has normals
         if (mesh->HasNormals()) 
@@ -185,40 +288,24 @@ void MeshFBX::processMesh(const aiMesh* mesh, const aiScene* scene, const glm::m
         {
             vertex.texCoords = glm::vec2(0.0f, 0.0f);
         }
-
-        vertexTemp.push_back(vertex);
     }
 
 
     // Process each face (assume triangles for simplicity)
+    out.indices.clear();
+    out.indices.reserve(mesh->mNumFaces * 3);
+
     for (unsigned int i = 0; i < mesh->mNumFaces; ++i)
     {
         const aiFace& face = mesh->mFaces[i];
         for (unsigned int j = 0; j < face.mNumIndices; ++j)
         {
-            indexTemp.push_back(face.mIndices[j]);
+            out.indices.push_back(face.mIndices[j]);
         }
     }
 
-
-    // Apply the parent transformation to the vertices
-    for (Vertex& vertex : vertexTemp)
-    {
-        glm::vec4 pos = glm::vec4(vertex.position, 1.0f);
-        pos = parentTransform * pos;
-        vertex.position = glm::vec3(pos);
-    }
-
-
-    // Create new mesh data object
-    meshData.push_back(MeshData());
-
-    // Copy the vertex and index data to it
-    meshData.back().vertices = std::vector<Vertex>(vertexTemp);
-    meshData.back().indices = std::vector<unsigned int>(indexTemp);
-
     // Set mesh material index
-    meshData.back().materialIndex = mesh->mMaterialIndex;
+    out.materialIndex = mesh->mMaterialIndex;
 
 }
 
@@ -406,13 +493,13 @@ MeshTerrain::MeshTerrain(float _size, int _resolution, float _height)
     : size(_size), resolution(_resolution), hWidth(0), hHeight(0), height(_height)
 {
     generateMesh(size, resolution);
+    computeBounds();
+    buildBVH();
 }
 
 MeshTerrain::~MeshTerrain()
 {
-    meshData[0].indices.clear();
-    meshData[0].vertices.clear();
-    meshData.clear();
+    // Sub-mesh buffers are deleted by ~Mesh
     heightMap.clear();
 }
 
@@ -573,15 +660,28 @@ void MeshTerrain::applyHeightMap()
 
     // Finally, update the mesh on the GPU
     updateMesh();
+
+    // Heights changed, refit bounds and BVH
+    computeBounds();
+    refitBVH();
 }
 
 
 void MeshTerrain::updateTerrain(float newSize, int newRes, float newHeight)
 {
+    height = newHeight;
+
+    // Same vertex count, reuse the existing buffers and BVH layout
+    if (newRes == resolution && !meshData.empty())
+    {
+        resetMesh(newSize);
+        applyHeightMap();
+        return;
+    }
+
     // Update terrain data
     size = newSize;
     resolution = newRes;
-    height = newHeight;
 
     // Delete existing mesh data
     glDeleteVertexArrays(1, &meshData[0].VAO);
@@ -598,6 +698,31 @@ void MeshTerrain::updateTerrain(float newSize, int newRes, float newHeight)
 
 
 
+// Flatten the grid back to its initial layout at a new size
+void MeshTerrain::resetMesh(float _size)
+{
+    size = _size;
+
+    int N = resolution;
+    float K = size / static_cast<float>(resolution);
+
+    float halfSize = static_cast<float>(N * K) / 2.0f;
+
+    std::vector<Vertex>& verts = meshData[0].vertices;
+
+    for (int i = 0; i <= N; ++i)
+    {
+        for (int j = 0; j <= N; ++j)
+        {
+            Vertex& vert = verts[i * (N + 1) + j];
+            vert.position = { j * K - halfSize, i * K - halfSize, 0.0f };
+            vert.normal = { 0.0f, 0.0f, -1.0f };
+        }
+    }
+}
+
+
+
 void MeshTerrain::updateMesh()
 {
     glBindBuffer(GL_ARRAY_BUFFER, meshData[0].VBO);
@@ -10,12 +10,16 @@
 
 #include "Material.h"
 #include "Texture.h"
+#include "MappedFile.h"
+#include "Resource.h"
 
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
 class Material;
+class MeshBVH;
+class ThreadPool;
 
 
 // A single vertex
@@ -65,25 +69,46 @@ struct MaterialData
 // Per mesh data
 struct MeshData
 {
-    unsigned int VAO, EBO, VBO;
+    unsigned int VAO = 0, EBO = 0, VBO = 0;
 
     std::vector<Vertex> vertices;
     std::vector<unsigned int> indices;
 
     unsigned int materialIndex = 0;
+
+    // Object space bounds
+    glm::vec3 boundsMin = { 0.0f, 0.0f, 0.0f };
+    glm::vec3 boundsMax = { 0.0f, 0.0f, 0.0f };
+
+    void computeBounds();
 };
 
 
 
 // Contains all mesh VAO's and vertices and materials of an FBX scene
-class Mesh
+class Mesh : public Resource
 {
 public:
-    Mesh() {};
-    virtual ~Mesh() {}
+    Mesh() : Resource(ResourceType::MESH) {};
+    virtual ~Mesh();
 
     virtual void drawVAO();
 
+    // Create GL buffers for every sub-mesh that has none yet. GL thread only
+    virtual void createBuffers();
+
+    // (Re)build the object space BVH over all sub-meshes
+    void buildBVH();
+
+    // Refit the BVH after vertices moved. Much cheaper than buildBVH()
+    void refitBVH();
+
+    // Recompute object space bounds of every sub-mesh
+    void computeBounds();
+
+    // Vertex and index bytes, counted twice for the CPU copy kept for the BVH
+    unsigned long long getMemoryUsage() const;
+
     // Data for every mesh in FBX scene
     std::vector<MeshData> meshData;
 
@@ -91,18 +116,38 @@ public:
     std::vector<MaterialData> matData;
 
     // Number of meshes and materials in scene
-    unsigned int nMeshes, nMaterials;
+    unsigned int nMeshes = 0, nMaterials = 0;
+
+    // Bottom level BVH for ray queries, in object space
+    MeshBVH* bvh = nullptr;
+
+    // Bumped when sub-mesh bounds change
+    unsigned int boundsVersion = 0;
+
+protected:
+    // Create the VAO, VBO and EBO of a sub-mesh. Sizes come from data.vertices and data.indices,
+    // contents from the given pointers so they can point into a mapped file
+    void uploadSubMesh(MeshData& data, const void* vertices, const void* indices);
 };
 
 
 class MeshFBX : public Mesh
 {
 public:
-    MeshFBX(std::string path, bool importMaterial);
+    // Safe to run on any thread when upload is false, call createBuffers() on the GL thread afterwards.
+    // With a pool, sub-meshes and materials are processed on its workers
+    MeshFBX(std::string path, bool importMaterial, bool upload = true, ThreadPool* pool = nullptr);
 
 private:
-    void processNode(const aiNode* node, const aiScene* scene, const glm::mat4& parentTransform);
-    void processMesh(const aiMesh* mesh, const aiScene* scene, const glm::mat4& parentTransform);
+    // A mesh referenced by a node, with the node's accumulated transform
+    struct MeshInstance
+    {
+        unsigned int meshIndex;
+        glm::mat4 transform;
+    };
+
+    void processNode(const aiNode* node, const glm::mat4& parentTransform, std::vector<MeshInstance>& instances);
+    static void processMesh(const aiMesh* mesh, const glm::mat4& parentTransform, MeshData& out);
     void processTexture(const aiScene* scene, const aiMaterial* material, aiTextureType type, const std::string& typeName, unsigned int index);
 
     void loadEmbeddedTexture(const aiTexture* texture, aiTextureType type, unsigned int index);
@@ -114,6 +159,30 @@ private:
 
 
 
+// Mesh loaded from a cooked .cmesh file, see CMesh.h
+class MeshCooked : public Mesh
+{
+public:
+    // Safe to run on any thread when upload is false. The file stays mapped until createBuffers()
+    MeshCooked(std::string path, bool upload = true);
+
+    // Uploads straight from the mapped file, then unmaps it
+    void createBuffers() override;
+
+    // False if the file was missing, from another version or damaged
+    bool isValid() const { return valid; }
+
+private:
+    bool valid;
+
+    MappedFile file;
+
+    // Vertex and index blobs of each sub-mesh inside the mapping
+    std::vector<std::pair<const void*, const void*>> blobs;
+};
+
+
+
 class MeshTerrain : public Mesh
 {
 public:
@@ -133,6 +202,7 @@ private:
 
     void updateMesh();
     void generateMesh(float _size, int _resolution);
+    void resetMesh(float _size);
 };
 
 
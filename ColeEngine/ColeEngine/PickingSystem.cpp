@@ -0,0 +1,51 @@
+#include "PickingSystem.h"
+
+#include "imgui.h"
+
+
+PickingSystem::PickingSystem(Engine& /*engine*/)
+{
+
+}
+
+
+void PickingSystem::update(Engine& engine)
+{
+    Platform& platform = engine.getPlatform();
+    World& world = engine.getWorld();
+
+    // Mouse is rotating the camera
+    if (platform.mouseRight)
+        return;
+
+    // Mouse is over a UI window
+    if (ImGui::GetCurrentContext() && ImGui::GetIO().WantCaptureMouse)
+        return;
+
+    Ray3D ray = world.screenPointToRay(platform.mouseX, platform.mouseY);
+
+    hoverHit = RayHit();
+
+    bool hit = world.castRay(ray, &hoverHit);
+
+    // Terrain mode reads the brush position from the G-buffer and uses clicks for painting
+    if (engine.mode == EngineMode::TERRAIN)
+        return;
+
+    // Off into the distance when the ray misses everything
+    world.mouseWorldPos = hit ? hoverHit.position : ray.origin + ray.direction * world.back;
+
+    // A click on empty space has no entity, which clears the selection
+    if (platform.mouseLeftRelease && hoverHit.entity != engine.selectedEntity)
+    {
+        engine.selectedEntity = hoverHit.entity;
+        engine.onSelect = true;
+    }
+}
+
+
+void PickingSystem::entityRemoved(Entity* entity)
+{
+    if (hoverHit.entity == entity)
+        hoverHit = RayHit();
+}
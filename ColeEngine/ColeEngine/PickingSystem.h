@@ -0,0 +1,31 @@
+#pragma once
+
+
+#ifndef _PICKINGSYSTEM
+#define _PICKINGSYSTEM
+
+#include "Engine.h"
+#include "System.h"
+
+#define GLM_FORCE_RADIANS
+#define GLM_SWIZZLE
+#include <glm/ext.hpp>
+
+// Mouse picking against the CPU scene BVH. Never reads back from the GPU.
+class PickingSystem : public System
+{
+public:
+	explicit PickingSystem(Engine& _engine);
+
+	void update(Engine& engine) override;
+
+	void entityRemoved(Entity* entity) override;
+
+	// Result of the last mouse ray
+	const RayHit& getHoverHit() const { return hoverHit; }
+
+private:
+	RayHit hoverHit;
+};
+
+#endif
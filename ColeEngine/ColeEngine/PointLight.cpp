@@ -1,32 +1,24 @@
 #include "PointLight.h"
 
-PointLight::PointLight(std::string _name, unsigned int width, unsigned int height)
-	: shadowFBO(nullptr), resW(width), resH(height)
+PointLight::PointLight(std::string _name)
 {
-
-	shadowFBO = new FBO();
-
-	if (shadowFBO)
-	{
-		shadowFBO->CreateFBO_3D(resW, resH, false);
-	}
-
 	setName(_name);
 }
 
 PointLight::~PointLight()
 {
-	if (shadowFBO)
-	{
-		delete shadowFBO;
-		shadowFBO = nullptr;
-	}
 }
 
-FBO* PointLight::getShadowFBO()
+
+unsigned int PointLight::getShadowStaleness() const
 {
-	if (shadowFBO)
+	unsigned int staleness = 0;
+
+	for (unsigned int f = 0; f < 6; f++)
 	{
-		return shadowFBO;
+		if ((pendingFaces & (1u << f)) && faceAge[f] > staleness)
+			staleness = faceAge[f];
 	}
-}
\ No newline at end of file
+
+	return staleness;
+}
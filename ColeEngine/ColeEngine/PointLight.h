@@ -5,19 +5,43 @@
 
 #include <string>
 #include "Entity.h"
-#include "FBO.h"
+#include "ShadowAtlas.h"
+
+// Face mask that renders to every cube map face
+#define CUBE_FACES_ALL 0x3F
 
 class PointLight : public Entity
 {
 public:
-	PointLight(std::string _name, unsigned int width, unsigned int height);
+	PointLight(std::string _name);
 	~PointLight();
-	FBO* getShadowFBO();
 
-private:
-	FBO* shadowFBO;
+	// Force the static cache to be redrawn
+	void invalidateStaticShadows() { staticDirty = true; }
+
+	// Redraw every face next frame, ignoring the face budget
+	void forceShadowUpdate() { forcedFaces = CUBE_FACES_ALL; }
+
+	// Frames since the oldest out of date face was drawn, 0 when the shadow map is current
+	unsigned int getShadowStaleness() const;
+
+	// Static cache bookkeeping
+	bool staticDirty = true; // Static casters need to be drawn again
+	bool hasDynamicCasters = true; // Dynamic casters in range this frame
+	glm::vec3 cachedPos = { 0.0f, 0.0f, 0.0f }; // Light position the static cache was drawn from
+	float cachedFarPlane = 0.0f; // Light range the static cache was drawn with
+
+	// Shadow update scheduling, face bits are ordered +X,-X,+Y,-Y,+Z,-Z
+	unsigned int pendingFaces = CUBE_FACES_ALL; // Faces whose contents are out of date
+	unsigned int forcedFaces = CUBE_FACES_ALL; // Faces that must be drawn this frame
+	unsigned int scheduledFaces = 0; // Faces picked for this frame
+	unsigned int nextFace = 0; // Round-robin cursor
+	unsigned int faceAge[6] = { 0, 0, 0, 0, 0, 0 }; // Frames since each face was drawn
+	float shadowPriority = 0.0f; // Screen influence weighted by distance to the eye
 
-	unsigned int resW, resH;
+	// Shadow atlas tiles, one per cube face. Invalid when the atlas had no room
+	ShadowTile shadowTiles[6];
+	int shadowTileRequest = 0; // Tile size wanted from screen coverage, 0 without shadows
 };
 
 #endif
\ No newline at end of file
@@ -4,8 +4,13 @@ precision highp float;
 
 in vec4 FragPos;
 
-uniform vec3 lightPos;
-uniform float far_plane;
+layout(std140) uniform LightBlock
+{
+    mat4 shadowMatrices[6];
+    vec3 lightPos;
+    float far_plane;
+    int faceLayer[6]; // Shadow atlas layer holding each face
+};
 
 //out vec4 FragColor;
 
@@ -11,7 +11,21 @@ in vec2 vertexTexture;
 in vec3 vertexTangent;
 
 
-uniform mat4 WorldView, WorldInverse, WorldProj, ModelTr;
+layout(std140) uniform FrameBlock
+{
+    mat4 WorldView;
+    mat4 WorldProj;
+    mat4 WorldInverse;
+    vec3 viewPos;
+    float time;
+    vec3 ambientColor;
+    int mode;
+    vec3 sunPos;
+    bool basicShading;
+    vec3 mouseWorld;
+};
+
+uniform mat4 ModelTr;
 
 //out vec3 FragPos;
 
@@ -1,4 +1,5 @@
 #include "RenderPipeline.h"
+#include "LightClusters.h"
 #include "PointLight.h"
 
 #include "Mesh.h"
@@ -19,61 +20,39 @@ void RenderPipeline::draw(RenderComponent* render)
 }
 
 
-void RenderPipeline::setGeometryPassUnis(Engine& engine, GeometryPassUniforms uniforms)
-{
-    // World specific uniforms
-    int loc = glGetUniformLocation(shader->programId, "WorldProj");
-    glUniformMatrix4fv(loc, 1, GL_FALSE, Pntr(uniforms.worldProj));
-
-    loc = glGetUniformLocation(shader->programId, "WorldView");
-    glUniformMatrix4fv(loc, 1, GL_FALSE, Pntr(uniforms.worldView));
-
-    loc = glGetUniformLocation(shader->programId, "WorldInverse");
-    glUniformMatrix4fv(loc, 1, GL_FALSE, Pntr(uniforms.worldInverse));
-
-    loc = glGetUniformLocation(shader->programId, "time");
-    glUniform1f(loc, engine.getWorld().time);
-
-}
-
-
 void RenderPipeline::setLightingPassUnis(Engine& engine, GBuffer* gBuffer, LightingPassUniforms uniforms)
 {
-
-    int loc = glGetUniformLocation(shader->programId, "viewPos");
-    glUniform3fv(loc, 1, &engine.getWorld().eyePos[0]);
-
-   
+    // Camera and world values come from FrameBlock
 
     // Bind G-Buffer textures to sampler slots
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, gBuffer->getTexture(BufferType::POSITION)->get());
-    loc = glGetUniformLocation(shader->programId, "gPosition");
+    int loc = shader->getUniformLocation("gPosition"_sid);
     glUniform1i(loc, 0);
 
     // Set normals texture
     glActiveTexture(GL_TEXTURE1);
     glBindTexture(GL_TEXTURE_2D, gBuffer->getTexture(BufferType::NORMALS)->get());
-    loc = glGetUniformLocation(shader->programId, "gNormal");
+    loc = shader->getUniformLocation("gNormal"_sid);
     glUniform1i(loc, 1);
 
     // Set albedo texture
     glActiveTexture(GL_TEXTURE2);
     glBindTexture(GL_TEXTURE_2D, gBuffer->getTexture(BufferType::ALBEDO)->get());
-    loc = glGetUniformLocation(shader->programId, "gAlbedo");
+    loc = shader->getUniformLocation("gAlbedo"_sid);
     glUniform1i(loc, 2);
 
     // Set specular texture
     glActiveTexture(GL_TEXTURE3);
     glBindTexture(GL_TEXTURE_2D, gBuffer->getTexture(BufferType::SPECULAR)->get());
-    loc = glGetUniformLocation(shader->programId, "gSpecular");
+    loc = shader->getUniformLocation("gSpecular"_sid);
     glUniform1i(loc, 3);
 
     /*
     // Set view texture
     glActiveTexture(GL_TEXTURE4);
     glBindTexture(GL_TEXTURE_2D, gBuffer->getTexture(BufferType::VIEW)->get());
-    loc = glGetUniformLocation(shader->programId, "gView");
+    loc = shader->getUniformLocation("gView"_sid);
     glUniform1i(loc, 4);
 
     */
@@ -82,152 +61,85 @@ void RenderPipeline::setLightingPassUnis(Engine& engine, GBuffer* gBuffer, Light
     {
         glActiveTexture(GL_TEXTURE4);
         glBindTexture(GL_TEXTURE_2D, engine.Resource().getSkyTexture()->get());
-        loc = glGetUniformLocation(shader->programId, "skyTexture");
+        loc = shader->getUniformLocation("skyTexture"_sid);
         glUniform1i(loc, 4);
     }
 
 
-    // Set world ambient color
-    loc = glGetUniformLocation(shader->programId, "ambientColor");
-    glUniform3fv(loc, 1, &engine.getWorld().ambientColor[0]);
+    // Every point light shadow lives in one atlas
+    glActiveTexture(GL_TEXTURE5);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, uniforms.shadowAtlas);
+    loc = shader->getUniformLocation("shadowAtlas"_sid);
+    glUniform1i(loc, 5);
 
-    // Set world sun position
-    loc = glGetUniformLocation(shader->programId, "sunPos");
-    glUniform3fv(loc, 1, &engine.getWorld().lightPos[0]);
+    loc = shader->getUniformLocation("shadowAtlasSize"_sid);
+    glUniform1f(loc, static_cast<float>(uniforms.shadowAtlasSize));
 
-    // Set shading mode
-    loc = glGetUniformLocation(shader->programId, "basicShading");
-    glUniform1i(loc, engine.debug.basicShading);
+    // Light tables built by the cluster binning
+    glActiveTexture(GL_TEXTURE6);
+    glBindTexture(GL_TEXTURE_BUFFER, uniforms.lightData);
+    loc = shader->getUniformLocation("lightData"_sid);
+    glUniform1i(loc, 6);
 
-    // Get all point lights in scene
-    std::vector<PointLight*> pointLights(engine.getWorld().pointLights);
+    glActiveTexture(GL_TEXTURE7);
+    glBindTexture(GL_TEXTURE_BUFFER, uniforms.clusterGrid);
+    loc = shader->getUniformLocation("clusterGrid"_sid);
+    glUniform1i(loc, 7);
 
-    
+    glActiveTexture(GL_TEXTURE8);
+    glBindTexture(GL_TEXTURE_BUFFER, uniforms.lightIndices);
+    loc = shader->getUniformLocation("lightIndices"_sid);
+    glUniform1i(loc, 8);
 
-    // Set point light uniforms for lighting shader
-    unsigned int nLights = pointLights.size();
-    for (unsigned int i = 0; i < nLights; i++)
-    {
-        // Point lightis valid
-        if (pointLights[i])
-        {
-            PointLight* light = engine.getWorld().pointLights[i];
-            unsigned int textureID = light->getShadowFBO()->textureCube->get();
-
-            TransformComponent* trn = pointLights[i]->getComponent<TransformComponent>();
-            PointLightComponent* plc = pointLights[i]->getComponent<PointLightComponent>();
-
-            // Components exist
-            if (trn && plc)
-            {
-                // Set light cubemap sampler
-                glActiveTexture(GL_TEXTURE5 + i);
-                glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
-                std::string uniName = "shadowMapPoint[" + std::to_string(i) + "]";
-                loc = glGetUniformLocation(shader->programId, uniName.c_str());
-                glUniform1i(loc, 5 + i);
-
-                // Set light position
-                uniName = "lights[" + std::to_string(i) + "].pos";
-                loc = glGetUniformLocation(shader->programId, uniName.c_str());
-                glUniform3fv(loc, 1, &trn->pos[0]);
-
-                // Set light color
-                uniName = "lights[" + std::to_string(i) + "].color";
-                loc = glGetUniformLocation(shader->programId, uniName.c_str());
-                glUniform3fv(loc, 1, &plc->color[0]);
-
-                // Set light strength
-                uniName = "lights[" + std::to_string(i) + "].strength";
-                loc = glGetUniformLocation(shader->programId, uniName.c_str());
-                glUniform1fv(loc, 1, &plc->strength);
-
-                // Set light falloff
-                uniName = "lights[" + std::to_string(i) + "].falloff";
-                loc = glGetUniformLocation(shader->programId, uniName.c_str());
-                glUniform1fv(loc, 1, &plc->falloff);
-
-                // Set light falloff
-                uniName = "lights[" + std::to_string(i) + "].farPlane";
-                loc = glGetUniformLocation(shader->programId, uniName.c_str());
-                glUniform1fv(loc, 1, &plc->farPlane);
-
-            }
-            
-        }
-    }
+    // Cluster lookup parameters
+    loc = shader->getUniformLocation("clusterDims"_sid);
+    glUniform3i(loc, CLUSTER_X, CLUSTER_Y, CLUSTER_Z);
+
+    loc = shader->getUniformLocation("clusterDepth"_sid);
+    glUniform2f(loc, CLUSTER_NEAR, CLUSTER_FAR);
+
+    loc = shader->getUniformLocation("screenSize"_sid);
+    glUniform2f(loc, static_cast<float>(engine.getPlatform().width), static_cast<float>(engine.getPlatform().height));
 }
 
 void RenderPipeline::setShadowPassUnis(Engine& engine, RenderComponent* render, ShadowPassUniforms uniforms)
 {
 
-    int loc = glGetUniformLocation(shader->programId, "WorldProj");
+    int loc = shader->getUniformLocation("WorldProj"_sid);
     glUniformMatrix4fv(loc, 1, GL_FALSE, Pntr(uniforms.lightProj));
 
-    loc = glGetUniformLocation(shader->programId, "WorldView");
+    loc = shader->getUniformLocation("WorldView"_sid);
     glUniformMatrix4fv(loc, 1, GL_FALSE, Pntr(uniforms.lightView));
 
-    loc = glGetUniformLocation(shader->programId, "lightPos");
+    loc = shader->getUniformLocation("lightPos"_sid);
     glUniform3fv(loc, 1, &(engine.getWorld().lightPos[0]));
 
-    loc = glGetUniformLocation(shader->programId, "ModelTr");
+    loc = shader->getUniformLocation("ModelTr"_sid);
     glUniformMatrix4fv(loc, 1, GL_FALSE, Pntr(uniforms.transform));
 
    
 }
 
-void RenderPipeline::setPointShadowPassUnis(Engine& engine, PointLightShadowPassUniforms pointPassUnis)
-{
-    int loc = glGetUniformLocation(shader->programId, "far_plane");
-    glUniform1f(loc, pointPassUnis.farPlane);
-
-
-    loc = glGetUniformLocation(shader->programId, "lightPos");
-    glUniform3fv(loc, 1, &pointPassUnis.pointLightPos[0]);
-
-
-    // Set the editor mode
-    loc = glGetUniformLocation(shader->programId, "mode");
-    if (engine.mode == EngineMode::TERRAIN)
-    {
-        glUniform1i(loc, 1);
-    }
-    else
-    {
-        glUniform1i(loc, 0);
-    }
-
-    // Set mouse world position
-    loc = glGetUniformLocation(shader->programId, "mouseWorld");
-    glUniform3fv(loc, 1, &engine.getWorld().mouseWorldPos[0]);
-
-
-    for (unsigned int i = 0; i < 6; ++i)
-    {
-        std::string uniName = "shadowMatrices[" + std::to_string(i) + "]";
-        loc = glGetUniformLocation(shader->programId, uniName.c_str());
-        //glUniformMatrix4fv(loc, 1, GL_FALSE, Pntr(uniforms.shadowTransforms[i]));
-        glm::mat4 trn = pointPassUnis.shadowTransforms[i];
-        glUniformMatrix4fv(loc, 1, GL_FALSE, &trn[0][0]);
-    }
-    
-}
-
 void RenderPipeline::setSpriteMaterialUniforms(Engine& engine, Material* mat, SpriteUniforms unis)
 {
     if (mat)
     {
+        // Sprites bind their own texture
+        boundMaterial = nullptr;
+
         // Shader attached to material
         ShaderProgram* shader = mat->getShader();
 
-        int loc = glGetUniformLocation(shader->programId, "diffuse");
+        int loc = shader->getUniformLocation("diffuse"_sid);
         glUniform4fv(loc, 1, &unis.color[0]);
 
-        Texture* texture = mat->vTexture["sprite_texture"];
+        Texture* texture = mat->vTexture["sprite_texture"_sid];
         //Texture* texture = nullptr;
         if (texture)
         {
-            loc = glGetUniformLocation(shader->programId, "sprite");
+            engine.Resource().requestTextureDetail(mat);
+
+            loc = shader->getUniformLocation("sprite"_sid);
             glUniform1i(loc, 0);
 
             glActiveTexture(GL_TEXTURE0);
@@ -241,73 +153,17 @@ void RenderPipeline::setMaterialUniforms(Engine& engine, Material* mat)
 {
     if (mat)
     {
-        // Shader attached to material
-        ShaderProgram* shader = mat->getShader();
-
-        int loc = -1;
-        // Set texture sampler uniforms
-        int i = 0;
-        for (auto& it : mat->vTexture)
-        {
-            std::string name = it.first;
-            Texture* texture = it.second;
-
-            int loc = glGetUniformLocation(shader->programId, name.c_str());
-            glUniform1i(loc, i);
+        // Still bound from the previous draw
+        if (mat == boundMaterial && mat->getVersion() == boundVersion && mat->getShader()->programId == boundProgram)
+            return;
 
-            glActiveTexture(GL_TEXTURE0 + i);
-            glBindTexture(GL_TEXTURE_2D, texture->get());
-
-            i++;
-        }
-
-        // Set float uniforms
-        for (auto& it : mat->vFloat)
-        {
-            std::string name = it.first;
-            float value = it.second.val;
-
-            int loc = glGetUniformLocation(shader->programId, name.c_str());
-            glUniform1f(loc, value);
-
-        }
-
-       
-
-        // Set color uniforms
-        for (auto& it : mat->vColor)
-        {
-            std::string name = it.first;
-            Color4 value = it.second;
-
-            std::string nm = name + ".c";
-            int loc = glGetUniformLocation(shader->programId, nm.c_str());
-            glUniform4fv(loc, 1, &value[0]);
-        }
-
-        // Set vec3 uniforms
-        for (auto& it : mat->vVec3)
-        {
-            std::string name = it.first;
-            glm::vec3 value = it.second.val;
-
-            int loc = glGetUniformLocation(shader->programId, name.c_str());
-            glUniform3fv(loc, 1, &value[0]);
-        }
-
-        // Set vec2 uniforms
-        for (auto& it : mat->vVec2)
-        {
-            std::string name = it.first;
-            glm::vec2 value = it.second.val;
-
-            int loc = glGetUniformLocation(shader->programId, name.c_str());
-            glUniform2fv(loc, 1, &value[0]);
-        }
-
-       
+        // Parameter block and texture slots were resolved when the material was updated
+        mat->bind();
 
+        boundMaterial = mat;
+        boundVersion = mat->getVersion();
+        boundProgram = mat->getShader()->programId;
 
+        engine.stats.materialBinds++;
     }
 }
-
@@ -15,18 +15,17 @@
 #include "GBuffer.h"
 //#include "ParticleEmitter.h"
 
-struct GeometryPassUniforms
-{
-	glm::mat4 worldProj = glm::mat4();
-	glm::mat4 worldView = glm::mat4();
-	glm::mat4 worldInverse = glm::mat4();
-	glm::mat4 transform = glm::mat4();
-
-};
-
 struct LightingPassUniforms
 {
 	std::vector<glm::vec3> pointLightPos;
+
+	unsigned int shadowAtlas = 0; // Point light shadow atlas texture array
+	int shadowAtlasSize = 0; // Width and height of one atlas layer
+
+	// Clustered light tables, buffer textures
+	unsigned int lightData = 0;
+	unsigned int clusterGrid = 0;
+	unsigned int lightIndices = 0;
 };
 
 
@@ -37,16 +36,6 @@ struct ShadowPassUniforms
 	glm::mat4 transform = glm::mat4();
 };
 
-struct PointLightShadowPassUniforms
-{
-	glm::mat4 shadowProj;
-	std::vector<glm::mat4> shadowTransforms;
-
-	float farPlane = 25.0f;
-	glm::vec3 pointLightPos = { 6.0f, 0.0f, 2.0f };
-	unsigned int textureID;
-};
-
 struct SpriteUniforms
 {
 	glm::vec4 color;
@@ -60,14 +49,15 @@ public:
 
 	void draw(RenderComponent* render);
 
-	void setGeometryPassUnis(Engine& engine, GeometryPassUniforms uniforms);
 	void setLightingPassUnis(Engine& engine, GBuffer* gBuffer, LightingPassUniforms uniforms);
 
 	//void setLightingPassUnis(Engine& engine, RenderComponent* render, LightingPassUniforms uniforms);
 	void setShadowPassUnis(Engine& engine, RenderComponent* render, ShadowPassUniforms uniforms);
-	void setPointShadowPassUnis(Engine& engine, PointLightShadowPassUniforms pointPassUnis);
 
 	void setMaterialUniforms(Engine& engine, Material* mat);
+
+	// Forget the bound material, call when other code changed texture or block bindings
+	void resetMaterialBinding() { boundMaterial = nullptr; }
 	void setSpriteMaterialUniforms(Engine& engine, Material* mat, SpriteUniforms unis);
 
 	std::string getName() { return name; }
@@ -76,6 +66,11 @@ public:
 
 private:
 	std::string name;
+
+	// Material whose block and textures are bound, so repeated draws skip binding it again
+	Material* boundMaterial = nullptr;
+	unsigned int boundVersion = 0;
+	int boundProgram = -1;
 };
 
 #endif
\ No newline at end of file
@@ -5,6 +5,9 @@
 #include "Transform.h"
 #include "Logging.h"
 
+#include <algorithm>
+#include <cstring>
+
 
 
 static unsigned int VaoFromPoints(std::vector<glm::vec4> Pnt, std::vector<int> Ind)
@@ -29,26 +32,41 @@ static unsigned int VaoFromPoints(std::vector<glm::vec4> Pnt, std::vector<int> I
 	return vaoID;
 }
 
-static glm::vec3 getRayDirection(int screenWidth, int screenHeight, double mouseX, double mouseY, glm::mat4 viewMatrix, glm::mat4 projectionMatrix)
+// Closest point of the box to the sphere center is within the radius
+static bool sphereIntersectsAABB(const glm::vec3& center, float radius, const glm::vec3& boxMin, const glm::vec3& boxMax)
 {
-	// Convert mouse coordinates to NDC (Normalized Device Coordinates)
-	float ndcX = (2.0f * mouseX) / (static_cast<float>(screenWidth) - 1.0f);
-	float ndcY = 1.0f - (2.0f * mouseY) / static_cast<float>(screenHeight);
-	//float ndcX = 0.0f;
-	//float ndcY = 0.0f;
-	// Create a ray in clip space
-	glm::vec4 rayClip(ndcX, ndcY, -1.0f, 0.0f);
+	glm::vec3 closest = glm::clamp(center, boxMin, boxMax);
+	glm::vec3 d = closest - center;
 
-	glm::mat4 viewProjectionInverse = glm::inverse(projectionMatrix * viewMatrix);
+	return glm::dot(d, d) <= radius * radius;
+}
 
-	// Unproject the ray into view space
-	glm::vec4 rayView = viewProjectionInverse * rayClip;
-	rayView /= rayView.w;
+// Which cube map faces a box (relative to the light) can touch. Bit order matches the
+// shadow matrices: +X, -X, +Y, -Y, +Z, -Z. Face +X covers points with x >= |y| and x >= |z|,
+// so the box is tested against those four planes.
+static unsigned int cubeFaceMask(const glm::vec3& boxMin, const glm::vec3& boxMax)
+{
+	unsigned int mask = 0;
+
+	for (int axis = 0; axis < 3; axis++)
+	{
+		int b = (axis + 1) % 3;
+		int c = (axis + 2) % 3;
 
-	// The ray direction is the vector from the camera position to the unprojected point
-	glm::vec3 rayDirection = glm::normalize(glm::vec3(rayView) - glm::vec3(viewMatrix[3]));
+		for (int side = 0; side < 2; side++)
+		{
+			// Furthest extent of the box along the face direction
+			float reach = (side == 0) ? boxMax[axis] : -boxMin[axis];
 
-	return rayDirection;
+			if (reach - boxMin[b] >= 0.0f && reach + boxMax[b] >= 0.0f &&
+				reach - boxMin[c] >= 0.0f && reach + boxMax[c] >= 0.0f)
+			{
+				mask |= 1u << (axis * 2 + side);
+			}
+		}
+	}
+
+	return mask;
 }
 
 RenderSystem::RenderSystem(Engine& _engine)
@@ -56,27 +74,27 @@ RenderSystem::RenderSystem(Engine& _engine)
 	pointLightPass(nullptr), gBuffer(nullptr)
 {
 	// Create pipeline for rendering geomentry into G-buffer
-	geometryPass = new RenderPipeline("Geometry pipeline", engine.Resource().shader("geometry_default"));
+	geometryPass = new RenderPipeline("Geometry pipeline", engine.Resource().shader("geometry_default"_sid));
 
 	// Create pipeline for deffered lighting pass
-	lightingPass = new RenderPipeline("Lighting pipeline", engine.Resource().shader("lighting"));
+	lightingPass = new RenderPipeline("Lighting pipeline", engine.Resource().shader("lighting"_sid));
 
 	// Create pipeline for point light shadows
-	pointLightPass = new RenderPipeline("Point light shadow pipeline", engine.Resource().shader("point_shadows_default"));
+	pointLightPass = new RenderPipeline("Point light shadow pipeline", engine.Resource().shader("point_shadows_default"_sid));
 
 	// Create pipeline for post processing
-	postProcessPass = new RenderPipeline("Post process pipeline", engine.Resource().shader("post_process_default"));
+	postProcessPass = new RenderPipeline("Post process pipeline", engine.Resource().shader("post_process_default"_sid));
 
 
-	particlesPass = new RenderPipeline("Particles pipeline", engine.Resource().shader("particles_default"));
+	particlesPass = new RenderPipeline("Particles pipeline", engine.Resource().shader("particles_default"_sid));
 
 	// Load debug shader
-	engine.Resource().loadShader("debug", "debug.frag", "debug.vert");
-	debugShader = engine.Resource().shader("debug");
+	engine.Resource().loadShader("debug"_sid, "debug.frag", "debug.vert");
+	debugShader = engine.Resource().shader("debug"_sid);
 
 
 	// Create pipeline for shadow pass
-	//shadowPass = new RenderPipeline("shadow pipeline", engine.Resource().shader("shadows_default"));
+	//shadowPass = new RenderPipeline("shadow pipeline", engine.Resource().shader("shadows_default"_sid));
 
 	// Create frame buffer for shadow map
 	//shadowFBO.CreateFBO_2D(1024, 1024, false);
@@ -101,6 +119,16 @@ RenderSystem::RenderSystem(Engine& _engine)
 	std::vector<int> Ind = { 0,1 };
 	gridVAO = VaoFromPoints(Pnt, Ind);
 
+	// Shared depth atlas for every point light shadow
+	shadowAtlas = new ShadowAtlas();
+
+	// Light binning for the lighting pass
+	lightClusters = new LightClusters();
+
+	// Uniform blocks shared between programs
+	frameBlock = new UniformBuffer();
+	lightBlock = new UniformBuffer();
+
 	// Create debug shape VAO's
 	debugAABB.createVAO();
 	debugGimbal.createVAO();
@@ -125,8 +153,6 @@ void RenderSystem::drawSpriteParticles()
 	// For every particle system in world
 	for (ParticleEmitter* system : engine.getWorld().particles)
 	{
-		system->update(engine);
-
 		RenderComponent* render = system->getComponent<RenderComponent>();
 		TransformComponent* transform = system->getComponent<TransformComponent>();
 
@@ -179,32 +205,19 @@ void RenderSystem::drawSpriteParticles()
 
 
 						// Set model matrix uniform
-						int loc = glGetUniformLocation(mat->getShader()->programId, "ModelTr");
+						int loc = mat->getShader()->getUniformLocation("ModelTr"_sid);
 						glUniformMatrix4fv(loc, 1, GL_FALSE, Pntr(modelMatrix));
 
-						//loc = glGetUniformLocation(mat->getShader()->programId, "hasDiffuseTexture");
+						//loc = mat->getShader()->getUniformLocation("hasDiffuseTexture"_sid);
 						//glUniform1i(loc, mat->hasDiffuseTexture);
 
-						//loc = glGetUniformLocation(mat->getShader()->programId, "hasNormalsTexture");
+						//loc = mat->getShader()->getUniformLocation("hasNormalsTexture"_sid);
 						//glUniform1i(loc, mat->hasNormalsTexture);
 
 						// Set per sprite uniforms
 						SpriteUniforms spriteUnis;
 						spriteUnis.color = p.col;
 
-						// World specific uniforms
-						loc = glGetUniformLocation(mat->getShader()->programId, "WorldProj");
-						glUniformMatrix4fv(loc, 1, GL_FALSE, Pntr(engine.getWorld().worldProj));
-
-						loc = glGetUniformLocation(mat->getShader()->programId, "WorldView");
-						glUniformMatrix4fv(loc, 1, GL_FALSE, Pntr(engine.getWorld().worldView));
-
-						loc = glGetUniformLocation(mat->getShader()->programId, "WorldInverse");
-						glUniformMatrix4fv(loc, 1, GL_FALSE, Pntr(engine.getWorld().worldInverse));
-
-						loc = glGetUniformLocation(mat->getShader()->programId, "time");
-						glUniform1f(loc, engine.getWorld().time);
-
 						geometryPass->setSpriteMaterialUniforms(engine, mat, spriteUnis);
 
 						
@@ -231,14 +244,12 @@ void RenderSystem::drawSpriteParticles()
 	}
 }
 
-void RenderSystem::drawMeshParticlesShadow(ShaderProgram* shader)
+void RenderSystem::drawMeshParticlesShadow(ShaderProgram* shader, const glm::vec3& lightPos, float range)
 {
 	
 	// For every particle system in world
 	for (ParticleEmitter* system : engine.getWorld().particles)
 	{
-		system->update(engine);
-
 		RenderComponent* render = system->getComponent<RenderComponent>();
 		TransformComponent* transform = system->getComponent<TransformComponent>();
 
@@ -253,6 +264,12 @@ void RenderSystem::drawMeshParticlesShadow(ShaderProgram* shader)
 			{
 				unsigned int nSubMeshes = mesh->nMeshes;
 
+				// Make object model matrix
+				glm::mat4 modelMatrix(1.0f);
+				modelMatrix = glm::translate(modelMatrix, p.pos);
+				modelMatrix = glm::rotate(modelMatrix, (transform->angle), transform->rot);
+				modelMatrix = glm::scale(modelMatrix, transform->scl * p.scale * glm::vec3(0.01f, 0.01f, 0.01f));
+
 				// For every sub-mesh in the mesh
 				for (unsigned int i = 0; i < nSubMeshes; i++)
 				{
@@ -264,14 +281,15 @@ void RenderSystem::drawMeshParticlesShadow(ShaderProgram* shader)
 						materialIndex = 0;
 					}
 
-					// Make object model matrix
-					glm::mat4 modelMatrix(1.0f);
-					modelMatrix = glm::translate(modelMatrix, p.pos);
-					modelMatrix = glm::rotate(modelMatrix, (transform->angle), transform->rot);
-					modelMatrix = glm::scale(modelMatrix, transform->scl * p.scale * glm::vec3(0.01f, 0.01f, 0.01f));
+					// Skip particles out of the light's range
+					glm::vec3 boxMin, boxMax;
+					TransformAABB(modelMatrix, mesh->meshData[i].boundsMin, mesh->meshData[i].boundsMax, boxMin, boxMax);
+
+					if (!sphereIntersectsAABB(lightPos, range, boxMin, boxMax))
+						continue;
 
 					// Set model matrix uniform
-					int loc = glGetUniformLocation(shader->programId, "ModelTr");
+					int loc = shader->getUniformLocation("ModelTr"_sid);
 					glUniformMatrix4fv(loc, 1, GL_FALSE, Pntr(modelMatrix));
 
 					
@@ -282,7 +300,7 @@ void RenderSystem::drawMeshParticlesShadow(ShaderProgram* shader)
 					//geometryPass->setMaterialUniforms(engine, mat);
 
 
-					loc = glGetUniformLocation(shader->programId, "diffuse.c");
+					loc = shader->getUniformLocation("diffuse.c"_sid);
 					glUniform4fv(loc, 1, &p.col[0]);
 
 					// Bind the VAO
@@ -319,11 +337,16 @@ void RenderSystem::drawMeshParticles()
 	// For every particle system in world
 	for (ParticleEmitter* system : engine.getWorld().particles)
 	{
-		system->update(engine);
-
 		RenderComponent* render = system->getComponent<RenderComponent>();
 		TransformComponent* transform = system->getComponent<TransformComponent>();
 
+		// Particles are small but numerous, keep their textures whole rather than size each one
+		for (Material* mat : render->materials)
+		{
+			if (mat)
+				engine.Resource().requestTextureDetail(mat);
+		}
+
 		// For every particle in system
 		for (Particle& p : system->particles)
 		{
@@ -353,6 +376,8 @@ void RenderSystem::drawMeshParticles()
 					// Material exists
 					if (mat)
 					{
+						prepareMaterial(engine, mat);
+
 						mat->getShader()->UseShader();
 
 						// Make object model matrix
@@ -362,26 +387,17 @@ void RenderSystem::drawMeshParticles()
 						modelMatrix = glm::scale(modelMatrix, transform->scl * p.scale * glm::vec3(0.01f, 0.01f, 0.01f));
 
 						// Set model matrix uniform
-						int loc = glGetUniformLocation(mat->getShader()->programId, "ModelTr");
+						int loc = mat->getShader()->getUniformLocation("ModelTr"_sid);
 						glUniformMatrix4fv(loc, 1, GL_FALSE, Pntr(modelMatrix));
 
-						loc = glGetUniformLocation(mat->getShader()->programId, "hasDiffuseTexture");
-						glUniform1i(loc, mat->hasDiffuseTexture);
-
-						loc = glGetUniformLocation(mat->getShader()->programId, "hasNormalsTexture");
-						glUniform1i(loc, mat->hasNormalsTexture);
-
-						// Set world specific uniforms
-						geometryPass->setGeometryPassUnis(engine, geoPassUnis);
-
 						// Set material specific uniforms
 						geometryPass->setMaterialUniforms(engine, mat);
 
+						// Particle color replaces the material's diffuse color
+						loc = mat->getShader()->getUniformLocation("hasDiffuseOverride"_sid);
+						glUniform1i(loc, 1);
 
-						
-
-
-						loc = glGetUniformLocation(mat->getShader()->programId, "diffuse.c");
+						loc = mat->getShader()->getUniformLocation("diffuseOverride"_sid);
 						glUniform4fv(loc, 1, &p.col[0]);
 
 						// Bind the VAO
@@ -393,6 +409,9 @@ void RenderSystem::drawMeshParticles()
 						// Un-bind the VAO
 						glBindVertexArray(0);
 
+						loc = mat->getShader()->getUniformLocation("hasDiffuseOverride"_sid);
+						glUniform1i(loc, 0);
+
 						// Done using this materials shader
 						mat->getShader()->UnuseShader();
 					}
@@ -405,6 +424,93 @@ void RenderSystem::drawMeshParticles()
 }
 
 
+// Switch the material to the variant compiled for its textures and upload its block if it changed.
+// Done as it's drawn, materials sitting in the resource cache or never assigned are left alone
+void RenderSystem::prepareMaterial(Engine& engine, Material* mat)
+{
+	// Until the variant finishes compiling the material keeps drawing with its current shader
+	if (mat->needsVariant() && mat->getBaseShader())
+	{
+		StringID baseName = mat->getBaseShader()->getID();
+
+		if (engine.Resource().isShaderVariantReady(baseName, mat->getShaderFeatures()))
+			mat->setVariant(engine.Resource().shaderVariant(baseName, mat->getShaderFeatures()));
+	}
+
+	if (mat->updateUniformBlock())
+		engine.stats.materialUploads++;
+}
+
+
+
+void RenderSystem::cullEntities(Engine& engine)
+{
+	World& world = engine.getWorld();
+
+	Frustum frustum(world.worldProj * world.worldView);
+
+	cullMin.clear();
+	cullMax.clear();
+
+	// Gather every sub-mesh box into one list so they can be tested four at a time
+	for (Entity* e : world.entities)
+	{
+		AABBComponent* aabb = e->getComponent<AABBComponent>();
+
+		if (aabb)
+		{
+			cullMin.insert(cullMin.end(), aabb->subMin.begin(), aabb->subMin.end());
+			cullMax.insert(cullMax.end(), aabb->subMax.begin(), aabb->subMax.end());
+		}
+	}
+
+	cullVisible.resize(cullMin.size());
+	frustum.testAABBs(cullMin.data(), cullMax.data(), static_cast<unsigned int>(cullMin.size()), cullVisible.data());
+
+	engine.stats.subMeshesCulled = 0;
+	engine.stats.entitiesCulled = 0;
+
+	// Hand results back to the components
+	unsigned int index = 0;
+	for (Entity* e : world.entities)
+	{
+		AABBComponent* aabb = e->getComponent<AABBComponent>();
+
+		if (!aabb)
+			continue;
+
+		// No bounds yet, draw it
+		aabb->visible = aabb->subVisible.empty();
+
+		for (unsigned int i = 0; i < aabb->subVisible.size(); i++, index++)
+		{
+			aabb->subVisible[i] = cullVisible[index];
+			aabb->visible |= cullVisible[index] != 0;
+
+			if (!cullVisible[index])
+				engine.stats.subMeshesCulled++;
+		}
+
+		if (!aabb->visible)
+			engine.stats.entitiesCulled++;
+	}
+}
+
+
+// Size on screen in pixels of a box's bounding sphere, 0 once the eye is inside it
+static float projectedSize(const glm::vec3& boxMin, const glm::vec3& boxMax, const glm::vec3& eye, float focal, float screenHeight)
+{
+	glm::vec3 center = (boxMin + boxMax) * 0.5f;
+	float radius = glm::length(boxMax - boxMin) * 0.5f;
+	float dist = glm::length(center - eye);
+
+	if (dist <= radius)
+		return 0.0f;
+
+	return radius * focal * screenHeight / dist;
+}
+
+
 void RenderSystem::doGeometryPass(Engine& engine)
 {
 	glEnable(GL_DEPTH_TEST);
@@ -426,12 +532,17 @@ void RenderSystem::doGeometryPass(Engine& engine)
 			glPolygonOffset(1.0, 1.0);
 			glEnable(GL_POLYGON_OFFSET_FILL);
 
-			// World specific uniforms
-			geoPassUnis.worldView = engine.getWorld().worldView;
-			geoPassUnis.worldProj = engine.getWorld().worldProj;
-			geoPassUnis.worldInverse = engine.getWorld().worldInverse;
+			engine.stats.drawCalls = 0;
+
+			// Only materials that are drawn and changed are uploaded again
+			engine.stats.materialUploads = 0;
+			engine.stats.materialBinds = 0;
+
+			geometryPass->resetMaterialBinding();
+
+			// Projection scale, cot(fovY / 2)
+			float focal = engine.getWorld().worldProj[1][1];
 
-			
 			// For every entity in world
 			for (Entity* e : engine.getWorld().entities)
 			{
@@ -444,9 +555,18 @@ void RenderSystem::doGeometryPass(Engine& engine)
 					if (!transform || !render)
 						continue;
 
+					AABBComponent* aabb = e->getComponent<AABBComponent>();
+
+					// Outside the view frustum
+					if (aabb && !aabb->visible)
+						continue;
+
 					// The render component's mesh
 					Mesh* mesh = render->mesh;
 
+					// Same matrix the culling bounds were made with
+					glm::mat4 modelMatrix = transform->getModelMatrix();
+
 					// Mesh exists
 					if (mesh)
 					{
@@ -455,6 +575,10 @@ void RenderSystem::doGeometryPass(Engine& engine)
 						// For every sub-mesh in the mesh
 						for (unsigned int i = 0; i < nSubMeshes; i++)
 						{
+							// Sub-mesh outside the view frustum
+							if (aabb && i < aabb->subVisible.size() && !aabb->subVisible[i])
+								continue;
+
 							unsigned int materialIndex = mesh->meshData[i].materialIndex;
 
 							// If sub-mesh material index is greater than # of material slots, set it to 
@@ -470,26 +594,20 @@ void RenderSystem::doGeometryPass(Engine& engine)
 							// Material exists
 							if (mat)
 							{
-								mat->getShader()->UseShader();
+								prepareMaterial(engine, mat);
 
-								// Make object model matrix
-								glm::mat4 modelMatrix(1.0f);
-								modelMatrix = glm::translate(modelMatrix, transform->pos);
-								modelMatrix = glm::rotate(modelMatrix, (transform->angle), transform->rot);
-								modelMatrix = glm::scale(modelMatrix, transform->scl * glm::vec3(0.01f, 0.01f, 0.01f));
+								mat->getShader()->UseShader();
 
 								// Set model matrix uniform
-								int loc = glGetUniformLocation(mat->getShader()->programId, "ModelTr");
+								int loc = mat->getShader()->getUniformLocation("ModelTr"_sid);
 								glUniformMatrix4fv(loc, 1, GL_FALSE, Pntr(modelMatrix));
 
-								loc = glGetUniformLocation(mat->getShader()->programId, "hasDiffuseTexture");
-								glUniform1i(loc, mat->hasDiffuseTexture);
-
-								loc = glGetUniformLocation(mat->getShader()->programId, "hasNormalsTexture");
-								glUniform1i(loc, mat->hasNormalsTexture);
+								// Stream in mips to match the sub-mesh's size on screen. Full detail up close
+								float size = 0.0f;
+								if (aabb && i < aabb->subMin.size())
+									size = projectedSize(aabb->subMin[i], aabb->subMax[i], engine.getWorld().eyePos, focal, static_cast<float>(gBuffer->getHeight()));
 
-								// Set world specific uniforms
-								geometryPass->setGeometryPassUnis(engine, geoPassUnis);
+								engine.Resource().requestTextureDetail(mat, size);
 
 								// Set material specific uniforms
 								geometryPass->setMaterialUniforms(engine, mat);
@@ -501,6 +619,8 @@ void RenderSystem::doGeometryPass(Engine& engine)
 								// Draw the mesh
 								glDrawElements(GL_TRIANGLES, mesh->meshData[i].indices.size(), GL_UNSIGNED_INT, 0);
 
+								engine.stats.drawCalls++;
+
 								// Un-bind the VAO
 								glBindVertexArray(0);
 
@@ -574,88 +694,426 @@ void RenderSystem::doPointLightShadowPass(Engine& engine)
 	pointLightPass->shader->UseShader();
 	
 
-	// Render to cubemap for every point light
+	engine.stats.shadowDraws = 0;
+	engine.stats.shadowCastersCulled = 0;
+	engine.stats.staticShadowUpdates = 0;
+
+	// Static casters that moved this frame dirty the caches of lights that covered them before or after
+	for (Entity* e : engine.getWorld().entities)
+	{
+		TransformComponent* transform = e->getComponent<TransformComponent>();
+		AABBComponent* aabb = e->getComponent<AABBComponent>();
+
+		if (!transform || !aabb || !transform->isStatic || !aabb->changed)
+			continue;
+
+		for (PointLight* light : engine.getWorld().pointLights)
+		{
+			TransformComponent* trn = light->getComponent<TransformComponent>();
+			PointLightComponent* plc = light->getComponent<PointLightComponent>();
+
+			if (sphereIntersectsAABB(trn->pos, plc->farPlane, aabb->prevMin, aabb->prevMax) ||
+				sphereIntersectsAABB(trn->pos, plc->farPlane, aabb->center - aabb->dim * 0.5f, aabb->center + aabb->dim * 0.5f))
+			{
+				light->invalidateStaticShadows();
+			}
+		}
+	}
+
+	// Pick which cube faces get drawn this frame
+	scheduleShadowUpdates(engine);
+
+	int maskLoc = pointLightPass->shader->getUniformLocation("faceMask"_sid);
+	glUniform1i(maskLoc, CUBE_FACES_ALL);
+
+	// Matrices and tiles of every light go up in one upload
+	updateLightUniforms(engine);
+
+	// Render the scheduled faces of every point light into its atlas tiles
 	unsigned int nLights = engine.getWorld().pointLights.size();
-	for (int i = 0; i < nLights; i++)
+	for (unsigned int i = 0; i < nLights; i++)
 	{
 		PointLight* light = engine.getWorld().pointLights[i];
 		TransformComponent* trn = light->getComponent<TransformComponent>();
 		PointLightComponent* plc = light->getComponent<PointLightComponent>();
 
+		unsigned int faces = light->scheduledFaces;
 
-		// Setup viewport for rendering to cubemap faces
-		glViewport(0, 0, light->getShadowFBO()->width, light->getShadowFBO()->height);
+		if (faces == 0 || !light->shadowTiles[0].valid())
+			continue;
 
-		// Bind shadowmap FBO
-		light->getShadowFBO()->BindFBO();
+		// This light's entry in the light block
+		lightBlock->bindRange(LIGHT_BLOCK_BINDING, i * lightBlockStride, sizeof(LightUniforms));
 
-		// Clear depth buffer
-		glClear(GL_DEPTH_BUFFER_BIT);
+		// Tiles differ in position per face, so faces are drawn one at a time with their own viewport
+		for (unsigned int f = 0; f < 6; f++)
+		{
+			unsigned int face = 1u << f;
 
-		float aspect = light->getShadowFBO()->width / light->getShadowFBO()->height;
+			if (!(faces & face))
+				continue;
 
-		pointLightUnis.farPlane = plc->farPlane;
-		pointLightUnis.pointLightPos = trn->pos;
+			const ShadowTile& tile = light->shadowTiles[f];
 
-		pointLightUnis.shadowProj = glm::perspective(90.0f, aspect, 1.0f, pointLightUnis.farPlane);
-		pointLightUnis.textureID = light->getShadowFBO()->textureCube->get();
-		
-		pointLightUnis.shadowTransforms.clear();
+			// Redraw the static cache. The scheduler forces every face when this happens
+			if (light->staticDirty)
+			{
+				shadowAtlas->clearStaticTile(tile);
+				shadowAtlas->bindTile(tile, true);
 
-		pointLightUnis.shadowTransforms.push_back(pointLightUnis.shadowProj *
-			glm::lookAt(pointLightUnis.pointLightPos, pointLightUnis.pointLightPos + glm::vec3(1.0, 0.0, 0.0), glm::vec3(0.0, -1.0, 0.0)));
-		pointLightUnis.shadowTransforms.push_back(pointLightUnis.shadowProj *
-			glm::lookAt(pointLightUnis.pointLightPos, pointLightUnis.pointLightPos + glm::vec3(-1.0, 0.0, 0.0), glm::vec3(0.0, -1.0, 0.0)));
-		pointLightUnis.shadowTransforms.push_back(pointLightUnis.shadowProj *
-			glm::lookAt(pointLightUnis.pointLightPos, pointLightUnis.pointLightPos + glm::vec3(0.0, 1.0, 0.0), glm::vec3(0.0, 0.0, 1.0)));
-		pointLightUnis.shadowTransforms.push_back(pointLightUnis.shadowProj *
-			glm::lookAt(pointLightUnis.pointLightPos, pointLightUnis.pointLightPos + glm::vec3(0.0, -1.0, 0.0), glm::vec3(0.0, 0.0, -1.0)));
-		pointLightUnis.shadowTransforms.push_back(pointLightUnis.shadowProj *
-			glm::lookAt(pointLightUnis.pointLightPos, pointLightUnis.pointLightPos + glm::vec3(0.0, 0.0, 1.0), glm::vec3(0.0, -1.0, 0.0)));
-		pointLightUnis.shadowTransforms.push_back(pointLightUnis.shadowProj *
-			glm::lookAt(pointLightUnis.pointLightPos, pointLightUnis.pointLightPos + glm::vec3(0.0, 0.0, -1.0), glm::vec3(0.0, -1.0, 0.0)));
+				drawShadowCasters(engine, trn->pos, plc->farPlane, true, face);
+			}
 
+			// Start the face from the static casters
+			shadowAtlas->copyStaticTile(tile);
 
+			// Draw dynamic casters on top
+			if (light->hasDynamicCasters)
+			{
+				shadowAtlas->bindTile(tile, false);
 
-		// Set per pass/per light shader uniforms
-		pointLightPass->setPointShadowPassUnis(engine, pointLightUnis);
+				drawShadowCasters(engine, trn->pos, plc->farPlane, false, face);
 
+				glUniform1i(maskLoc, static_cast<int>(face));
+				drawMeshParticlesShadow(pointLightPass->shader, trn->pos, plc->farPlane);
+			}
 
-		// Draw all objects
-		for (Entity* e : engine.getWorld().entities)
+			light->faceAge[f] = 0;
+		}
+
+		glUniform1i(maskLoc, CUBE_FACES_ALL);
+
+		if (light->staticDirty)
 		{
-			if (e)
+			light->staticDirty = false;
+			light->cachedPos = trn->pos;
+			light->cachedFarPlane = plc->farPlane;
+
+			engine.stats.staticShadowUpdates++;
+		}
+
+		// Drawn faces are current again
+		light->pendingFaces &= ~faces;
+		light->forcedFaces = 0;
+	}
+
+	pointLightPass->shader->UnuseShader();
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+
+// Fill the light block with every point light's shadow matrices and atlas layers.
+// Entries are spaced by the range alignment so each light can be bound on its own.
+void RenderSystem::updateLightUniforms(Engine& engine)
+{
+	std::vector<PointLight*>& lights = engine.getWorld().pointLights;
+
+	size_t alignment = UniformBuffer::getOffsetAlignment();
+	lightBlockStride = (sizeof(LightUniforms) + alignment - 1) / alignment * alignment;
+
+	lightBlockData.assign(lights.size() * lightBlockStride, 0);
+
+	for (unsigned int i = 0; i < lights.size(); i++)
+	{
+		TransformComponent* trn = lights[i]->getComponent<TransformComponent>();
+		PointLightComponent* plc = lights[i]->getComponent<PointLightComponent>();
+
+		LightUniforms unis;
+		unis.lightPos = trn->pos;
+		unis.farPlane = plc->farPlane;
+
+		glm::mat4 shadowProj = glm::perspective(glm::radians(90.0f), 1.0f, 1.0f, plc->farPlane);
+		glm::vec3 pos = trn->pos;
+
+		unis.shadowMatrices[0] = shadowProj * glm::lookAt(pos, pos + glm::vec3(1.0, 0.0, 0.0), glm::vec3(0.0, -1.0, 0.0));
+		unis.shadowMatrices[1] = shadowProj * glm::lookAt(pos, pos + glm::vec3(-1.0, 0.0, 0.0), glm::vec3(0.0, -1.0, 0.0));
+		unis.shadowMatrices[2] = shadowProj * glm::lookAt(pos, pos + glm::vec3(0.0, 1.0, 0.0), glm::vec3(0.0, 0.0, 1.0));
+		unis.shadowMatrices[3] = shadowProj * glm::lookAt(pos, pos + glm::vec3(0.0, -1.0, 0.0), glm::vec3(0.0, 0.0, -1.0));
+		unis.shadowMatrices[4] = shadowProj * glm::lookAt(pos, pos + glm::vec3(0.0, 0.0, 1.0), glm::vec3(0.0, -1.0, 0.0));
+		unis.shadowMatrices[5] = shadowProj * glm::lookAt(pos, pos + glm::vec3(0.0, 0.0, -1.0), glm::vec3(0.0, -1.0, 0.0));
+
+		for (unsigned int f = 0; f < 6; f++)
+			unis.faceLayer[f] = glm::ivec4(lights[i]->shadowTiles[f].layer, 0, 0, 0);
+
+		memcpy(&lightBlockData[i * lightBlockStride], &unis, sizeof(LightUniforms));
+	}
+
+	if (!lightBlockData.empty())
+		lightBlock->upload(lightBlockData.data(), lightBlockData.size());
+}
+
+
+// Rank lights, give them atlas tiles and spend the face budget. Forced faces are always drawn
+// and count against the budget, what is left goes round-robin over out of date faces in priority order.
+void RenderSystem::scheduleShadowUpdates(Engine& engine)
+{
+	World& world = engine.getWorld();
+
+	Frustum frustum(world.worldProj * world.worldView);
+
+	// Projection scale, cot(fovY / 2)
+	float focal = world.worldProj[1][1];
+
+	shadowQueue.clear();
+
+	for (PointLight* light : world.pointLights)
+	{
+		TransformComponent* trn = light->getComponent<TransformComponent>();
+		PointLightComponent* plc = light->getComponent<PointLightComponent>();
+
+		// Projected size of the light's range on screen, full screen once the eye is inside it
+		glm::vec3 toLight = trn->pos - world.eyePos;
+		float dist = glm::length(toLight);
+		float radius = plc->farPlane;
+
+		float influence = 1.0f;
+		if (dist > radius)
+			influence = glm::min(radius * focal / glm::sqrt(dist * dist - radius * radius), 1.0f);
+
+		// Range doesn't reach anything on screen
+		if (!frustum.testAABB(trn->pos - glm::vec3(radius), trn->pos + glm::vec3(radius)))
+			influence = 0.0f;
+
+		light->shadowPriority = influence / (1.0f + dist / SHADOW_PRIORITY_DISTANCE);
+
+		// Tile size from screen coverage. Shrinking waits for a 4x drop so lights near a size boundary don't repack every frame
+		int maxTile = glm::min(plc->resolution.x, SHADOW_TILE_MAX);
+		int request = SHADOW_TILE_MIN;
+
+		while (request < maxTile && request < influence * SHADOW_TILE_MAX)
+			request *= 2;
+
+		if (request < light->shadowTileRequest && request * 4 > light->shadowTileRequest)
+			request = light->shadowTileRequest;
+
+		// Off screen lights give their tiles up to the ones that are visible
+		light->shadowTileRequest = (plc->disableShadows || influence == 0.0f) ? 0 : request;
+
+		shadowQueue.push_back(light);
+	}
+
+	// Most important lights get first pick of the atlas
+	std::sort(shadowQueue.begin(), shadowQueue.end(), [](PointLight* a, PointLight* b)
+	{
+		return a->shadowPriority > b->shadowPriority;
+	});
+
+	shadowAtlas->allocate(shadowQueue);
+
+	int budget = engine.debug.shadowFaceBudget;
+
+	engine.stats.shadowFacesForced = 0;
+
+	shadowQueue.clear();
+
+	for (PointLight* light : world.pointLights)
+	{
+		TransformComponent* trn = light->getComponent<TransformComponent>();
+		PointLightComponent* plc = light->getComponent<PointLightComponent>();
+
+		for (unsigned int f = 0; f < 6; f++)
+			light->faceAge[f]++;
+
+		light->scheduledFaces = 0;
+
+		// No room in the atlas
+		if (!light->shadowTiles[0].valid())
+			continue;
+
+		// Light moved or changed range, everything it sees is different
+		if (trn->pos != light->cachedPos || plc->farPlane != light->cachedFarPlane)
+			light->invalidateStaticShadows();
+
+		// A new static cache has to reach every face
+		if (light->staticDirty)
+			light->forcedFaces = CUBE_FACES_ALL;
+
+		// Dynamic casters may change every frame. Once they leave, each face still needs one redraw to clear them
+		bool hadDynamic = light->hasDynamicCasters;
+		light->hasDynamicCasters = findDynamicShadowCasters(engine, light);
+
+		if (light->hasDynamicCasters || hadDynamic)
+			light->pendingFaces = CUBE_FACES_ALL;
+
+		light->pendingFaces |= light->forcedFaces;
+		light->scheduledFaces = light->forcedFaces;
+
+		unsigned int nForced = 0;
+		for (unsigned int f = 0; f < 6; f++)
+			nForced += (light->forcedFaces >> f) & 1u;
+
+		budget -= static_cast<int>(nForced);
+		engine.stats.shadowFacesForced += nForced;
+
+		if (light->pendingFaces & ~light->scheduledFaces)
+			shadowQueue.push_back(light);
+	}
+
+	// Lights that have waited longer move up so low priority lights still get updated
+	std::sort(shadowQueue.begin(), shadowQueue.end(), [](PointLight* a, PointLight* b)
+	{
+		return a->shadowPriority * (1.0f + a->getShadowStaleness()) > b->shadowPriority * (1.0f + b->getShadowStaleness());
+	});
+
+	// One face per light per round until the budget runs out
+	bool progress = true;
+	while (budget > 0 && progress)
+	{
+		progress = false;
+
+		for (PointLight* light : shadowQueue)
+		{
+			if (budget <= 0)
+				break;
+
+			unsigned int open = light->pendingFaces & ~light->scheduledFaces;
+
+			for (unsigned int k = 0; k < 6 && open; k++)
 			{
-				RenderComponent* render = e->getComponent<RenderComponent>();
-				TransformComponent* transform = e->getComponent<TransformComponent>();
+				unsigned int f = (light->nextFace + k) % 6;
 
-				if (render)
+				if (open & (1u << f))
 				{
-					// Make object transform
-					glm::mat4 modelMatrix(1.0f);
-					modelMatrix = glm::translate(modelMatrix, transform->pos);
-					modelMatrix = glm::rotate(modelMatrix, (transform->angle), transform->rot);
-					modelMatrix = glm::scale(modelMatrix, transform->scl * glm::vec3(0.01f, 0.01f, 0.01f));
+					light->scheduledFaces |= 1u << f;
+					light->nextFace = (f + 1) % 6;
 
-					// Set object transform uniform
-					int loc = glGetUniformLocation(pointLightPass->shader->programId, "ModelTr");
-					glUniformMatrix4fv(loc, 1, GL_FALSE, Pntr(modelMatrix));
+					budget--;
+					progress = true;
+					break;
+				}
+			}
+		}
+	}
 
-					// Render mesh
-					pointLightPass->draw(render);
+	engine.stats.shadowFacesUpdated = 0;
+	for (PointLight* light : world.pointLights)
+	{
+		for (unsigned int f = 0; f < 6; f++)
+			engine.stats.shadowFacesUpdated += (light->scheduledFaces >> f) & 1u;
+	}
+
+	engine.stats.shadowAtlasOccupancy = shadowAtlas->getOccupancy();
+	engine.stats.shadowAtlasBytes = shadowAtlas->getMemoryBytes();
+}
+
+
+void RenderSystem::drawShadowCasters(Engine& engine, const glm::vec3& lightPos, float range, bool staticCasters, unsigned int faces)
+{
+	int maskLoc = pointLightPass->shader->getUniformLocation("faceMask"_sid);
+	int modelLoc = pointLightPass->shader->getUniformLocation("ModelTr"_sid);
+
+	// Draw casters in range of the light
+	for (Entity* e : engine.getWorld().entities)
+	{
+		if (e)
+		{
+			RenderComponent* render = e->getComponent<RenderComponent>();
+			TransformComponent* transform = e->getComponent<TransformComponent>();
+			AABBComponent* aabb = e->getComponent<AABBComponent>();
+
+			if (!render || !transform || !render->mesh)
+				continue;
+
+			// Only the requested set of casters
+			if (transform->isStatic != staticCasters)
+				continue;
+
+			// Whole entity out of range
+			if (aabb && !aabb->subMin.empty() &&
+				!sphereIntersectsAABB(lightPos, range, aabb->center - aabb->dim * 0.5f, aabb->center + aabb->dim * 0.5f))
+			{
+				engine.stats.shadowCastersCulled++;
+				continue;
+			}
+
+			// Set object transform uniform
+			glm::mat4 modelMatrix = transform->getModelMatrix();
+			glUniformMatrix4fv(modelLoc, 1, GL_FALSE, Pntr(modelMatrix));
+
+			Mesh* mesh = render->mesh;
+
+			for (unsigned int j = 0; j < mesh->nMeshes; j++)
+			{
+				unsigned int faceMask = faces;
+
+				// No bounds (e.g. sky), draw to every face
+				if (aabb && j < aabb->subMin.size())
+				{
+					if (!sphereIntersectsAABB(lightPos, range, aabb->subMin[j], aabb->subMax[j]))
+						continue;
+
+					faceMask &= cubeFaceMask(aabb->subMin[j] - lightPos, aabb->subMax[j] - lightPos);
 				}
+
+				if (faceMask == 0)
+					continue;
+
+				glUniform1i(maskLoc, static_cast<int>(faceMask));
+
+				glBindVertexArray(mesh->meshData[j].VAO);
+				glDrawElements(GL_TRIANGLES, mesh->meshData[j].indices.size(), GL_UNSIGNED_INT, 0);
+
+				engine.stats.shadowDraws++;
 			}
 		}
+	}
 
-		
+	glBindVertexArray(0);
+
+	glUniform1i(maskLoc, CUBE_FACES_ALL);
+}
+
+
+// Also forces the faces touched by dynamic casters that moved this frame
+bool RenderSystem::findDynamicShadowCasters(Engine& engine, PointLight* light)
+{
+	glm::vec3 lightPos = light->getComponent<TransformComponent>()->pos;
+	float range = light->getComponent<PointLightComponent>()->farPlane;
+
+	bool found = false;
+
+	for (Entity* e : engine.getWorld().entities)
+	{
+		RenderComponent* render = e->getComponent<RenderComponent>();
+		TransformComponent* transform = e->getComponent<TransformComponent>();
+		AABBComponent* aabb = e->getComponent<AABBComponent>();
+
+		if (!render || !transform || !render->mesh || transform->isStatic)
+			continue;
+
+		// No bounds to test, assume it's in range
+		if (!aabb || aabb->subMin.empty())
+		{
+			found = true;
+			continue;
+		}
 
-		drawMeshParticlesShadow(pointLightPass->shader);
+		glm::vec3 boxMin = aabb->center - aabb->dim * 0.5f;
+		glm::vec3 boxMax = aabb->center + aabb->dim * 0.5f;
 
-		light->getShadowFBO()->UnbindFBO();
+		bool inRange = sphereIntersectsAABB(lightPos, range, boxMin, boxMax);
+
+		found = found || inRange;
+
+		if (!aabb->changed)
+			continue;
+
+		// Both where the caster was and where it is now need redrawing
+		if (inRange)
+			light->forcedFaces |= cubeFaceMask(boxMin - lightPos, boxMax - lightPos);
+
+		if (sphereIntersectsAABB(lightPos, range, aabb->prevMin, aabb->prevMax))
+			light->forcedFaces |= cubeFaceMask(aabb->prevMin - lightPos, aabb->prevMax - lightPos);
 	}
 
-	pointLightPass->shader->UnuseShader();
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	// Particles count as dynamic but move every frame, so they only update with the budget
+	for (ParticleEmitter* system : engine.getWorld().particles)
+	{
+		if (!system->particles.empty())
+			found = true;
+	}
+
+	return found;
 }
 
 
@@ -685,6 +1143,19 @@ void RenderSystem::doLightingPass(Engine& engine)
 
 			lightingPass->shader->UseShader();
 
+			// Bin lights for this view
+			lightClusters->update(engine);
+
+			engine.stats.clusterLightRefs = lightClusters->numReferences();
+			engine.stats.maxClusterLights = lightClusters->maxClusterLights();
+
+			lightingPass2Unis.shadowAtlas = shadowAtlas->getTexture();
+			lightingPass2Unis.shadowAtlasSize = shadowAtlas->getSize();
+
+			lightingPass2Unis.lightData = lightClusters->getLightData();
+			lightingPass2Unis.clusterGrid = lightClusters->getClusterGrid();
+			lightingPass2Unis.lightIndices = lightClusters->getLightIndices();
+
 			// Set lighting uniforms
 			lightingPass->setLightingPassUnis(engine, gBuffer, lightingPass2Unis);
 
@@ -738,10 +1209,10 @@ void RenderSystem::doPostProcessPass(Engine& engine)
 			
 			glActiveTexture(GL_TEXTURE0);
 			glBindTexture(GL_TEXTURE_2D, sceneColorFBO->getTextures()[0].texture->get());
-			int loc = glGetUniformLocation(postProcessPass->shader->programId, "sceneColor");
+			int loc = postProcessPass->shader->getUniformLocation("sceneColor"_sid);
 			glUniform1i(loc, 0);
 
-			loc = glGetUniformLocation(postProcessPass->shader->programId, "time");
+			loc = postProcessPass->shader->getUniformLocation("time"_sid);
 			glUniform1f(loc, engine.getWorld().time);
 
 
@@ -784,13 +1255,13 @@ void RenderSystem::doDebugPass(Engine& engine)
 
 		debugShader->UseShader();
 
-		int loc = glGetUniformLocation(debugShader->programId, "WorldProj");
+		int loc = debugShader->getUniformLocation("WorldProj"_sid);
 		glUniformMatrix4fv(loc, 1, GL_FALSE, Pntr(engine.getWorld().worldProj));
 
-		loc = glGetUniformLocation(debugShader->programId, "WorldView");
+		loc = debugShader->getUniformLocation("WorldView"_sid);
 		glUniformMatrix4fv(loc, 1, GL_FALSE, Pntr(engine.getWorld().worldView));
 
-		loc = glGetUniformLocation(debugShader->programId, "WorldInverse");
+		loc = debugShader->getUniformLocation("WorldInverse"_sid);
 		glUniformMatrix4fv(loc, 1, GL_FALSE, Pntr(engine.getWorld().worldInverse));
 
 		
@@ -806,7 +1277,7 @@ void RenderSystem::doDebugPass(Engine& engine)
 			ModelTr = glm::rotate(ModelTr, transform->angle, transform->rot);
 			ModelTr = glm::scale(ModelTr, transform->scl);
 
-			loc = glGetUniformLocation(debugShader->programId, "ModelTr");
+			loc = debugShader->getUniformLocation("ModelTr"_sid);
 			glUniformMatrix4fv(loc, 1, GL_FALSE, Pntr(ModelTr));
 
 			if (engine.onSelect)
@@ -822,9 +1293,8 @@ void RenderSystem::doDebugPass(Engine& engine)
 			debugGimbal.draw(engine.selectedEntity, debugShader);
 
 			/*
-			glm::vec3 rayDir = getRayDirection(engine.getPlatform().width, engine.getPlatform().height, 
-				engine.getPlatform().mouseX,engine.getPlatform().mouseY, engine.getWorld().worldView, 
-				engine.getWorld().worldProj);
+			glm::vec3 rayDir = engine.getWorld().screenPointToRay(engine.getPlatform().mouseX, 
+				engine.getPlatform().mouseY).direction;
 
 			glm::vec3 from = engine.getWorld().eyePos + glm::vec3(1.0f, 0.0f, 0.0f);
 			//glm::vec3 to = from - rayDir * 90.0f;
@@ -871,54 +1341,89 @@ void RenderSystem::update(Engine& engine)
 	
 
 
+	// Collect G-buffer reads that finished since last frame
+	gBuffer->updateReadbacks();
+
+	// Simulate particles once, every pass draws the same state
+	for (ParticleEmitter* system : engine.getWorld().particles)
+		system->update(engine);
+
+	// Camera and world values shared by every pass
+	updateFrameUniforms(engine);
+
 	// Render scene from point light perspective
 	doPointLightShadowPass(engine);
 
+	// Skip entities outside the camera
+	cullEntities(engine);
+
 	// Render geometry into G_Buffer
 	doGeometryPass(engine);
 
+	// Terrain brush position comes from the G-buffer
+	if (engine.mode == EngineMode::TERRAIN)
+		readMouseWorldPosition(engine);
+
 	// Render deferred lighting
 	doLightingPass(engine);
 
 
-	/*
-	if (engine.mode == EngineMode::TERRAIN)
-	{
-		Platform& platform = engine.getPlatform();
-
-		int u = static_cast<int>(platform.mouseX);
-		int v = static_cast<int>(platform.mouseY);
-
-		int width = static_cast<int>(platform.width);
-		int height = static_cast<int>(platform.height);
+	// Apply post processing
+	doPostProcessPass(engine);
 
-		//GLubyte* pixels = new GLubyte[4 * width * height];
+	// Draw debug lines
+	doDebugPass(engine); 
 
-		GLubyte pixel[4];
 
-		// Read positions
-		glReadBuffer(GL_COLOR_ATTACHMENT0);
 
-		glReadPixels(u, v, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, pixel);
+	
+}
 
-		glm::vec3 mousePos = { pixel[0], pixel[1], pixel[2] };
+// Camera and world state every program reads from FrameBlock
+void RenderSystem::updateFrameUniforms(Engine& engine)
+{
+	World& world = engine.getWorld();
+
+	FrameUniforms unis;
+	unis.worldView = world.worldView;
+	unis.worldProj = world.worldProj;
+	unis.worldInverse = world.worldInverse;
+	unis.viewPos = world.eyePos;
+	unis.time = world.time;
+	unis.ambientColor = world.ambientColor;
+	unis.mode = engine.mode == EngineMode::TERRAIN ? 1 : 0;
+	unis.sunPos = world.lightPos;
+	unis.basicShading = engine.debug.basicShading;
+	unis.mouseWorld = world.mouseWorldPos;
+	unis.pad0 = 0.0f;
+
+	frameBlock->upload(&unis, sizeof(FrameUniforms));
+	frameBlock->bind(FRAME_BLOCK_BINDING);
+}
 
-		engine.getWorld().mouseWorldPos = mousePos;
 
-		//std::cout << "x: " << mousePos.x << "\ny: " << mousePos.y << "\n:z: " << mousePos.z << "\n\n";
+void RenderSystem::readMouseWorldPosition(Engine& engine)
+{
+	Platform& platform = engine.getPlatform();
 
-	}
-	*/
+	// Window y goes down, G-buffer rows go up
+	int u = static_cast<int>(platform.mouseX);
+	int v = static_cast<int>(gBuffer->getHeight()) - 1 - static_cast<int>(platform.mouseY);
 
-	// Apply post processing
-	doPostProcessPass(engine);
-
-	// Draw debug lines
-	doDebugPass(engine); 
+	// Copy is queued now and picked up a frame or two later
+	gBuffer->requestPixel(BufferType::POSITION, u, v);
 
+	ReadbackResult result;
+	if (gBuffer->getReadResult(BufferType::POSITION, result))
+	{
+		glm::vec4 position = result.texel(0, 0);
 
+		// Alpha holds depth, zero where nothing was drawn
+		if (position.w > 0.0f)
+			engine.getWorld().mouseWorldPos = glm::vec3(position);
+	}
 
-	
+	engine.debug.readbackLatency = gBuffer->getReadbackLatency();
 }
 
 void RenderSystem::drawTriangleAABB()
@@ -939,11 +1444,11 @@ void RenderSystem::drawTriangleAABB()
 			glm::vec3 color = { 1.0f, 0.0f, 0.0f };
 
 			// Set lines color for fragment shader
-			int loc = glGetUniformLocation(debugShader->programId, "diffuse");
+			int loc = debugShader->getUniformLocation("diffuse"_sid);
 			glUniform3fv(loc, 1, &color[0]);
 
 			// Set transformation for vertex shader
-			loc = glGetUniformLocation(debugShader->programId, "ModelTr");
+			loc = debugShader->getUniformLocation("ModelTr"_sid);
 			glUniformMatrix4fv(loc, 1, GL_FALSE, Pntr(transform));
 
 			if (i == (int)engine.debug.float2)
@@ -993,11 +1498,11 @@ void RenderSystem::drawTreeLeaves(TreeNode* node, int level)
 			glm::mat4 transform = Translate(minP) * Scale(maxP - minP);
 
 			// Set lines color for fragment shader
-			int loc = glGetUniformLocation(debugShader->programId, "diffuse");
+			int loc = debugShader->getUniformLocation("diffuse"_sid);
 			glUniform3fv(loc, 1, &color[0]);
 
 			// Set transformation for vertex shader
-			loc = glGetUniformLocation(debugShader->programId, "ModelTr");
+			loc = debugShader->getUniformLocation("ModelTr"_sid);
 			glUniformMatrix4fv(loc, 1, GL_FALSE, Pntr(transform));
 
 
@@ -1049,11 +1554,11 @@ void RenderSystem::drawTreeRec(TreeNode* node, int level, int maxLevel)
 		glm::mat4 transform = Translate(minP) * Scale(maxP - minP);
 
 		// Set lines color for fragment shader
-		int loc = glGetUniformLocation(debugShader->programId, "diffuse");
+		int loc = debugShader->getUniformLocation("diffuse"_sid);
 		glUniform3fv(loc, 1, &color[0]);
 
 		// Set transformation for vertex shader
-		loc = glGetUniformLocation(debugShader->programId, "ModelTr");
+		loc = debugShader->getUniformLocation("ModelTr"_sid);
 		glUniformMatrix4fv(loc, 1, GL_FALSE, Pntr(transform));
 
 
@@ -1100,6 +1605,30 @@ RenderSystem::~RenderSystem()
 		delete pointLightPass;
 		pointLightPass = nullptr;
 	}
+
+	if (shadowAtlas)
+	{
+		delete shadowAtlas;
+		shadowAtlas = nullptr;
+	}
+
+	if (frameBlock)
+	{
+		delete frameBlock;
+		frameBlock = nullptr;
+	}
+
+	if (lightBlock)
+	{
+		delete lightBlock;
+		lightBlock = nullptr;
+	}
+
+	if (lightClusters)
+	{
+		delete lightClusters;
+		lightClusters = nullptr;
+	}
 }
 
 
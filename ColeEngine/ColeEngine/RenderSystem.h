@@ -12,6 +12,10 @@
 #include "DebugDrawing.h"
 #include "GBuffer.h"
 #include "FrameBuffer.h"
+#include "Frustum.h"
+#include "ShadowAtlas.h"
+#include "LightClusters.h"
+#include "UniformBuffer.h"
 
 #define GLM_FORCE_RADIANS
 #define GLM_SWIZZLE
@@ -19,6 +23,9 @@
 
 #define GRIDLINE_LENGTH 99999.0f
 
+// Distance from the eye at which a light's shadow priority is halved
+#define SHADOW_PRIORITY_DISTANCE 100.0f
+
 
 
 
@@ -31,13 +38,26 @@ public:
 	
 private:
 
+	void cullEntities(Engine& engine);
+
+	// Variant and uniform block updates for a material about to be drawn
+	void prepareMaterial(Engine& engine, Material* mat);
 	void doGeometryPass(Engine& engine);
 	void doLightingPass(Engine& engine);
 	void doPointLightShadowPass(Engine& engine);
 	void doPostProcessPass(Engine& engine);
 	void doDebugPass(Engine& engine);
+
+	void readMouseWorldPosition(Engine& engine);
+
+	void updateFrameUniforms(Engine& engine);
+	void updateLightUniforms(Engine& engine);
 	
-	void drawMeshParticlesShadow(ShaderProgram* shader);
+	void scheduleShadowUpdates(Engine& engine);
+	void drawShadowCasters(Engine& engine, const glm::vec3& lightPos, float range, bool staticCasters, unsigned int faces);
+	bool findDynamicShadowCasters(Engine& engine, PointLight* light);
+
+	void drawMeshParticlesShadow(ShaderProgram* shader, const glm::vec3& lightPos, float range);
 	void drawMeshParticles();
 	void drawSpriteParticles();
 
@@ -75,12 +95,31 @@ private:
 	//glm::mat4 shadowMatrix; // Transform for directional light
 
 	// Stores uniforms
-	GeometryPassUniforms geoPassUnis;
 	LightingPassUniforms lightingPass2Unis;
 
 	LightingPassUniforms lightingPassUnis;
 	ShadowPassUniforms shadowPassUnis;
-	PointLightShadowPassUniforms pointLightUnis;
+
+	// Per frame values, one block for every program
+	UniformBuffer* frameBlock;
+
+	// One LightBlock entry per point light, bound by range while drawing its shadows
+	UniformBuffer* lightBlock;
+	std::vector<unsigned char> lightBlockData;
+	size_t lightBlockStride = 0;
+
+	// Lights ordered by shadow priority, rebuilt every frame
+	std::vector<PointLight*> shadowQueue;
+
+	// Point light shadow maps for every light
+	ShadowAtlas* shadowAtlas;
+
+	// Point lights binned per froxel for the lighting pass
+	LightClusters* lightClusters;
+
+	// Sub-mesh bounds gathered for culling, reused every frame
+	std::vector<glm::vec3> cullMin, cullMax;
+	std::vector<unsigned char> cullVisible;
 
 	// Debug objects
 	DebugAABB debugAABB;
@@ -0,0 +1,26 @@
+#include "Resource.h"
+#include "ResourceManager.h"
+
+
+void Resource::addRef()
+{
+    // Back in use, out of the cache
+    if (refs++ == 0 && owner)
+        owner->referenced(this);
+}
+
+
+void Resource::release()
+{
+    // May delete this
+    if (--refs == 0 && owner)
+        owner->released(this);
+}
+
+
+void Resource::resized()
+{
+    // Only cached resources count towards the cache size
+    if (cached && owner)
+        owner->resized(this);
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#ifndef _RESOURCE
+#define _RESOURCE
+
+#include <list>
+
+#include "StringID.h"
+
+class ResourceManager;
+
+enum class ResourceType
+{
+	MESH,
+	TEXTURE,
+	MATERIAL
+};
+
+
+// Something ResourceManager can free, counted by the Handles pointing at it.
+// When the last handle to a resource the manager owns goes away the resource is kept in the manager's
+// cache, and freed least recently released first once the cache is over its memory cap. Resources
+// made outside the manager are counted the same way but are never freed by it
+class Resource
+{
+public:
+	Resource(ResourceType _type) : type(_type) {}
+	virtual ~Resource() {}
+
+	// A copy is a new resource, it isn't owned or referenced yet
+	Resource(const Resource& other) : type(other.type) {}
+	Resource& operator=(const Resource&) { return *this; }
+
+	// Called by Handle. The manager hears when the count leaves or reaches zero
+	void addRef();
+	void release();
+
+	// Called when the memory behind it changes, e.g. the streamer dropped texture mips, so the cache stays sized right
+	void resized();
+
+	unsigned int getRefs() const { return refs; }
+
+	ResourceType getResourceType() const { return type; }
+
+private:
+	friend class ResourceManager;
+
+	ResourceType type;
+	unsigned int refs = 0;
+
+	// Set once the manager owns it
+	ResourceManager* owner = nullptr;
+	StringID key; // Name in the manager's map for this type
+
+	// Place in the manager's cache while nothing references it
+	std::list<Resource*>::iterator cacheEntry;
+	bool cached = false;
+	unsigned long long cachedBytes = 0;
+};
+
+
+// Counted reference to a resource. Converts to and from T* so it can replace a raw pointer member
+template <typename T>
+class Handle
+{
+public:
+	Handle() : ptr(nullptr) {}
+	Handle(T* _ptr) : ptr(_ptr) { if (ptr) ptr->addRef(); }
+	Handle(const Handle& other) : ptr(other.ptr) { if (ptr) ptr->addRef(); }
+	Handle(Handle&& other) : ptr(other.ptr) { other.ptr = nullptr; }
+	~Handle() { reset(nullptr); }
+
+	Handle& operator=(const Handle& other) { reset(other.ptr); return *this; }
+	Handle& operator=(T* _ptr) { reset(_ptr); return *this; }
+
+	Handle& operator=(Handle&& other)
+	{
+		if (this != &other)
+		{
+			reset(nullptr);
+			ptr = other.ptr;
+			other.ptr = nullptr;
+		}
+
+		return *this;
+	}
+
+	// Takes the new reference before dropping the old one, releasing may free other resources
+	void reset(T* _ptr)
+	{
+		if (_ptr)
+			_ptr->addRef();
+
+		T* old = ptr;
+		ptr = _ptr;
+
+		if (old)
+			old->release();
+	}
+
+	T* get() const { return ptr; }
+	T* operator->() const { return ptr; }
+	operator T*() const { return ptr; }
+
+private:
+	T* ptr;
+};
+
+#endif
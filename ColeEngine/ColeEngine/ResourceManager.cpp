@@ -1,14 +1,30 @@
 #include<iostream>
+#include<algorithm>
+#include<cmath>
 
 #include "ResourceManager.h"
 #include "Material.h"
 #include "Logging.h"
+#include "ShaderCache.h"
+#include "Mesh.h"
+#include "ThreadPool.h"
 
 
 ResourceManager::ResourceManager()
-    :textures(0), shaders(0), nullTexture(nullptr), skyTexture(nullptr)
+    :shaders(0), textures(0), cacheBytes(0), cacheCapacity(RESOURCE_CACHE_BYTES), trimming(false), skyTexture(nullptr), nullTexture(nullptr)
 {
     nullTexture = new Texture(16, 16, 4, GL_LINEAR);
+
+    // Let the driver compile shaders on as many threads as it likes
+    if (GLEW_KHR_parallel_shader_compile)
+        glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+    else if (GLEW_ARB_parallel_shader_compile)
+        glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+
+    if (manifest.load(std::string(COOKED_DIR) + "/" + ASSET_MANIFEST_FILE))
+        Log::info("Loaded asset manifest, " + std::to_string(manifest.size()) + " cooked assets");
+    else
+        Log::info("No cooked assets, loading sources. Run colecook to cook them");
 }
 
 Texture* ResourceManager::getNullTexture()
@@ -24,40 +40,151 @@ Texture* ResourceManager::getNullTexture()
     }
 }
 
-void ResourceManager::loadShader(std::string name, std::string fragSrc, std::string vertSrc)
+void ResourceManager::loadShader(StringID name, std::string fragSrc, std::string vertSrc)
+{
+    loadShader(name, fragSrc, vertSrc, "");
+}
+
+// Create a new shader and add to resource manager
+void ResourceManager::loadShader(StringID name, std::string fragSrc, std::string vertSrc, std::string geomSrc)
 {
-    ShaderProgram* shader = new ShaderProgram(name);
+    ShaderFiles files;
+    files.frag = fragSrc;
+    files.vert = vertSrc;
+    files.geom = geomSrc;
+
+    ShaderProgram* shader = compileShader(name, files, 0);
 
     if (shader)
     {
-        shader->AddShader(vertSrc, GL_VERTEX_SHADER);
-        shader->AddShader(fragSrc, GL_FRAGMENT_SHADER);
+        shaders[name] = shader; // Add new shader to list of shaders in resource manager
 
-        shader->LinkProgram();
+        shaderFiles[name] = files;
+        shaderVariants[name][0] = shader;
+    }
 
-        shaders[name] = shader; // Add new shader to list of shaders in resource manager
+}
 
+
+ShaderProgram* ResourceManager::shaderVariant(StringID name, unsigned int features)
+{
+    auto files = shaderFiles.find(name);
+
+    if (files == shaderFiles.end())
+    {
+        Log::warning("Unable to find shader: " + name.str() + " for a variant");
+        return nullptr;
+    }
+
+    ShaderProgram*& variant = shaderVariants[name][features];
+
+    // First use of this feature set
+    if (!variant)
+    {
+        variant = compileShader(name, files->second, features);
+
+        Log::msg("Compiling variant " + std::to_string(features) + " of shader " + name.str());
     }
+
+    return variant;
 }
 
-// Create a new shader and add to resource manager
-void ResourceManager::loadShader(std::string name, std::string fragSrc, std::string vertSrc, std::string geomSrc)
+
+bool ResourceManager::isShaderVariantReady(StringID name, unsigned int features)
+{
+    // Nothing to wait for, shaderVariant reports the missing shader. Loaded shaders always have variant 0
+    auto variants = shaderVariants.find(name);
+
+    if (variants == shaderVariants.end())
+        return true;
+
+    auto found = variants->second.find(features);
+
+    // Submit it now and check again next time
+    if (found == variants->second.end() || !found->second)
+    {
+        shaderVariant(name, features);
+        return false;
+    }
+
+    ShaderProgram* variant = found->second;
+
+    if (!variant->IsLinkDone())
+        return false;
+
+    // Only reported once, the failed program stays in the list so it isn't compiled again
+    if (variant->isLinkPending())
+    {
+        variant->FinishLink();
+
+        if (!variant->isLinked())
+            Log::warning("Variant " + std::to_string(features) + " of shader " + name.str() + " failed to link");
+    }
+
+    pendingShaders.erase(std::remove(pendingShaders.begin(), pendingShaders.end(), variant), pendingShaders.end());
+
+    return true;
+}
+
+
+void ResourceManager::finishShaders()
+{
+    // Status checks wait until everything has been submitted
+    for (ShaderProgram* shader : pendingShaders)
+        shader->FinishLink();
+
+    pendingShaders.clear();
+}
+
+
+void ResourceManager::warmUpShaders()
+{
+    // Submit every needed variant before waiting on any of them
+    for (auto& it : materials)
+    {
+        Material* mat = it.second;
+
+        if (mat && mat->getBaseShader())
+            shaderVariant(mat->getBaseShader()->getID(), mat->getShaderFeatures());
+    }
+
+    finishShaders();
+
+    for (auto& it : materials)
+    {
+        Material* mat = it.second;
+
+        if (mat && mat->getBaseShader() && mat->needsVariant())
+            mat->setVariant(shaderVariant(mat->getBaseShader()->getID(), mat->getShaderFeatures()));
+    }
+
+    Log::info("Shader warm-up done, " + std::to_string(ShaderCache::getHits()) + " from cache, " +
+        std::to_string(ShaderCache::getMisses()) + " compiled");
+}
+
+
+ShaderProgram* ResourceManager::compileShader(StringID name, const ShaderFiles& files, unsigned int features)
 {
-    ShaderProgram* shader = new ShaderProgram(name);
+    ShaderProgram* shader = new ShaderProgram(name.str(), features);
 
     if (shader)
     {
-        shader->AddShader(vertSrc, GL_VERTEX_SHADER);
-        shader->AddShader(geomSrc, GL_GEOMETRY_SHADER);
-        shader->AddShader(fragSrc, GL_FRAGMENT_SHADER);
+        shader->AddShader(files.vert, GL_VERTEX_SHADER);
 
-        shader->LinkProgram();
+        if (!files.geom.empty())
+            shader->AddShader(files.geom, GL_GEOMETRY_SHADER);
 
-        shaders[name] = shader; // Add new shader to list of shaders in resource manager
+        shader->AddShader(files.frag, GL_FRAGMENT_SHADER);
+
+        shader->BeginLink();
 
+        pendingShaders.push_back(shader);
     }
 
+    return shader;
 }
+
+
 /*
 void ResourceManager::loadShader(std::string name, std::string fragSrc, std::string vertSrc, std::string geomSrc)
 {
@@ -67,13 +194,15 @@ void ResourceManager::loadShader(std::string name, std::string fragSrc, std::str
 
 
 // If shader exists, return it.
-ShaderProgram* ResourceManager::shader(std::string name)
+ShaderProgram* ResourceManager::shader(StringID name)
 {
-    if (shaders.find(name) != shaders.end()) {
-        return shaders[name];
+    auto found = shaders.find(name);
+
+    if (found != shaders.end()) {
+        return found->second;
     }
     else {
-        std::cout << "Unable to find shader: " << name << " in resource manager\n";
+        std::cout << "Unable to find shader: " << name.c_str() << " in resource manager\n";
         return nullptr;
     }
 
@@ -82,12 +211,49 @@ ShaderProgram* ResourceManager::shader(std::string name)
 
 
 
-void ResourceManager::freeShader(std::string name)
+void ResourceManager::freeShader(StringID name)
 {
+    auto found = shaders.find(name);
+
+    if (found == shaders.end())
+    {
+        Log::warning("Unable to find shader: " + name.str() + " to free");
+        return;
+    }
+
+    // Materials point at the base shader and one of its variants
+    for (auto& it : materials)
+    {
+        Material* mat = it.second;
+
+        if ((mat->getBaseShader() && mat->getBaseShader()->getID() == name) || (mat->getShader() && mat->getShader()->getID() == name))
+        {
+            Log::warning("Cannot free shader " + name.str() + ", material " + mat->getName() + " uses it");
+            return;
+        }
+    }
+
+    for (auto& variant : shaderVariants[name])
+    {
+        ShaderProgram* shader = variant.second;
+
+        if (!shader)
+            continue;
+
+        pendingShaders.erase(std::remove(pendingShaders.begin(), pendingShaders.end(), shader), pendingShaders.end());
+
+        glDeleteProgram(shader->programId);
+        delete shader;
+    }
+
+    shaderVariants.erase(name);
+    shaderFiles.erase(name);
+    shaders.erase(found);
 
+    Log::msg("Freed shader " + name.str());
 }
 
-void ResourceManager::addTexture(std::string name, Texture* texture)
+void ResourceManager::addTexture(StringID name, Texture* texture)
 {
     if (texture)
     {
@@ -100,12 +266,14 @@ void ResourceManager::addTexture(std::string name, Texture* texture)
         {
             // Add the texture to resource manager
             textures[name] = texture;
+
+            manage(texture, name);
         }
     }
 }
 
-// Create a new texture and add to resource manager
-Texture* ResourceManager::loadTexture(std::string src)
+// Create a new texture and add to resource manager. It loads in the background
+Texture* ResourceManager::loadTexture(StringID src)
 {
     // Create new texure
     Texture* texture = new Texture();
@@ -113,36 +281,212 @@ Texture* ResourceManager::loadTexture(std::string src)
     // Allocation success
     if (texture)
     {
-        // Texture load success
-        if (texture->load(src))
-        {
-            // Add new texture to resource manager
-            textures[src] = texture;
+        textureLoader.load(texture, nullTexture, src.str(), findCookedAsset(src.str()));
 
-            Log::msg("loaded texture: " + src);
+        // Add new texture to resource manager
+        textures[src] = texture;
 
-            return textures[src];
-        }
-        else
-        {
-            Log::warning("Failed to load texture in resource manager: " + src);
-            return nullptr;
-        }
+        manage(texture, src);
+
+        Log::msg("loading texture: " + src.str());
+
+        return texture;
     }
     else
     {
-        Log::warning("Failed to allocate texture in resource manager: " + src);
+        Log::warning("Failed to allocate texture in resource manager: " + src.str());
         return nullptr;
     }
     
 }
 
+
+void ResourceManager::requestTextureDetail(Material* mat, float pixels)
+{
+    // Tiled materials repeat their textures across the mesh
+    float tiling = 1.0f;
+
+    auto scale = mat->vVec2.find("textureScale"_sid);
+    if (scale != mat->vVec2.end())
+        tiling = std::max(std::max(scale->second.val.x, scale->second.val.y), 1.0f);
+
+    for (auto& slot : mat->vTexture)
+    {
+        Texture* texture = slot.second;
+
+        if (!texture || !texture->isReady())
+            continue;
+
+        // Texels per pixel across the surface, each halving is a level
+        float texels = std::max(texture->getWidth(), texture->getHeight()) * tiling;
+        float level = pixels > 0.0f ? std::floor(std::log2(std::max(texels / pixels, 1.0f))) : 0.0f;
+
+        textureLoader.request(texture, static_cast<unsigned int>(std::max(level - TEXTURE_DETAIL_BIAS, 0.0f)));
+    }
+}
+
+
+void ResourceManager::requestTextureDetail(Material* mat)
+{
+    requestTextureDetail(mat, 0.0f);
+}
+
+
+void ResourceManager::updateTextures()
+{
+    // Fills the background, always wanted in full
+    if (skyTexture)
+        textureLoader.request(skyTexture, 0);
+
+    std::vector<Texture*> finished;
+    textureLoader.update(finished);
+
+    if (finished.empty())
+        return;
+
+    // Materials cache texture ids, so the ones using a finished texture have to look them up again
+    for (auto& it : materials)
+    {
+        Material* mat = it.second;
+
+        for (auto& slot : mat->vTexture)
+        {
+            if (std::find(finished.begin(), finished.end(), slot.second) != finished.end())
+            {
+                mat->markDirty();
+                break;
+            }
+        }
+    }
+}
+
+std::string ResourceManager::findCookedAsset(const std::string& src)
+{
+    // Nothing cooked at all, already said so once
+    if (manifest.size() == 0)
+        return std::string();
+
+    const AssetRecord* record = manifest.find(src);
+
+    if (!record)
+    {
+        Log::warning("Asset is not cooked, loading source: " + src);
+        return std::string();
+    }
+
+    // Sources with embedded data stay uncooked
+    if (record->cooked.empty())
+        return std::string();
+
+    unsigned long long size;
+    long long modified;
+
+    // Edited since the last cook. A missing source is fine, cooked builds can ship without them
+    if (AssetManifest::fileInfo(src, size, modified) && (size != record->size || modified != record->modified))
+    {
+        Log::warning("Asset changed since it was cooked, loading source: " + src);
+        return std::string();
+    }
+
+    return record->cooked;
+}
+
+
+Mesh* ResourceManager::importMesh(const std::string& src, ThreadPool* pool)
+{
+    std::string cooked = findCookedAsset(src);
+
+    if (!cooked.empty())
+    {
+        MeshCooked* mesh = new MeshCooked(cooked, false);
+
+        if (mesh->isValid())
+            return mesh;
+
+        delete mesh;
+    }
+
+    return new MeshFBX(src, true, false, pool);
+}
+
+
+Mesh* ResourceManager::loadMesh(std::string src)
+{
+    StringID key(src);
+
+    auto found = meshes.find(key);
+
+    if (found != meshes.end())
+        return found->second;
+
+    Mesh* mesh = importMesh(src, nullptr);
+    mesh->createBuffers();
+
+    meshes[key] = mesh;
+    manage(mesh, key);
+
+    return mesh;
+}
+
+
+std::vector<Mesh*> ResourceManager::loadMeshes(const std::vector<std::string>& srcs, ThreadPool& pool)
+{
+    std::vector<Mesh*> loaded(srcs.size(), nullptr);
+
+    // Interned once, every lookup below uses them
+    std::vector<StringID> keys;
+    keys.reserve(srcs.size());
+
+    for (const std::string& src : srcs)
+        keys.push_back(StringID(src));
+
+    // Files loaded before are reused. Only the first of any repeated src is imported
+    std::vector<unsigned int> missing;
+
+    for (unsigned int i = 0; i < srcs.size(); i++)
+    {
+        auto found = meshes.find(keys[i]);
+
+        if (found != meshes.end())
+            loaded[i] = found->second;
+        else if (std::find(srcs.begin(), srcs.begin() + i, srcs[i]) == srcs.begin() + i)
+            missing.push_back(i);
+    }
+
+    // One file per job, each file splits its sub-meshes over the same pool
+    pool.parallelFor(static_cast<unsigned int>(missing.size()), 1, [&](unsigned int begin, unsigned int end)
+    {
+        for (unsigned int i = begin; i < end; i++)
+            loaded[missing[i]] = importMesh(srcs[missing[i]], &pool);
+    });
+
+    // GL objects can only be created on this thread
+    for (unsigned int i : missing)
+    {
+        loaded[i]->createBuffers();
+
+        meshes[keys[i]] = loaded[i];
+        manage(loaded[i], keys[i]);
+    }
+
+    for (unsigned int i = 0; i < srcs.size(); i++)
+    {
+        if (!loaded[i])
+            loaded[i] = meshes[keys[i]];
+    }
+
+    return loaded;
+}
+
+
 // If texture exists, return it. If not, load the texture, add it to resource manager and return it.
-Texture* ResourceManager::getTexture(std::string src)
+Texture* ResourceManager::getTexture(StringID src)
 {
-    if (textures.find(src) != textures.end()) 
+    auto found = textures.find(src);
+
+    if (found != textures.end()) 
     {
-        return textures[src];
+        return found->second;
     }
     else 
     {
@@ -151,15 +495,161 @@ Texture* ResourceManager::getTexture(std::string src)
 }
 
 
-void ResourceManager::freeTexture(std::string name)
+void ResourceManager::freeTexture(StringID name)
+{
+    auto found = textures.find(name);
+
+    if (found == textures.end())
+    {
+        Log::warning("Unable to find texture: " + name.str() + " to free");
+        return;
+    }
+
+    Texture* texture = found->second;
+
+    if (texture->getRefs() > 0)
+    {
+        Log::warning("Cannot free texture " + name.str() + ", still used in " + std::to_string(texture->getRefs()) + " places");
+        return;
+    }
+
+    evict(texture);
+}
+
+
+void ResourceManager::manage(Resource* resource, StringID key)
+{
+    resource->owner = this;
+    resource->key = key;
+}
+
+
+void ResourceManager::referenced(Resource* resource)
+{
+    if (!resource->cached)
+        return;
+
+    cache.erase(resource->cacheEntry);
+    cacheBytes -= resource->cachedBytes;
+
+    resource->cached = false;
+}
+
+
+void ResourceManager::released(Resource* resource)
+{
+    // Sized again in resized() when the streamer changes a texture's mips while it waits
+    resource->cachedBytes = resourceBytes(resource);
+    resource->cacheEntry = cache.insert(cache.end(), resource);
+    resource->cached = true;
+
+    cacheBytes += resource->cachedBytes;
+
+    trimCache();
+}
+
+
+void ResourceManager::resized(Resource* resource)
+{
+    cacheBytes -= resource->cachedBytes;
+    resource->cachedBytes = resourceBytes(resource);
+    cacheBytes += resource->cachedBytes;
+}
+
+
+void ResourceManager::setCacheCapacity(unsigned long long bytes)
+{
+    cacheCapacity = bytes;
+
+    trimCache();
+}
+
+
+void ResourceManager::trimCache()
+{
+    // Already freeing, the outer loop picks up anything released along the way
+    if (trimming)
+        return;
+
+    trimming = true;
+
+    while (cacheBytes > cacheCapacity && !cache.empty())
+        evict(cache.front());
+
+    trimming = false;
+}
+
+
+void ResourceManager::evict(Resource* resource)
 {
+    if (resource->cached)
+    {
+        cache.erase(resource->cacheEntry);
+        cacheBytes -= resource->cachedBytes;
+    }
+
+    // A material or mesh made again under the same name replaced this one in its map
+    switch (resource->type)
+    {
+    case ResourceType::TEXTURE:
+    {
+        Texture* texture = static_cast<Texture*>(resource);
+
+        textureLoader.cancel(texture);
+
+        auto found = textures.find(resource->key);
+        if (found != textures.end() && found->second == texture)
+            textures.erase(found);
+
+        delete texture;
+        break;
+    }
+    case ResourceType::MESH:
+    {
+        Mesh* mesh = static_cast<Mesh*>(resource);
 
+        auto found = meshes.find(resource->key);
+        if (found != meshes.end() && found->second == mesh)
+            meshes.erase(found);
+
+        delete mesh;
+        break;
+    }
+    case ResourceType::MATERIAL:
+    {
+        Material* mat = static_cast<Material*>(resource);
+
+        auto found = materials.find(resource->key);
+        if (found != materials.end() && found->second == mat)
+            materials.erase(found);
+
+        // Releases its textures, they join the cache
+        delete mat;
+        break;
+    }
+    }
 }
 
 
-void ResourceManager::createNewMaterial(std::string name, ShaderProgram* shader)
+unsigned long long ResourceManager::resourceBytes(Resource* resource)
 {
-    Material* mat = new Material(name, shader);
+    switch (resource->type)
+    {
+    case ResourceType::TEXTURE:
+        return textureLoader.getTextureBytes(static_cast<Texture*>(resource));
+    case ResourceType::MESH:
+        return static_cast<Mesh*>(resource)->getMemoryUsage();
+    case ResourceType::MATERIAL:
+        return sizeof(Material);
+    default:
+        return 0;
+    }
+}
+
+
+void ResourceManager::createNewMaterial(StringID name, ShaderProgram* shader)
+{
+    Material* mat = new Material(name.str(), shader);
 
     if (mat)
     {
@@ -169,9 +659,11 @@ void ResourceManager::createNewMaterial(std::string name, ShaderProgram* shader)
 
             mat->registerUniforms();
 
-            Log::msg("Created material " + name);
+            Log::msg("Created material " + name.str());
 
             materials[name] = mat; // Add new material to list of materials
+
+            manage(mat, name);
         }
     }
     else
@@ -183,15 +675,17 @@ void ResourceManager::createNewMaterial(std::string name, ShaderProgram* shader)
 
 
 
-Material* ResourceManager::getMaterial(std::string name)
+Material* ResourceManager::getMaterial(StringID name)
 {
-    if (materials.find(name) != materials.end())
+    auto found = materials.find(name);
+
+    if (found != materials.end())
     {
-        return materials[name];
+        return found->second;
     }
     else
     {
-        Log::warning("Cannot find material: " + name + " in resource manager");
+        Log::warning("Cannot find material: " + name.str() + " in resource manager");
         return nullptr;
     }
 }
@@ -6,53 +6,166 @@
 
 #include<string>
 #include<vector>
+#include<list>
 #include<unordered_map>
 
 #include "Texture.h"
 #include "Shader.h"
 #include "Material.h"
+#include "AssetManifest.h"
+#include "TextureLoader.h"
+#include "Resource.h"
+#include "StringID.h"
+
+// Memory unreferenced meshes, textures and materials may hold before the least recently released are freed
+#define RESOURCE_CACHE_BYTES (128ull * 1024 * 1024)
 
 class Material;
+class Mesh;
+class ThreadPool;
 
 class ResourceManager
 {
 public:
 	ResourceManager();
 
-	ShaderProgram* shader(std::string name);
+	// Resources are looked up by interned name. Use _sid for literals, e.g. shader("lighting"_sid)
+	ShaderProgram* shader(StringID name);
 
-	Texture* getTexture(std::string src);
+	// Loads in the background on first use, drawn as the null texture until ready
+	Texture* getTexture(StringID src);
 	Texture* getNullTexture();
 
-	Material* getMaterial(std::string name);
+	Material* getMaterial(StringID name);
+
+	// Upload textures that finished decoding, within the frame budget. Once per frame
+	void updateTextures();
+
+	// Ask for enough mip detail to draw a material's textures across about pixels on screen this frame.
+	// Without a size every level is wanted
+	void requestTextureDetail(Material* mat, float pixels);
+	void requestTextureDetail(Material* mat);
+
+	unsigned int getTexturesLoading() { return textureLoader.getPending(); }
+	unsigned long long getTextureBytesUploaded() const { return textureLoader.getBytesUploaded(); }
+
+	void setTextureBudget(unsigned long long bytes) { textureLoader.setBudget(bytes); }
+	unsigned long long getTextureBudget() const { return textureLoader.getBudget(); }
+	unsigned long long getTextureResidentBytes() const { return textureLoader.getResidentBytes(); }
+	unsigned int getTextureStreamRequests() const { return textureLoader.getStreamRequests(); }
+
+	// Load a mesh, from its cooked file if colecook has cooked it. Loaded once per src and owned by the
+	// resource manager, freed some time after the last handle to it is gone
+	Mesh* loadMesh(std::string src);
+
+	// Load several meshes at once. Files and their sub-meshes are processed on the pool's workers,
+	// then GL buffers are created on the calling thread. Same order as srcs
+	std::vector<Mesh*> loadMeshes(const std::vector<std::string>& srcs, ThreadPool& pool);
+
+	// Memory unreferenced resources can hold. Lowering it frees them straight away
+	void setCacheCapacity(unsigned long long bytes);
+	unsigned long long getCacheCapacity() const { return cacheCapacity; }
+
+	// Unreferenced resources waiting to be freed
+	unsigned int getCachedCount() const { return static_cast<unsigned int>(cache.size()); }
+	unsigned long long getCachedBytes() const { return cacheBytes; }
 
 	// Load shader program (fragment, vertex, geometry)
-	void loadShader(std::string name, std::string fragSrc, std::string vertSrc, std::string geomSrc);
+	void loadShader(StringID name, std::string fragSrc, std::string vertSrc, std::string geomSrc);
 
 	// Load shader program (fragment, vertex)
-	void loadShader(std::string name, std::string fragSrc, std::string vertSrc);
+	void loadShader(StringID name, std::string fragSrc, std::string vertSrc);
+
+	// Loaded shader compiled with the defines for a feature bitmask. Compiled on first use and cached
+	ShaderProgram* shaderVariant(StringID name, unsigned int features);
+
+	// Start compiling a variant if it isn't already. True once it can be used without stalling
+	bool isShaderVariantReady(StringID name, unsigned int features);
+
+	// Wait for every shader that is still compiling
+	void finishShaders();
+
+	// Compile every variant the current materials need and switch them over, before the first frame
+	void warmUpShaders();
 
 	// Create a material with specified shader, add to resource manager
-	void createNewMaterial(std::string name, ShaderProgram* shader);
+	void createNewMaterial(StringID name, ShaderProgram* shader);
 
 	// Add a previously created texture to resource manager
-	void addTexture(std::string name, Texture* texture);
+	void addTexture(StringID name, Texture* texture);
 
-	void freeShader(std::string name);
-	void freeTexture(std::string name);
+	// Free now rather than when the cache fills. Refused with a warning while still in use
+	void freeShader(StringID name);
+	void freeTexture(StringID name);
 
-	std::unordered_map<std::string, ShaderProgram*> shaders;
-	std::unordered_map<std::string, Texture*> textures;
-	std::unordered_map<std::string, Material*> materials;
+	std::unordered_map<StringID, ShaderProgram*> shaders;
+	std::unordered_map<StringID, Texture*> textures;
+	std::unordered_map<StringID, Material*> materials;
+	std::unordered_map<StringID, Mesh*> meshes;
 
 	Texture* getSkyTexture() { return skyTexture; }
 	void setSkyTexture(Texture* _texture) { skyTexture = _texture; }
 
 private:
-	
-	Texture* loadTexture(std::string src);
+	friend class Resource;
+
+	// Take ownership of a resource stored in its map under key
+	void manage(Resource* resource, StringID key);
+
+	// From Resource, when its count leaves or reaches zero
+	void referenced(Resource* resource);
+	void released(Resource* resource);
+
+	// From Resource, when a cached resource's memory changed. Doesn't evict, the texture loader may be mid-update
+	void resized(Resource* resource);
+
+	// Free least recently released resources until the cache fits its capacity
+	void trimCache();
+
+	// Delete a resource and remove it from its map
+	void evict(Resource* resource);
+
+	unsigned long long resourceBytes(Resource* resource);
+
+	// Unreferenced resources, least recently released first
+	std::list<Resource*> cache;
+	unsigned long long cacheBytes;
+	unsigned long long cacheCapacity;
+	bool trimming; // Evicting a material releases its textures into the cache
+
+	Texture* loadTexture(StringID src);
+
+	// CPU side of loadMesh, safe on any thread. Buffers are created later with Mesh::createBuffers
+	Mesh* importMesh(const std::string& src, ThreadPool* pool);
+
+	// Cooked file for a source asset. Empty if it isn't cooked or the source changed since, load the source then
+	std::string findCookedAsset(const std::string& src);
+
+	// Written by colecook, empty if assets were never cooked
+	AssetManifest manifest;
+
+	TextureLoader textureLoader;
+
+	// Files a shader was loaded from, kept to compile its variants
+	struct ShaderFiles
+	{
+		std::string frag;
+		std::string vert;
+		std::string geom; // Empty if there is no geometry shader
+	};
+
+	// Submits the program for compiling, it finishes on first use or in finishShaders
+	ShaderProgram* compileShader(StringID name, const ShaderFiles& files, unsigned int features);
+
+	std::unordered_map<StringID, ShaderFiles> shaderFiles;
+
+	// Every compiled variant of each shader, by feature bitmask. Variant 0 is the loaded shader
+	std::unordered_map<StringID, std::unordered_map<unsigned int, ShaderProgram*>> shaderVariants;
+
+	// Programs submitted but not finished
+	std::vector<ShaderProgram*> pendingShaders;
 
-	Texture* skyTexture;
+	Handle<Texture> skyTexture;
 	Texture* nullTexture;
 };
 
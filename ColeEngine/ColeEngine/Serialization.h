@@ -100,7 +100,7 @@ private:
         // Serialize texture paths
         for (auto& it : mat->vTexture)
         {
-            std::string path = it.first;
+            std::string path = it.first.str();
 
             //rapidjson::Value texturePath;
             //texturePath.SetString(path);
@@ -114,7 +114,7 @@ private:
         // Serialize float values
         for (auto& it : mat->vFloat)
         {
-            std::string name = it.first;
+            std::string name = it.first.str();
             float value = it.second.val;
 
             rapidjson::Value floatVal;
@@ -130,7 +130,7 @@ private:
         // Serialize color values
         for (auto& it : mat->vColor)
         {
-            std::string name = it.first;
+            std::string name = it.first.str();
             Color3 value = it.second;
 
             rapidjson::Value comp;
@@ -154,7 +154,7 @@ private:
         // Serialize vec3 values
         for (auto& it : mat->vVec3)
         {
-            std::string name = it.first;
+            std::string name = it.first.str();
             glm::vec3 value = it.second.val;
 
             rapidjson::Value comp;
@@ -177,7 +177,7 @@ private:
         // Set vec2 uniforms
         for (auto& it : mat->vVec2)
         {
-            std::string name = it.first;
+            std::string name = it.first.str();
             glm::vec2 value = it.second.val;
 
             rapidjson::Value comp;
@@ -12,6 +12,9 @@
 
 
 #include "Shader.h"
+#include "UniformBuffer.h"
+#include "MaterialLayout.h"
+#include "ShaderCache.h"
 #include "Logging.h"
 
 /*
@@ -45,8 +48,9 @@ char* ReadFile(const char* name)
 }
 
 // Creates an empty shader program.
-ShaderProgram::ShaderProgram(std::string _name)
-    : name(name)
+ShaderProgram::ShaderProgram(std::string _name, unsigned int _features)
+    : name(_name), id(_name), features(_features), materialLayout(nullptr), linkCount(0),
+    linkPending(false), linked(false), linkFromCache(false), cacheKey(0)
 {
     programId = glCreateProgram();
     //LOG_GL_ERROR();
@@ -55,6 +59,9 @@ ShaderProgram::ShaderProgram(std::string _name)
 // Use a shader program
 void ShaderProgram::UseShader()
 {
+    // Still compiling, wait for it
+    FinishLink();
+
     glUseProgram(programId);
     //LOG_GL_ERROR();
 }
@@ -66,70 +73,241 @@ void ShaderProgram::UnuseShader()
     //LOG_GL_ERROR();
 }
 
-// Read, send to OpenGL, and compile a single file into a shader
-// program.  In case of an error, retrieve and print the error log
-// string.
+// Read a single file and queue it for the program. Compiling waits for
+// LinkProgram, which first tries the program binary cache.
 void ShaderProgram::AddShader(std::string fileName, GLenum type)
 {
     // Read the source from the named file
     char* src = ReadFile(fileName.c_str());
-    const char* psrc[1] = { src };
 
     shaderSrc = std::string(src);
 
-    // Create a shader and attach, hand it the source, and compile it.
-    int shader = glCreateShader(type);
-    glAttachShader(programId, shader);
+    delete src;
 
-    //LOG_GL_ERROR();
+    // Feature defines have to come after the #version line
+    std::string defines = featureDefines(features);
 
-    glShaderSource(shader, 1, psrc, NULL);
+    if (!defines.empty())
+    {
+        size_t insertAt = 0;
 
-   // LOG_GL_ERROR();
+        if (shaderSrc.compare(0, 8, "#version") == 0)
+        {
+            size_t lineEnd = shaderSrc.find('\n');
+            insertAt = lineEnd == std::string::npos ? shaderSrc.size() : lineEnd + 1;
+        }
 
-    glCompileShader(shader);
+        shaderSrc.insert(insertAt, defines);
+    }
 
-    //LOG_GL_ERROR();
+    ShaderStage stage;
+    stage.type = type;
+    stage.fileName = fileName;
+    stage.source = shaderSrc;
+    stage.shader = 0;
 
-    delete src;
+    stages.push_back(stage);
+}
 
-    // Get the compilation status
-    int status;
-    glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+// Compile every queued stage and attach it. Status is not queried
+// here so the driver can keep compiling while other work is submitted.
+void ShaderProgram::CompileStages()
+{
+    for (ShaderStage& stage : stages)
+    {
+        const char* psrc[1] = { stage.source.c_str() };
 
-    
-    // If compilation status is not OK, get and print the log message.
-    if (status != 1) 
+        // Create a shader and attach, hand it the source, and compile it.
+        stage.shader = glCreateShader(stage.type);
+        glAttachShader(programId, stage.shader);
+
+        glShaderSource(stage.shader, 1, psrc, NULL);
+
+        glCompileShader(stage.shader);
+    }
+}
+
+// Print the log of every stage that failed to compile, then free the shader objects
+void ShaderProgram::ReleaseStages()
+{
+    for (ShaderStage& stage : stages)
     {
-        int length;
-        glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
-        char* buffer = new char[length];
-        glGetShaderInfoLog(shader, length, NULL, buffer);
-        printf("Compile log for %s:\n%s\n", fileName.c_str(), buffer);
-        delete buffer;
+        if (!stage.shader)
+            continue;
+
+        // Get the compilation status
+        int status;
+        glGetShaderiv(stage.shader, GL_COMPILE_STATUS, &status);
+
+        // If compilation status is not OK, get and print the log message.
+        if (status != 1) 
+        {
+            int length;
+            glGetShaderiv(stage.shader, GL_INFO_LOG_LENGTH, &length);
+            char* buffer = new char[length];
+            glGetShaderInfoLog(stage.shader, length, NULL, buffer);
+            printf("Compile log for %s:\n%s\n", stage.fileName.c_str(), buffer);
+            delete buffer;
+        }
+
+        glDetachShader(programId, stage.shader);
+        glDeleteShader(stage.shader);
+        stage.shader = 0;
     }
 }
 
 // Link a shader program after all the shader files have been added
-// with the AddShader method.  In case of an error, retrieve and print
-// the error log string.
+// with the AddShader method. Blocks until the program is ready.
 void ShaderProgram::LinkProgram()
 {
-    // Link program and check the status
-    glLinkProgram(programId);
-    int status;
-    glGetProgramiv(programId, GL_LINK_STATUS, &status);
+    BeginLink();
+    FinishLink();
+}
 
-    //LOG_GL_ERROR();
+// Load a cached binary of the same sources if the driver accepts it,
+// otherwise submit the sources for compiling and linking without
+// waiting on the result.
+void ShaderProgram::BeginLink()
+{
+    std::vector<std::pair<unsigned int, std::string>> sources;
+
+    for (ShaderStage& stage : stages)
+        sources.push_back(std::make_pair(static_cast<unsigned int>(stage.type), stage.source));
+
+    cacheKey = ShaderCache::makeKey(sources);
+
+    linkPending = true;
+    linkFromCache = ShaderCache::load(programId, cacheKey);
+
+    if (!linkFromCache)
+    {
+        CompileStages();
+
+        if (ShaderCache::isSupported())
+            glProgramParameteri(programId, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
+        glLinkProgram(programId);
+    }
+}
+
+// True once FinishLink won't stall. Without parallel compile support the
+// driver can't be asked, so callers finish the link at the end of a batch.
+bool ShaderProgram::IsLinkDone()
+{
+    if (!linkPending || linkFromCache)
+        return true;
+
+    if (GLEW_KHR_parallel_shader_compile || GLEW_ARB_parallel_shader_compile)
+    {
+        int done = 0;
+        glGetProgramiv(programId, GL_COMPLETION_STATUS_KHR, &done);
+        return done != 0;
+    }
+
+    return true;
+}
 
-    // If link failed, get and print log
-    if (status != 1) 
+// Check the link status, cache the binary and set up program state.
+// In case of an error, retrieve and print the error log string.
+void ShaderProgram::FinishLink()
+{
+    if (!linkPending)
+        return;
+
+    linkPending = false;
+
+    // The cache only loads binaries that linked
+    linked = true;
+
+    if (!linkFromCache)
     {
-        int length;
-        glGetProgramiv(programId, GL_INFO_LOG_LENGTH, &length);
-        char* buffer = new char[length];
-        glGetProgramInfoLog(programId, length, NULL, buffer);
-        printf("Link log:\n%s\n", buffer);
-        delete buffer;
+        int status;
+        glGetProgramiv(programId, GL_LINK_STATUS, &status);
+
+        linked = status == 1;
+
+        // If link failed, get and print log
+        if (status != 1) 
+        {
+            int length;
+            glGetProgramiv(programId, GL_INFO_LOG_LENGTH, &length);
+            char* buffer = new char[length];
+            glGetProgramInfoLog(programId, length, NULL, buffer);
+            printf("Link log:\n%s\n", buffer);
+            delete buffer;
+        }
+        else
+        {
+            ShaderCache::save(programId, cacheKey);
+        }
+
+        ReleaseStages();
     }
+
+    // Shared uniform blocks always use the same binding points
+    bindUniformBlock("FrameBlock", FRAME_BLOCK_BINDING);
+    bindUniformBlock("LightBlock", LIGHT_BLOCK_BINDING);
+    bindUniformBlock("MaterialBlock", MATERIAL_BLOCK_BINDING);
+
+    linkCount++;
+
+    // Offsets and locations may have moved, read them again when next asked
+    if (materialLayout)
+    {
+        delete materialLayout;
+        materialLayout = nullptr;
+    }
+
+    uniformLocations.clear();
+}
+
+// Point a uniform block at a binding point, if the program uses it
+void ShaderProgram::bindUniformBlock(const std::string& blockName, unsigned int binding)
+{
+    GLuint index = glGetUniformBlockIndex(programId, blockName.c_str());
+
+    if (index != GL_INVALID_INDEX)
+        glUniformBlockBinding(programId, index, binding);
+}
+
+
+MaterialLayout* ShaderProgram::getMaterialLayout()
+{
+    FinishLink();
+
+    if (!materialLayout)
+        materialLayout = new MaterialLayout(programId);
+
+    return materialLayout;
+}
+
+
+int ShaderProgram::getUniformLocation(StringID uniform)
+{
+    FinishLink();
+
+    auto found = uniformLocations.find(uniform);
+
+    if (found != uniformLocations.end())
+        return found->second;
+
+    // Missing uniforms are cached as -1 too, glUniform ignores them
+    int location = glGetUniformLocation(programId, uniform.c_str());
+    uniformLocations.emplace(uniform, location);
+
+    return location;
+}
+
+
+std::string ShaderProgram::featureDefines(unsigned int features)
+{
+    std::string defines;
+
+    if (features & SHADER_DIFFUSE_MAP)
+        defines += "#define DIFFUSE_MAP\n";
+
+    if (features & SHADER_NORMAL_MAP)
+        defines += "#define NORMAL_MAP\n";
+
+    return defines;
 }
@@ -5,24 +5,98 @@
 #include"glew.h"
 
 #include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "StringID.h"
+
+class MaterialLayout;
+
+// Optional parts of a shader. Each set bit compiles in a #define of the same name
+#define SHADER_DIFFUSE_MAP 0x1
+#define SHADER_NORMAL_MAP 0x2
 
 class ShaderProgram
 {
 public:
     int programId;
 
-    ShaderProgram(std::string _name);
+    ShaderProgram(std::string _name, unsigned int _features = 0);
+
+    // Queue a file for the program, with the feature #defines added after #version
     void AddShader(std::string fileName, const GLenum type);
+
+    // Load the program from the binary cache, or compile the queued files and link
     void LinkProgram();
+
+    // LinkProgram split in two, so many programs can compile at once.
+    // BeginLink submits the work, FinishLink waits for it and sets up the program.
+    void BeginLink();
+    bool IsLinkDone();
+    void FinishLink();
+
+    bool isLinkPending() const { return linkPending; }
+
+    // Whether the program linked. Only known once FinishLink has run
+    bool isLinked() const { return linked; }
+
     void UseShader();
     void UnuseShader();
 
     std::string getName() { return name; }
 
+    // Interned name, for looking the shader up without hashing the string
+    StringID getID() const { return id; }
+
+    // Location of a uniform outside the material block, -1 if the program doesn't use it.
+    // Asked of GL once per link, then cached
+    int getUniformLocation(StringID uniform);
+
+    // Feature bits the program was compiled with
+    unsigned int getFeatures() const { return features; }
+
+    // #define lines for a feature bitmask
+    static std::string featureDefines(unsigned int features);
+
+    void bindUniformBlock(const std::string& blockName, unsigned int binding);
+
+    // Material parameter layout, read from the linked program on first use
+    MaterialLayout* getMaterialLayout();
+
+    // Bumped every link, anything derived from the old program is out of date
+    unsigned int getLinkCount() const { return linkCount; }
+
     std::string shaderSrc;
 
 private:
+    struct ShaderStage
+    {
+        GLenum type;
+        std::string fileName;
+        std::string source; // With feature defines
+        GLuint shader; // Shader object while the program is linking
+    };
+
+    void CompileStages();
+    void ReleaseStages();
+
     std::string name;
+    StringID id;
+
+    std::vector<ShaderStage> stages;
+
+    unsigned int features;
+
+    MaterialLayout* materialLayout;
+
+    unsigned int linkCount;
+
+    std::unordered_map<StringID, int> uniformLocations; // Cleared every link
+
+    bool linkPending; // Submitted but not finished
+    bool linked; // Set by FinishLink, glUseProgram refuses the program otherwise
+    bool linkFromCache;
+    unsigned long long cacheKey;
     
 };
 
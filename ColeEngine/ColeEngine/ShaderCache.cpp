@@ -0,0 +1,174 @@
+#include "ShaderCache.h"
+
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <direct.h>
+
+#include "glew.h"
+#include "Logging.h"
+#include "Hash.h"
+
+
+unsigned int ShaderCache::hits = 0;
+unsigned int ShaderCache::misses = 0;
+
+// "CSBC", start of every cache file
+static const unsigned int SHADER_CACHE_MAGIC = 0x43425343;
+
+struct ShaderCacheHeader
+{
+    unsigned int magic;
+    unsigned int version;
+    unsigned long long key; // Checked again in case two keys share a file name
+    unsigned int format; // Driver specific binary format
+    unsigned int length;
+};
+
+
+static unsigned long long hashString(unsigned long long hash, const char* str)
+{
+    // Separator so "ab" + "c" and "a" + "bc" differ
+    static const char separator = 0;
+
+    if (str)
+        hash = hashBytes(hash, str, strlen(str));
+
+    return hashBytes(hash, &separator, 1);
+}
+
+
+bool ShaderCache::isSupported()
+{
+    if (!GLEW_ARB_get_program_binary && !GLEW_VERSION_4_1)
+        return false;
+
+    GLint nFormats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &nFormats);
+
+    return nFormats > 0;
+}
+
+
+unsigned long long ShaderCache::makeKey(const std::vector<std::pair<unsigned int, std::string>>& stages)
+{
+    unsigned long long hash = FNV_OFFSET_BASIS;
+
+    unsigned int version = SHADER_CACHE_VERSION;
+    hash = hashBytes(hash, &version, sizeof(version));
+
+    // Binaries only load on the driver that made them
+    hash = hashString(hash, reinterpret_cast<const char*>(glGetString(GL_VENDOR)));
+    hash = hashString(hash, reinterpret_cast<const char*>(glGetString(GL_RENDERER)));
+    hash = hashString(hash, reinterpret_cast<const char*>(glGetString(GL_VERSION)));
+
+    for (const std::pair<unsigned int, std::string>& stage : stages)
+    {
+        hash = hashBytes(hash, &stage.first, sizeof(stage.first));
+        hash = hashString(hash, stage.second.c_str());
+    }
+
+    return hash;
+}
+
+
+std::string ShaderCache::getPath(unsigned long long key)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.bin", key);
+
+    return std::string(SHADER_CACHE_DIR) + "/" + name;
+}
+
+
+bool ShaderCache::load(unsigned int program, unsigned long long key)
+{
+    if (!isSupported())
+    {
+        misses++;
+        return false;
+    }
+
+    std::ifstream file(getPath(key), std::ios::binary);
+
+    if (!file)
+    {
+        misses++;
+        return false;
+    }
+
+    ShaderCacheHeader header;
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+    if (!file || header.magic != SHADER_CACHE_MAGIC || header.version != SHADER_CACHE_VERSION || header.key != key)
+    {
+        misses++;
+        return false;
+    }
+
+    std::vector<char> binary(header.length);
+    file.read(binary.data(), header.length);
+
+    if (!file)
+    {
+        misses++;
+        return false;
+    }
+
+    glProgramBinary(program, header.format, binary.data(), header.length);
+
+    // Drivers may still refuse a binary they made, e.g. after a settings change
+    GLint status = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+
+    if (status != GL_TRUE)
+    {
+        Log::info("Cached shader binary was rejected, compiling from source");
+        misses++;
+        return false;
+    }
+
+    hits++;
+    return true;
+}
+
+
+void ShaderCache::save(unsigned int program, unsigned long long key)
+{
+    if (!isSupported())
+        return;
+
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+
+    if (length <= 0)
+        return;
+
+    ShaderCacheHeader header;
+    header.magic = SHADER_CACHE_MAGIC;
+    header.version = SHADER_CACHE_VERSION;
+    header.key = key;
+
+    std::vector<char> binary(length);
+
+    GLenum format = 0;
+    GLsizei written = 0;
+    glGetProgramBinary(program, length, &written, &format, binary.data());
+
+    header.format = format;
+    header.length = static_cast<unsigned int>(written);
+
+    // Fails harmlessly if the folder already exists
+    _mkdir(SHADER_CACHE_DIR);
+
+    std::ofstream file(getPath(key), std::ios::binary);
+
+    if (!file)
+    {
+        Log::warning("Unable to write shader cache file: " + getPath(key));
+        return;
+    }
+
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(binary.data(), written);
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#ifndef _SHADER_CACHE
+#define _SHADER_CACHE
+
+#include <string>
+#include <vector>
+
+// Folder linked program binaries are written to, relative to the working directory
+#define SHADER_CACHE_DIR "shadercache"
+
+// Bump when the file layout changes so old files are ignored
+#define SHADER_CACHE_VERSION 1
+
+
+// Stores linked program binaries on disk so later runs can skip compiling.
+// Files are keyed by a hash of the final sources and the driver vendor, renderer and version,
+// so an edited shader or a new driver just misses and gets compiled again.
+class ShaderCache
+{
+public:
+	ShaderCache() = delete;
+
+	// Driver can hand out program binaries
+	static bool isSupported();
+
+	// Key for a program built from these sources (stage type followed by source, per stage)
+	static unsigned long long makeKey(const std::vector<std::pair<unsigned int, std::string>>& stages);
+
+	// Load a cached binary into program. False if there is none or the driver rejected it
+	static bool load(unsigned int program, unsigned long long key);
+
+	// Write the binary of a linked program
+	static void save(unsigned int program, unsigned long long key);
+
+	static unsigned int getHits() { return hits; }
+	static unsigned int getMisses() { return misses; } // Programs compiled from source
+
+private:
+	static std::string getPath(unsigned long long key);
+
+	static unsigned int hits;
+	static unsigned int misses;
+};
+
+#endif
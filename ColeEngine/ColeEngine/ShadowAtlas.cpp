@@ -0,0 +1,268 @@
+#include "ShadowAtlas.h"
+
+#include "glew.h"
+
+#include <algorithm>
+#include <string>
+
+#include "PointLight.h"
+#include "Logging.h"
+
+
+// Squares of SHADOW_TILE_MIN covered by a tile
+static unsigned int tileUnits(int tileSize)
+{
+    unsigned int side = static_cast<unsigned int>(tileSize / SHADOW_TILE_MIN);
+
+    return side * side;
+}
+
+// Every other bit of a Morton code
+static unsigned int compactBits(unsigned int v)
+{
+    v &= 0x55555555;
+    v = (v | (v >> 1)) & 0x33333333;
+    v = (v | (v >> 2)) & 0x0F0F0F0F;
+    v = (v | (v >> 4)) & 0x00FF00FF;
+    v = (v | (v >> 8)) & 0x0000FFFF;
+
+    return v;
+}
+
+
+ShadowAtlas::ShadowAtlas(int _size, int _layers)
+    : size(_size), layers(_layers)
+{
+    depthTexture = createArray();
+    staticTexture = createArray();
+
+    // Layered framebuffers for rendering
+    glGenFramebuffers(1, &depthFBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, depthFBO);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthTexture, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        Log::error("Shadow atlas framebuffer is incomplete");
+
+    glGenFramebuffers(1, &staticFBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, staticFBO);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, staticTexture, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        Log::error("Shadow atlas static framebuffer is incomplete");
+
+    // Layers are attached when copying
+    glGenFramebuffers(2, copyFBO);
+
+    for (unsigned int i = 0; i < 2; i++)
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, copyFBO[i]);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+
+ShadowAtlas::~ShadowAtlas()
+{
+    glDeleteFramebuffers(1, &depthFBO);
+    glDeleteFramebuffers(1, &staticFBO);
+    glDeleteFramebuffers(2, copyFBO);
+
+    glDeleteTextures(1, &depthTexture);
+    glDeleteTextures(1, &staticTexture);
+}
+
+
+unsigned int ShadowAtlas::createArray()
+{
+    unsigned int texture;
+
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT32F, size, size, layers, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+
+    // Tiles are sampled texel exact, filtering would bleed between them
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    return texture;
+}
+
+
+void ShadowAtlas::allocate(const std::vector<PointLight*>& lights)
+{
+    // Nothing to do unless a light was added, removed or wants a different size
+    bool changed = lights.size() != packedRequests.size();
+
+    for (unsigned int i = 0; i < lights.size() && !changed; i++)
+    {
+        auto found = packedRequests.find(lights[i]);
+        changed = found == packedRequests.end() || found->second != lights[i]->shadowTileRequest;
+    }
+
+    if (!changed)
+        return;
+
+    unsigned int unitsPerLayer = tileUnits(size);
+    unsigned int remaining = unitsPerLayer * static_cast<unsigned int>(layers);
+
+    // Pick tile sizes in priority order. Each light shrinks until what's left still holds the
+    // smallest tiles for the lights after it, as many of them as can fit at all
+    std::vector<int> tileSizes(lights.size(), 0);
+
+    unsigned int minLightUnits = 6 * tileUnits(SHADOW_TILE_MIN);
+
+    unsigned int wanting = 0;
+    for (PointLight* light : lights)
+        wanting += light->shadowTileRequest > 0 ? 1 : 0;
+
+    unsigned int unshadowed = 0;
+
+    for (unsigned int i = 0; i < lights.size(); i++)
+    {
+        if (lights[i]->shadowTileRequest <= 0)
+            continue;
+
+        wanting--;
+
+        int tileSize = std::min(lights[i]->shadowTileRequest, std::min(size, SHADOW_TILE_MAX));
+
+        unsigned int fits = remaining / minLightUnits;
+        unsigned int reserved = minLightUnits * std::min(wanting, fits > 0 ? fits - 1 : 0);
+        unsigned int available = remaining - reserved;
+
+        while (tileSize >= SHADOW_TILE_MIN && 6 * tileUnits(tileSize) > available)
+            tileSize /= 2;
+
+        // Out of room, light goes without shadows
+        if (tileSize < SHADOW_TILE_MIN)
+        {
+            unshadowed++;
+            continue;
+        }
+
+        tileSizes[i] = tileSize;
+        remaining -= 6 * tileUnits(tileSize);
+    }
+
+    if (unshadowed > 0)
+        Log::warning("Shadow atlas is full, " + std::to_string(unshadowed) + " point lights have no shadows");
+
+    // Place largest tiles first along a Morton curve. Every tile then starts
+    // aligned to its own size, so there are no gaps and no tile crosses a layer
+    std::vector<unsigned int> order;
+    for (unsigned int i = 0; i < lights.size(); i++)
+    {
+        if (tileSizes[i] > 0)
+            order.push_back(i);
+    }
+
+    std::stable_sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) { return tileSizes[a] > tileSizes[b]; });
+
+    std::vector<ShadowTile> tiles(lights.size() * 6);
+
+    unsigned int cursor = 0;
+    for (unsigned int i : order)
+    {
+        for (unsigned int f = 0; f < 6; f++)
+        {
+            unsigned int local = cursor % unitsPerLayer;
+
+            ShadowTile& tile = tiles[i * 6 + f];
+            tile.layer = static_cast<int>(cursor / unitsPerLayer);
+            tile.x = static_cast<int>(compactBits(local)) * SHADOW_TILE_MIN;
+            tile.y = static_cast<int>(compactBits(local >> 1)) * SHADOW_TILE_MIN;
+            tile.size = tileSizes[i];
+
+            cursor += tileUnits(tileSizes[i]);
+        }
+    }
+
+    usedUnits = cursor;
+
+    // Hand tiles over. Moved tiles hold someone else's depth, so redraw them
+    packedRequests.clear();
+
+    for (unsigned int i = 0; i < lights.size(); i++)
+    {
+        PointLight* light = lights[i];
+
+        bool moved = false;
+        for (unsigned int f = 0; f < 6; f++)
+        {
+            moved = moved || !(light->shadowTiles[f] == tiles[i * 6 + f]);
+            light->shadowTiles[f] = tiles[i * 6 + f];
+        }
+
+        if (moved)
+        {
+            light->invalidateStaticShadows();
+            light->forceShadowUpdate();
+        }
+
+        packedRequests[light] = light->shadowTileRequest;
+    }
+}
+
+
+void ShadowAtlas::bindTile(const ShadowTile& tile, bool staticCache)
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, staticCache ? staticFBO : depthFBO);
+    glViewport(tile.x, tile.y, tile.size, tile.size);
+}
+
+
+void ShadowAtlas::clearStaticTile(const ShadowTile& tile)
+{
+    // Clearing the layered framebuffer would clear every layer, so attach just this one
+    glBindFramebuffer(GL_FRAMEBUFFER, copyFBO[1]);
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, staticTexture, 0, tile.layer);
+
+    glEnable(GL_SCISSOR_TEST);
+    glScissor(tile.x, tile.y, tile.size, tile.size);
+    glClear(GL_DEPTH_BUFFER_BIT);
+    glDisable(GL_SCISSOR_TEST);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+
+void ShadowAtlas::copyStaticTile(const ShadowTile& tile)
+{
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, copyFBO[0]);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, copyFBO[1]);
+
+    glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, staticTexture, 0, tile.layer);
+    glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthTexture, 0, tile.layer);
+
+    glBlitFramebuffer(tile.x, tile.y, tile.x + tile.size, tile.y + tile.size,
+        tile.x, tile.y, tile.x + tile.size, tile.y + tile.size, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+}
+
+
+unsigned long long ShadowAtlas::getMemoryBytes() const
+{
+    // Two arrays of 32 bit depth
+    return 2ull * 4ull * static_cast<unsigned long long>(size) * size * layers;
+}
+
+
+float ShadowAtlas::getOccupancy() const
+{
+    return static_cast<float>(usedUnits) / static_cast<float>(tileUnits(size) * layers);
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#ifndef _SHADOW_ATLAS
+#define _SHADOW_ATLAS
+
+#include <vector>
+#include <unordered_map>
+
+class PointLight;
+
+// Width and height of one atlas layer
+#define SHADOW_ATLAS_SIZE 2048
+
+// Layers in the atlas. Size and layers together are the memory budget for all point light shadows
+#define SHADOW_ATLAS_LAYERS 4
+
+// Largest and smallest cube face tile, both powers of two
+#define SHADOW_TILE_MAX 1024
+#define SHADOW_TILE_MIN 128
+
+
+// Square region of one atlas layer holding a single cube face
+struct ShadowTile
+{
+	int layer = -1;
+	int x = 0, y = 0;
+	int size = 0;
+
+	bool valid() const { return layer >= 0; }
+
+	bool operator==(const ShadowTile& other) const
+	{
+		return layer == other.layer && x == other.x && y == other.y && size == other.size;
+	}
+};
+
+
+// Depth atlas shared by every point light. Each light gets six tiles, one per cube face, in a
+// 2D texture array so the lighting pass samples all lights through a single binding.
+// A second array with the same layout holds the static caster caches.
+class ShadowAtlas
+{
+public:
+	ShadowAtlas(int _size = SHADOW_ATLAS_SIZE, int _layers = SHADOW_ATLAS_LAYERS);
+	~ShadowAtlas();
+
+	// Hand out tiles to lights ordered by priority, sized from each light's shadowTileRequest.
+	// Repacks only when a request changed. Lights whose tiles moved are redrawn in full
+	void allocate(const std::vector<PointLight*>& lights);
+
+	// Render into a tile of the shadow or static cache array. The geometry shader selects the layer
+	void bindTile(const ShadowTile& tile, bool staticCache);
+
+	// Clear a tile of the static cache before it is redrawn
+	void clearStaticTile(const ShadowTile& tile);
+
+	// Copy a tile from the static cache into the shadow array
+	void copyStaticTile(const ShadowTile& tile);
+
+	unsigned int getTexture() const { return depthTexture; }
+
+	int getSize() const { return size; }
+	int getLayers() const { return layers; }
+
+	// Bytes used by both arrays
+	unsigned long long getMemoryBytes() const;
+
+	// Fraction of the atlas handed out to lights
+	float getOccupancy() const;
+
+private:
+	unsigned int createArray();
+
+	int size, layers;
+
+	unsigned int depthTexture, staticTexture;
+
+	unsigned int depthFBO, staticFBO; // Whole arrays attached, rendered to with gl_Layer
+	unsigned int copyFBO[2]; // Single layer read/draw attachments for copies and clears
+
+	unsigned int usedUnits = 0; // SHADOW_TILE_MIN squares handed out
+
+	std::unordered_map<PointLight*, int> packedRequests; // Requests the current packing was made from
+};
+
+#endif
@@ -0,0 +1,40 @@
+#include "StringID.h"
+
+#include <unordered_map>
+#include <mutex>
+
+#include "Logging.h"
+
+
+// Interned strings by hash. Map nodes never move, so c_str() of an entry stays valid.
+// Function statics, IDs can be made while other globals are being constructed
+static std::unordered_map<unsigned long long, std::string>& internTable()
+{
+    static std::unordered_map<unsigned long long, std::string> table;
+    return table;
+}
+
+static std::mutex& internMutex()
+{
+    static std::mutex mutex;
+    return mutex;
+}
+
+
+StringID::StringID(const std::string& str)
+    : hash(hashString(str.data(), str.size())), text(nullptr)
+{
+    // Meshes are imported on worker threads
+    std::lock_guard<std::mutex> lock(internMutex());
+
+    std::unordered_map<unsigned long long, std::string>& table = internTable();
+
+    auto found = table.find(hash);
+
+    if (found == table.end())
+        found = table.emplace(hash, str).first;
+    else if (found->second != str)
+        Log::warning("String ID collision between " + str + " and " + found->second);
+
+    text = found->second.c_str();
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#ifndef _STRING_ID
+#define _STRING_ID
+
+#include <string>
+#include <cstddef>
+#include <functional>
+
+#include "Hash.h"
+
+
+// A name reduced to its FNV-1a hash, so map keys compare and hash as one integer. Literals are
+// hashed at compile time with _sid ("textureDiffuse"_sid). Other strings are interned by the explicit constructor,
+// which keeps a copy of the characters for c_str(), so convert once at load rather than per frame
+class StringID
+{
+public:
+	constexpr StringID() : hash(FNV_OFFSET_BASIS), text("") {}
+	constexpr StringID(unsigned long long _hash, const char* _text) : hash(_hash), text(_text) {}
+
+	explicit StringID(const std::string& str);
+
+	constexpr unsigned long long value() const { return hash; }
+
+	// The literal or the interned copy, valid for the rest of the program
+	constexpr const char* c_str() const { return text; }
+	std::string str() const { return text; }
+
+	constexpr bool operator==(const StringID& other) const { return hash == other.hash; }
+	constexpr bool operator!=(const StringID& other) const { return hash != other.hash; }
+
+private:
+	unsigned long long hash;
+	const char* text;
+};
+
+
+constexpr StringID operator"" _sid(const char* str, size_t length)
+{
+	return StringID(hashString(str, length), str);
+}
+
+
+namespace std
+{
+	template <>
+	struct hash<StringID>
+	{
+		size_t operator()(const StringID& id) const { return static_cast<size_t>(id.value()); }
+	};
+}
+
+#endif
@@ -2,6 +2,7 @@
 
 
 class Engine;
+class Entity;
 
 class System
 {
@@ -11,4 +12,7 @@ public:
 
 	virtual void update(Engine & engine) = 0;
 
+	// Called by Engine::removeEntity before the entity is deleted. Drop any pointers to it
+	virtual void entityRemoved(Entity* /*entity*/) {}
+
 };
\ No newline at end of file
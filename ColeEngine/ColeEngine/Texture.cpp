@@ -1,4 +1,8 @@
 #include "Texture.h"
+#include "CTexture.h"
+#include "MappedFile.h"
+#include "Logging.h"
+
 
 
 #define STB_IMAGE_IMPLEMENTATION
@@ -7,7 +11,7 @@
 
 
 Texture::Texture()
-	:data(nullptr)
+	: Resource(ResourceType::TEXTURE), data(nullptr), width(0), height(0), channels(0), texture(0), ready(true), placeholder(nullptr)
 {
 	
 }
@@ -15,7 +19,7 @@ Texture::Texture()
 
 // Constructor for creating empty texture
 Texture::Texture (unsigned int _width, unsigned int _height, unsigned int _nChannels, GLint filtering)
-	: data(nullptr), channels(_nChannels), width(_width), height(_height)
+	: Resource(ResourceType::TEXTURE), data(nullptr), channels(_nChannels), width(_width), height(_height), texture(0), ready(true), placeholder(nullptr)
 {
 	// Generate texture ID and bind
 	glGenTextures(1, &texture);
@@ -200,6 +204,84 @@ bool Texture::load(std::string path)
 	}
 }
 
+bool Texture::loadCooked(std::string path)
+{
+	MappedFile file;
+
+	if (!file.open(path))
+	{
+		Log::warning("Unable to open cooked texture: " + path);
+		return false;
+	}
+
+	CTextureHeader header;
+	const CTextureLevel* levels = nullptr;
+
+	if (!readCookedTexture(file, header, levels))
+	{
+		Log::warning("Cooked texture is damaged or from another version: " + path);
+		return false;
+	}
+
+	if (!isFormatSupported(header.format))
+	{
+		Log::warning("Cooked texture format isn't supported by this GPU: " + path);
+		return false;
+	}
+
+	width = header.width;
+	height = header.height;
+	channels = header.channels;
+
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, (int)GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, (int)GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, header.nLevels - 1);
+
+	const CTextureFormat* format = getTextureFormat(header.format);
+
+	// Mips were built by the cooker, straight from the mapping
+	for (unsigned int i = 0; i < header.nLevels; i++)
+	{
+		if (format->compressed)
+		{
+			glCompressedTexImage2D(GL_TEXTURE_2D, i, format->glInternalFormat, levels[i].width, levels[i].height, 0, levels[i].size, file.data() + levels[i].offset);
+		}
+		else
+		{
+			glTexImage2D(GL_TEXTURE_2D, i, (GLint)format->glInternalFormat, levels[i].width, levels[i].height, 0, format->glFormat, format->glType, file.data() + levels[i].offset);
+		}
+	}
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	return true;
+}
+
+bool Texture::isFormatSupported(unsigned int format)
+{
+	switch (format)
+	{
+	case CTEXTURE_FORMAT_RGBA8:
+		return true;
+	case CTEXTURE_FORMAT_BC1:
+	case CTEXTURE_FORMAT_BC3:
+		return GLEW_EXT_texture_compression_s3tc;
+	case CTEXTURE_FORMAT_BC5:
+		return true; // RGTC is core since 3.0
+	case CTEXTURE_FORMAT_BC6H:
+		return GLEW_VERSION_4_2 || GLEW_ARB_texture_compression_bptc;
+	case CTEXTURE_FORMAT_RGBA16F:
+		return true;
+	default:
+		return false;
+	}
+}
+
 void Texture::unload()
 {
 	glDeleteTextures(1, &texture);
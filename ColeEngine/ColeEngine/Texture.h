@@ -8,12 +8,13 @@
 #include <iostream>
 #include <string>
 #include "glew.h"
+#include "Resource.h"
 
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
-class Texture
+class Texture : public Resource
 {
 public:
 	Texture();
@@ -24,17 +25,26 @@ public:
 	int getHeight() { return height; }
 	int numChannels() { return channels; }
 
-	unsigned int get() { return texture; }
+	// While loading in the background this is the placeholder's texture
+	unsigned int get() { return ready ? texture : (placeholder ? placeholder->get() : 0); }
+
+	// False while TextureLoader is still decoding or uploading it
+	bool isReady() const { return ready; }
+
+	// Whether this GPU can sample a CTEXTURE_FORMAT_*. Block compressed formats need extensions on GL 3.3
+	static bool isFormatSupported(unsigned int format);
 
 	static std::vector<unsigned char> getHeightMapData(std::string path, int* hWidth, int* hHeight);
 
 	bool load(std::string path);
+	bool loadCooked(std::string path); // .ctex from colecook, every mip level is uploaded as stored
 	bool loadEmbedded(aiTexel* textureData, unsigned int _width, unsigned int _height);
 	void unload();
 
 	void bind();
 	void unbind();
 private:
+	friend class TextureLoader;
 
 	unsigned char* data;
 	int width;
@@ -42,6 +52,9 @@ private:
 	int channels;
 
 	unsigned int texture;
+
+	bool ready;
+	Texture* placeholder; // Drawn instead until ready
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,773 @@
+#include "TextureLoader.h"
+
+#include <algorithm>
+#include <cstring>
+#include <cctype>
+
+#include "glew.h"
+#include "stb_image.h"
+#include "Texture.h"
+#include "CTexture.h"
+#include "BlockCompression.h"
+#include "Logging.h"
+
+// Decoding is mostly waiting on the disk and inflating, a couple of threads keeps up with the upload budget
+#define TEXTURE_DECODE_THREADS 2
+
+// Bands start on this within an upload buffer
+#define TEXTURE_UPLOAD_ALIGNMENT 16
+
+
+TextureLoader::Job::~Job()
+{
+    if (image)
+        stbi_image_free(image);
+}
+
+
+TextureLoader::TextureLoader()
+    : decoding(0), stopping(false), ringIndex(0), bytesUploaded(0), frame(0), budget(TEXTURE_BUDGET_DEFAULT), residentBytes(0),
+      streamRequests(0), decodePool(TEXTURE_DECODE_THREADS)
+{
+}
+
+
+TextureLoader::~TextureLoader()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+
+    // Let the decodes already running finish, queued ones return straight away
+    while (true)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            if (decoding == 0)
+                break;
+        }
+
+        std::this_thread::yield();
+    }
+
+    for (Job* job : decoded)
+        delete job;
+
+    for (Job* job : uploading)
+    {
+        // Streamed levels belong to a texture that is still alive
+        if (!job->stream)
+            glDeleteTextures(1, &job->glTexture);
+
+        delete job;
+    }
+
+    for (UploadBuffer& buffer : ring)
+    {
+        if (buffer.fence)
+            glDeleteSync(static_cast<GLsync>(buffer.fence));
+
+        glDeleteBuffers(1, &buffer.pbo);
+    }
+}
+
+
+void TextureLoader::load(Texture* texture, Texture* placeholder, const std::string& src, const std::string& cooked)
+{
+    texture->ready = false;
+    texture->placeholder = placeholder;
+
+    Job* job = new Job();
+    job->texture = texture;
+    job->src = src;
+    job->cooked = cooked;
+
+    submit(job);
+}
+
+
+void TextureLoader::submit(Job* job)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queued.push_back(job);
+        decoding++;
+    }
+
+    decodePool.submit([this, job]()
+    {
+        bool skip;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            skip = stopping;
+        }
+
+        if (!skip)
+            decode(*job);
+
+        std::lock_guard<std::mutex> lock(mutex);
+
+        queued.erase(std::find(queued.begin(), queued.end(), job));
+
+        if (skip)
+            delete job;
+        else
+            decoded.push_back(job);
+
+        decoding--;
+    });
+}
+
+
+void TextureLoader::request(Texture* texture, unsigned int level)
+{
+    auto found = residency.find(texture);
+
+    if (found == residency.end())
+        return;
+
+    Residency& r = found->second;
+
+    if (r.lastUsed != frame)
+    {
+        r.lastUsed = frame;
+        r.wanted = level;
+    }
+    else
+    {
+        r.wanted = std::min(r.wanted, level);
+    }
+}
+
+
+void TextureLoader::cancel(Texture* texture)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        // Decoding doesn't touch the texture, the job just has nowhere to go once it's done
+        for (Job* job : queued)
+        {
+            if (job->texture == texture)
+                job->texture = nullptr;
+        }
+
+        for (Job* job : decoded)
+        {
+            if (job->texture == texture)
+                job->texture = nullptr;
+        }
+    }
+
+    for (auto it = uploading.begin(); it != uploading.end();)
+    {
+        if ((*it)->texture == texture)
+        {
+            discard(*it);
+            it = uploading.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    auto found = residency.find(texture);
+
+    if (found != residency.end())
+    {
+        residentBytes -= found->second.bytes;
+        residency.erase(found);
+    }
+}
+
+
+void TextureLoader::discard(Job* job)
+{
+    // Streamed levels went into the texture's own GL texture, deleted along with it
+    if (!job->stream && job->glTexture)
+        glDeleteTextures(1, &job->glTexture);
+
+    delete job;
+}
+
+
+unsigned long long TextureLoader::getTextureBytes(Texture* texture) const
+{
+    auto found = residency.find(texture);
+
+    return found != residency.end() ? found->second.bytes : 0;
+}
+
+
+static bool isHDR(const std::string& path)
+{
+    size_t dot = path.find_last_of('.');
+
+    if (dot == std::string::npos)
+        return false;
+
+    std::string ext = path.substr(dot + 1);
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+
+    return ext == "hdr";
+}
+
+
+void TextureLoader::decode(Job& job)
+{
+    // Levels streamed in come straight from a mapping that is already open. Touch every page here
+    // so the GL thread doesn't stall on reading them from disk
+    if (job.stream)
+    {
+        volatile unsigned char sink = 0;
+
+        for (const Level& level : job.levels)
+        {
+            size_t size = textureLevelSize(job.format, level.width, level.height);
+
+            for (size_t i = 0; i < size; i += 4096)
+                sink += level.pixels[i];
+        }
+
+        return;
+    }
+
+    if (!job.cooked.empty())
+    {
+        CTextureHeader header;
+        const CTextureLevel* levels = nullptr;
+
+        job.file = std::make_shared<MappedFile>();
+
+        if (job.file->open(job.cooked) && readCookedTexture(*job.file, header, levels) && Texture::isFormatSupported(header.format))
+        {
+            job.channels = header.channels;
+            job.format = header.format;
+            job.table.assign(levels, levels + header.nLevels);
+
+            // Start from the small mips, larger ones stream in once something draws the texture
+            job.firstLevel = header.nLevels - 1;
+
+            while (job.firstLevel > 0 && std::max(levels[job.firstLevel - 1].width, levels[job.firstLevel - 1].height) <= TEXTURE_RESIDENT_TAIL)
+                job.firstLevel--;
+
+            for (unsigned int i = job.firstLevel; i < header.nLevels; i++)
+            {
+                Level level;
+                level.width = levels[i].width;
+                level.height = levels[i].height;
+                level.pixels = job.file->data() + levels[i].offset;
+
+                job.levels.push_back(level);
+            }
+
+            return;
+        }
+
+        // Warnings go through the GL thread with the result, the log isn't shared between threads
+        job.file.reset();
+    }
+
+    int width = 0, height = 0;
+
+    if (isHDR(job.src))
+    {
+        // Kept linear like the cooked BC6H version, so the sky looks the same either way
+        float* pixels = stbi_loadf(job.src.c_str(), &width, &height, &job.channels, 4);
+
+        if (!pixels)
+        {
+            job.failed = true;
+            return;
+        }
+
+        job.halfPixels.resize(static_cast<size_t>(width) * height * 4);
+
+        for (size_t i = 0; i < job.halfPixels.size(); i++)
+            job.halfPixels[i] = floatToHalf(pixels[i]);
+
+        stbi_image_free(pixels);
+
+        job.format = CTEXTURE_FORMAT_RGBA16F;
+    }
+    else
+    {
+        // Always RGBA, rows stay 4 byte aligned for the unpack buffer
+        job.image = stbi_load(job.src.c_str(), &width, &height, &job.channels, 4);
+
+        if (!job.image)
+        {
+            job.failed = true;
+            return;
+        }
+
+        job.format = CTEXTURE_FORMAT_RGBA8;
+    }
+
+    Level level;
+    level.width = static_cast<unsigned int>(width);
+    level.height = static_cast<unsigned int>(height);
+    level.pixels = job.image ? job.image : reinterpret_cast<const unsigned char*>(job.halfPixels.data());
+
+    job.levels.push_back(level);
+}
+
+
+void TextureLoader::allocate(Job& job)
+{
+    if (job.stream)
+    {
+        glBindTexture(GL_TEXTURE_2D, job.glTexture);
+    }
+    else
+    {
+        glGenTextures(1, &job.glTexture);
+        glBindTexture(GL_TEXTURE_2D, job.glTexture);
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, (int)GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, (int)GL_LINEAR_MIPMAP_LINEAR);
+
+        // Cooked textures bring their own mips, and may start partway down them
+        if (job.file)
+        {
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, static_cast<GLint>(job.firstLevel));
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(job.table.size() - 1));
+        }
+    }
+
+    const CTextureFormat* format = getTextureFormat(job.format);
+
+    // Storage only, the contents arrive in bands. Streamed levels sit above the base level so they
+    // aren't sampled until they are complete
+    for (unsigned int i = 0; i < job.levels.size(); i++)
+    {
+        const Level& level = job.levels[i];
+        unsigned int glLevel = job.firstLevel + i;
+
+        if (format->compressed)
+        {
+            glCompressedTexImage2D(GL_TEXTURE_2D, glLevel, format->glInternalFormat, level.width, level.height, 0,
+                textureLevelSize(job.format, level.width, level.height), nullptr);
+        }
+        else
+        {
+            glTexImage2D(GL_TEXTURE_2D, glLevel, (GLint)format->glInternalFormat, level.width, level.height, 0, format->glFormat, format->glType, nullptr);
+        }
+    }
+
+    job.allocated = true;
+}
+
+
+void TextureLoader::finish(Job& job)
+{
+    glBindTexture(GL_TEXTURE_2D, job.glTexture);
+
+    unsigned long long bytes = 0;
+
+    for (const Level& level : job.levels)
+        bytes += textureLevelSize(job.format, level.width, level.height);
+
+    if (job.stream)
+    {
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, static_cast<GLint>(job.firstLevel));
+
+        auto found = residency.find(job.texture);
+
+        if (found != residency.end())
+        {
+            found->second.base = job.firstLevel;
+            found->second.bytes += bytes;
+            found->second.streaming = false;
+        }
+
+        residentBytes += bytes;
+
+        job.texture->resized();
+        return;
+    }
+
+    Residency r;
+
+    if (job.file)
+    {
+        r.file = job.file;
+        r.table = job.table;
+        r.base = job.firstLevel;
+        r.tail = job.firstLevel;
+    }
+    else
+    {
+        glGenerateMipmap(GL_TEXTURE_2D);
+
+        // Plus a third for the generated mips
+        bytes += bytes / 3;
+    }
+
+    r.format = job.format;
+    r.bytes = bytes;
+    r.wanted = r.base;
+    r.lastUsed = frame;
+
+    Texture* texture = job.texture;
+
+    // A texture loaded twice drops the first result
+    auto previous = residency.find(texture);
+
+    if (previous != residency.end())
+        residentBytes -= previous->second.bytes;
+
+    glDeleteTextures(1, &texture->texture);
+
+    residency[texture] = r;
+    residentBytes += bytes;
+
+    texture->texture = job.glTexture;
+    texture->width = job.file ? job.table[0].width : job.levels[0].width;
+    texture->height = job.file ? job.table[0].height : job.levels[0].height;
+    texture->channels = job.channels;
+    texture->ready = true;
+    texture->placeholder = nullptr;
+
+    job.glTexture = 0;
+
+    texture->resized();
+}
+
+
+void TextureLoader::trim(Texture* texture, Residency& r, unsigned int level)
+{
+    const CTextureFormat* format = getTextureFormat(r.format);
+
+    glBindTexture(GL_TEXTURE_2D, texture->texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, static_cast<GLint>(level));
+
+    // No way to free a single level in GL 3.3, but redefining it as empty lets the driver release it
+    for (unsigned int i = r.base; i < level; i++)
+    {
+        if (format->compressed)
+            glCompressedTexImage2D(GL_TEXTURE_2D, i, format->glInternalFormat, 0, 0, 0, 0, nullptr);
+        else
+            glTexImage2D(GL_TEXTURE_2D, i, (GLint)format->glInternalFormat, 0, 0, 0, format->glFormat, format->glType, nullptr);
+
+        r.bytes -= r.table[i].size;
+        residentBytes -= r.table[i].size;
+    }
+
+    r.base = level;
+
+    texture->resized();
+}
+
+
+bool TextureLoader::evict(unsigned long long needed, const Residency* keep)
+{
+    if (residentBytes + needed <= budget)
+        return true;
+
+    std::vector<std::pair<Texture*, Residency*>> candidates;
+
+    for (auto& it : residency)
+    {
+        Residency& r = it.second;
+
+        if (r.file && !r.streaming && r.base < r.tail && &r != keep)
+            candidates.push_back({ it.first, &r });
+    }
+
+    // Least recently used first
+    std::sort(candidates.begin(), candidates.end(), [](const std::pair<Texture*, Residency*>& a, const std::pair<Texture*, Residency*>& b)
+    {
+        return a.second->lastUsed < b.second->lastUsed;
+    });
+
+    for (auto& candidate : candidates)
+    {
+        Residency& r = *candidate.second;
+
+        // Drawn last frame, only what it has beyond what it asked for can go
+        unsigned int limit = r.lastUsed == frame ? std::min(r.wanted, r.tail) : r.tail;
+
+        while (r.base < limit && residentBytes + needed > budget)
+            trim(candidate.first, r, r.base + 1);
+
+        if (residentBytes + needed <= budget)
+            return true;
+    }
+
+    return false;
+}
+
+
+void TextureLoader::stream()
+{
+    std::vector<std::pair<Texture*, Residency*>> wanting;
+
+    for (auto& it : residency)
+    {
+        Residency& r = it.second;
+
+        if (r.file && r.lastUsed == frame && r.wanted < r.base)
+            wanting.push_back({ it.first, &r });
+    }
+
+    streamRequests = static_cast<unsigned int>(wanting.size());
+
+    // Furthest from what they asked for first
+    std::sort(wanting.begin(), wanting.end(), [](const std::pair<Texture*, Residency*>& a, const std::pair<Texture*, Residency*>& b)
+    {
+        return a.second->base - a.second->wanted > b.second->base - b.second->wanted;
+    });
+
+    for (auto& it : wanting)
+    {
+        Texture* texture = it.first;
+        Residency& r = *it.second;
+
+        if (r.streaming)
+            continue;
+
+        // One level at a time, so every texture on screen sharpens a step before any gets two
+        unsigned int level = r.base - 1;
+
+        if (!evict(r.table[level].size, &r))
+            break;
+
+        Job* job = new Job();
+        job->texture = texture;
+        job->stream = true;
+        job->format = r.format;
+        job->file = r.file;
+        job->firstLevel = level;
+        job->glTexture = texture->texture;
+
+        Level next;
+        next.width = r.table[level].width;
+        next.height = r.table[level].height;
+        next.pixels = r.file->data() + r.table[level].offset;
+        job->levels.push_back(next);
+
+        r.streaming = true;
+
+        submit(job);
+    }
+
+    // The budget may have been lowered
+    evict(0, nullptr);
+}
+
+
+void TextureLoader::update(std::vector<Texture*>& finished)
+{
+    bytesUploaded = 0;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        for (Job* job : decoded)
+        {
+            if (!job->texture)
+            {
+                discard(job);
+                continue;
+            }
+
+            if (job->failed)
+            {
+                Log::warning("Failed to load texture: " + job->src);
+                delete job;
+                continue;
+            }
+
+            if (!job->cooked.empty() && !job->file)
+                Log::warning("Cooked texture is damaged, from another version or unsupported by the GPU, loaded source: " + job->src);
+
+            uploading.push_back(job);
+        }
+
+        decoded.clear();
+    }
+
+    stream();
+    upload(finished);
+
+    // Requests made while drawing from here on belong to the next frame
+    frame++;
+}
+
+
+void TextureLoader::upload(std::vector<Texture*>& finished)
+{
+    if (uploading.empty())
+        return;
+
+    if (!ring[0].pbo)
+    {
+        for (UploadBuffer& buffer : ring)
+        {
+            glGenBuffers(1, &buffer.pbo);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer.pbo);
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, TEXTURE_UPLOAD_BUDGET, nullptr, GL_STREAM_DRAW);
+        }
+
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+
+    UploadBuffer& buffer = ring[ringIndex];
+
+    // The GPU is still reading this buffer from a few frames ago. Try again next frame rather than stall
+    if (buffer.fence)
+    {
+        GLenum status = glClientWaitSync(static_cast<GLsync>(buffer.fence), 0, 0);
+
+        if (status == GL_TIMEOUT_EXPIRED)
+            return;
+
+        glDeleteSync(static_cast<GLsync>(buffer.fence));
+        buffer.fence = nullptr;
+    }
+
+    struct Band
+    {
+        Job* job;
+        unsigned int level;
+        unsigned int row;
+        unsigned int rows;
+        size_t offset;
+    };
+
+    std::vector<Band> bands;
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer.pbo);
+
+    unsigned char* mapped = static_cast<unsigned char*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, TEXTURE_UPLOAD_BUDGET,
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+
+    if (!mapped)
+    {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        return;
+    }
+
+    size_t used = 0;
+    bool full = false;
+
+    // Oldest first, as many whole rows as fit
+    for (Job* job : uploading)
+    {
+        while (job->level < job->levels.size())
+        {
+            const Level& level = job->levels[job->level];
+            const CTextureFormat* format = getTextureFormat(job->format);
+
+            size_t rowBytes = ((level.width + format->blockSize - 1) / format->blockSize) * format->blockBytes;
+            unsigned int levelRows = (level.height + format->blockSize - 1) / format->blockSize;
+
+            size_t rows = std::min<size_t>(levelRows - job->row, (TEXTURE_UPLOAD_BUDGET - used) / rowBytes);
+
+            if (rows == 0)
+            {
+                full = true;
+                break;
+            }
+
+            memcpy(mapped + used, level.pixels + job->row * rowBytes, rows * rowBytes);
+
+            bands.push_back({ job, job->level, job->row, static_cast<unsigned int>(rows), used });
+
+            used = (used + rows * rowBytes + TEXTURE_UPLOAD_ALIGNMENT - 1) & ~static_cast<size_t>(TEXTURE_UPLOAD_ALIGNMENT - 1);
+            used = std::min<size_t>(used, TEXTURE_UPLOAD_BUDGET);
+
+            job->row += static_cast<unsigned int>(rows);
+
+            if (job->row == levelRows)
+            {
+                job->level++;
+                job->row = 0;
+            }
+        }
+
+        if (full)
+            break;
+    }
+
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+    // With an unpack buffer bound a null pointer is an offset into it, so allocate without one
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    for (const Band& band : bands)
+    {
+        if (!band.job->allocated)
+            allocate(*band.job);
+    }
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer.pbo);
+
+    for (const Band& band : bands)
+    {
+        const Level& level = band.job->levels[band.level];
+        const CTextureFormat* format = getTextureFormat(band.job->format);
+
+        unsigned int y = band.row * format->blockSize;
+        unsigned int height = std::min(band.rows * format->blockSize, level.height - y);
+        unsigned int size = ((level.width + format->blockSize - 1) / format->blockSize) * format->blockBytes * band.rows;
+
+        glBindTexture(GL_TEXTURE_2D, band.job->glTexture);
+
+        // Whole rows of blocks, so only the last band of a level ends off the block grid
+        if (format->compressed)
+        {
+            glCompressedTexSubImage2D(GL_TEXTURE_2D, band.job->firstLevel + band.level, 0, y, level.width, height, format->glInternalFormat, size,
+                reinterpret_cast<const void*>(band.offset));
+        }
+        else
+        {
+            glTexSubImage2D(GL_TEXTURE_2D, band.job->firstLevel + band.level, 0, y, level.width, height, format->glFormat, format->glType,
+                reinterpret_cast<const void*>(band.offset));
+        }
+
+        bytesUploaded += size;
+    }
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    buffer.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    ringIndex = (ringIndex + 1) % TEXTURE_UPLOAD_BUFFERS;
+
+    for (auto it = uploading.begin(); it != uploading.end();)
+    {
+        Job* job = *it;
+
+        if (job->level < job->levels.size())
+        {
+            ++it;
+            continue;
+        }
+
+        // Commands after the uploads in the same context see the data, no need to wait on the fence
+        finish(*job);
+
+        if (!job->stream)
+            finished.push_back(job->texture);
+
+        delete job;
+        it = uploading.erase(it);
+    }
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+
+unsigned int TextureLoader::getPending()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    return decoding + static_cast<unsigned int>(decoded.size() + uploading.size());
+}
@@ -0,0 +1,203 @@
+#pragma once
+
+#ifndef _TEXTURE_LOADER
+#define _TEXTURE_LOADER
+
+#include <string>
+#include <vector>
+#include <list>
+#include <mutex>
+#include <memory>
+#include <unordered_map>
+#include <cstdint>
+
+#include "ThreadPool.h"
+#include "MappedFile.h"
+#include "CTexture.h"
+
+class Texture;
+
+// Bytes copied into the upload ring per frame. Bigger textures are spread over several frames
+#define TEXTURE_UPLOAD_BUDGET (8 * 1024 * 1024)
+
+// Pixel buffers in the upload ring. A buffer is reused once the GPU has finished reading it
+#define TEXTURE_UPLOAD_BUFFERS 3
+
+// Texture memory the loader aims to stay under, can be changed at runtime
+#define TEXTURE_BUDGET_DEFAULT (256ull * 1024 * 1024)
+
+// Cooked mips this size and smaller are loaded up front and never evicted
+#define TEXTURE_RESIDENT_TAIL 128
+
+// Levels sharper than the screen size asks for, UV density across a mesh isn't uniform
+#define TEXTURE_DETAIL_BIAS 1
+
+
+// Loads textures in the background. Files are decoded on worker threads, then copied into a ring of
+// pixel unpack buffers a budgeted number of bytes per frame and uploaded from there.
+//
+// Cooked textures are streamed. Only their small mips are loaded at first, larger ones are added as
+// draws ask for them and dropped again least recently used first when over the memory budget.
+// GL_TEXTURE_BASE_LEVEL keeps sampling to the resident mips. Textures loaded from source are
+// always fully resident, there are no mips on disk to stream them from.
+class TextureLoader
+{
+public:
+	TextureLoader();
+	~TextureLoader();
+
+	TextureLoader(const TextureLoader&) = delete;
+	TextureLoader& operator=(const TextureLoader&) = delete;
+
+	// Queue a texture to load from src, or from the cooked .ctex file if cooked isn't empty.
+	// It draws as placeholder until it is ready
+	void load(Texture* texture, Texture* placeholder, const std::string& src, const std::string& cooked);
+
+	// Upload decoded textures within the frame budget. GL thread, once per frame.
+	// Textures that became ready are added to finished
+	void update(std::vector<Texture*>& finished);
+
+	// Mips down to level are needed to draw the texture this frame. Called for every draw, so cheap
+	void request(Texture* texture, unsigned int level);
+
+	// Forget a texture before deleting it. Its loads still in flight are dropped when they arrive
+	void cancel(Texture* texture);
+
+	// Resident levels of one texture, 0 until it is loaded
+	unsigned long long getTextureBytes(Texture* texture) const;
+
+	// Textures queued, decoding or uploading, including mips being streamed in
+	unsigned int getPending();
+
+	// Bytes uploaded by the last update
+	unsigned long long getBytesUploaded() const { return bytesUploaded; }
+
+	void setBudget(unsigned long long bytes) { budget = bytes; }
+	unsigned long long getBudget() const { return budget; }
+
+	// Every level of every loaded texture
+	unsigned long long getResidentBytes() const { return residentBytes; }
+
+	// Textures drawn last frame with less detail than they asked for
+	unsigned int getStreamRequests() const { return streamRequests; }
+
+private:
+	// Pixels or blocks of one mip level, in the job's format
+	struct Level
+	{
+		unsigned int width = 0;
+		unsigned int height = 0;
+		const unsigned char* pixels = nullptr;
+	};
+
+	struct Job
+	{
+		~Job();
+
+		Texture* texture = nullptr; // Null once cancelled
+		std::string src;
+		std::string cooked;
+
+		bool failed = false;
+		int channels = 0; // Of the source image
+		uint32_t format = 0; // CTEXTURE_FORMAT_*
+
+		// Just the base level for source images, their mips are generated after the upload
+		std::vector<Level> levels;
+
+		// GL level of levels[0]. Cooked textures start from their resident tail
+		unsigned int firstLevel = 0;
+
+		// Adds levels to a texture that is already drawn instead of creating it
+		bool stream = false;
+
+		// Owners of the level pixels, only one is used
+		unsigned char* image = nullptr;   // From stb_image
+		std::vector<uint16_t> halfPixels; // HDR sources, converted to half floats
+		std::shared_ptr<MappedFile> file; // Cooked levels are copied straight from the mapping
+
+		// Every level of a cooked texture, kept to stream the rest later
+		std::vector<CTextureLevel> table;
+
+		// Upload progress. Rows are rows of blocks for compressed formats
+		unsigned int glTexture = 0;
+		bool allocated = false;
+		unsigned int level = 0;
+		unsigned int row = 0;
+	};
+
+	// Mips of a loaded texture
+	struct Residency
+	{
+		std::shared_ptr<MappedFile> file; // Null if loaded from source
+		uint32_t format = 0;
+		std::vector<CTextureLevel> table;
+
+		unsigned int base = 0;  // Most detailed resident level
+		unsigned int tail = 0;  // Levels from here on are never evicted
+		unsigned long long bytes = 0;
+
+		unsigned int wanted = 0;   // Most detailed level asked for in lastUsed
+		unsigned int lastUsed = 0; // Frame
+		bool streaming = false;    // Levels on their way in
+	};
+
+	struct UploadBuffer
+	{
+		unsigned int pbo = 0;
+		void* fence = nullptr; // GLsync of the uploads that read it
+	};
+
+	// Hand a job to the decode threads
+	void submit(Job* job);
+
+	// Worker thread side
+	static void decode(Job& job);
+
+	// Queue more detail for textures that asked for it and evict to stay in budget
+	void stream();
+
+	// Drop the least recently used mips until needed more bytes fit in the budget. Mips wanted this
+	// frame are kept. False if it couldn't free enough
+	bool evict(unsigned long long needed, const Residency* keep);
+
+	// Release levels above level, leaving level the most detailed
+	void trim(Texture* texture, Residency& residency, unsigned int level);
+
+	// Copy decoded jobs through the ring into their textures
+	void upload(std::vector<Texture*>& finished);
+
+	// Create the texture and allocate every level
+	void allocate(Job& job);
+
+	// Make the texture drawable
+	void finish(Job& job);
+
+	// Drop a cancelled job, and its GL texture unless it belonged to the deleted texture
+	void discard(Job* job);
+
+	std::mutex mutex;
+	std::vector<Job*> queued;  // Submitted to the decode threads, guarded by mutex
+	std::vector<Job*> decoded; // Waiting for the GL thread, guarded by mutex
+	unsigned int decoding;     // Guarded by mutex
+	bool stopping;             // Guarded by mutex, queued decodes are skipped
+
+	std::list<Job*> uploading; // GL thread only, oldest first
+
+	UploadBuffer ring[TEXTURE_UPLOAD_BUFFERS];
+	unsigned int ringIndex;
+
+	unsigned long long bytesUploaded;
+
+	std::unordered_map<Texture*, Residency> residency; // GL thread only
+
+	unsigned int frame;
+	unsigned long long budget;
+	unsigned long long residentBytes;
+	unsigned int streamRequests;
+
+	// Last so its workers are joined before anything they write to goes away
+	ThreadPool decodePool;
+};
+
+#endif
@@ -0,0 +1,154 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+
+
+ThreadPool::ThreadPool(unsigned int threads)
+    : stopping(false)
+{
+    if (threads == 0)
+    {
+        unsigned int hw = std::thread::hardware_concurrency();
+
+        // Leave a core for the main thread
+        threads = hw > 1 ? hw - 1 : 1;
+    }
+
+    for (unsigned int i = 0; i < threads; i++)
+        workers.emplace_back(&ThreadPool::workerLoop, this);
+}
+
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+
+    condition.notify_all();
+
+    for (std::thread& worker : workers)
+        worker.join();
+}
+
+
+void ThreadPool::workerLoop()
+{
+    while (true)
+    {
+        std::packaged_task<void()> job;
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [this]() { return stopping || !jobs.empty(); });
+
+            // Finish queued work before shutting down
+            if (stopping && jobs.empty())
+                return;
+
+            job = std::move(jobs.front());
+            jobs.pop();
+        }
+
+        job();
+    }
+}
+
+
+std::future<void> ThreadPool::submit(std::function<void()> job)
+{
+    std::packaged_task<void()> task(std::move(job));
+    std::future<void> result = task.get_future();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push(std::move(task));
+    }
+
+    condition.notify_one();
+
+    return result;
+}
+
+
+void ThreadPool::parallelFor(unsigned int count, unsigned int grainSize, const std::function<void(unsigned int begin, unsigned int end)>& func)
+{
+    if (count == 0)
+        return;
+
+    grainSize = std::max(grainSize, 1u);
+
+    unsigned int nRanges = (count + grainSize - 1) / grainSize;
+
+    // Not worth waking the workers
+    if (nRanges == 1)
+    {
+        func(0, count);
+        return;
+    }
+
+    // Ranges are claimed from a shared counter so fast threads take more of them
+    std::atomic<unsigned int> next(0);
+
+    auto runRanges = [&]()
+    {
+        unsigned int range;
+
+        while ((range = next.fetch_add(1)) < nRanges)
+        {
+            unsigned int begin = range * grainSize;
+            unsigned int end = std::min(begin + grainSize, count);
+
+            func(begin, end);
+        }
+    };
+
+    unsigned int nHelpers = std::min(nRanges - 1, numThreads());
+
+    std::vector<std::future<void>> helpers;
+    helpers.reserve(nHelpers);
+
+    for (unsigned int i = 0; i < nHelpers; i++)
+        helpers.push_back(submit(runRanges));
+
+    // Calling thread works too instead of just waiting
+    runRanges();
+
+    // Run other queued jobs while waiting. When parallelFor is called from inside a job, the helpers
+    // may be queued behind jobs whose workers are all waiting too, so someone has to run them
+    for (std::future<void>& helper : helpers)
+    {
+        while (helper.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        {
+            // Nothing queued means a worker already took the helper, it can't be blocked on us
+            if (!runPendingJob())
+            {
+                helper.wait();
+                break;
+            }
+        }
+    }
+}
+
+
+bool ThreadPool::runPendingJob()
+{
+    std::packaged_task<void()> job;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        if (jobs.empty())
+            return false;
+
+        job = std::move(jobs.front());
+        jobs.pop();
+    }
+
+    job();
+
+    return true;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#ifndef _THREAD_POOL
+#define _THREAD_POOL
+
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+
+
+// Fixed set of worker threads that run queued jobs
+class ThreadPool
+{
+public:
+	// 0 threads uses one less than the number of hardware threads
+	explicit ThreadPool(unsigned int threads = 0);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	// Queue a job. The future becomes ready once it has run
+	std::future<void> submit(std::function<void()> job);
+
+	// Split [0, count) into ranges and run them on the workers and the calling thread.
+	// Blocks until every range is done. Can be called from inside a job.
+	void parallelFor(unsigned int count, unsigned int grainSize, const std::function<void(unsigned int begin, unsigned int end)>& func);
+
+	unsigned int numThreads() const { return static_cast<unsigned int>(workers.size()); }
+
+private:
+	void workerLoop();
+
+	// Pop and run one queued job on the calling thread. False if the queue was empty
+	bool runPendingJob();
+
+	std::vector<std::thread> workers;
+	std::queue<std::packaged_task<void()>> jobs;
+
+	std::mutex mutex;
+	std::condition_variable condition;
+
+	bool stopping;
+};
+
+#endif
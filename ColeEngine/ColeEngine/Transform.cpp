@@ -83,3 +83,18 @@ glm::mat4 Perspective(const float rx, const float ry,
 }
 
 
+// Returns the axis aligned bounds of a box after transforming it by M
+void TransformAABB(const glm::mat4& M, const glm::vec3& boxMin, const glm::vec3& boxMax, glm::vec3& outMin, glm::vec3& outMax)
+{
+    glm::vec3 center = (boxMin + boxMax) * 0.5f;
+    glm::vec3 extents = (boxMax - boxMin) * 0.5f;
+
+    // Extents of the rotated box along each world axis
+    glm::mat3 absM = glm::mat3(glm::abs(glm::vec3(M[0])), glm::abs(glm::vec3(M[1])), glm::abs(glm::vec3(M[2])));
+
+    glm::vec3 worldCenter = glm::vec3(M * glm::vec4(center, 1.0f));
+    glm::vec3 worldExtents = absM * extents;
+
+    outMin = worldCenter - worldExtents;
+    outMax = worldCenter + worldExtents;
+}
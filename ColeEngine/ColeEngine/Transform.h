@@ -24,6 +24,9 @@ glm::mat4 LookAt(const glm::vec3 E, const glm::vec3 C, const glm::vec3 U);
 
 float* Pntr(glm::mat4& m);
 
+// Bounds of a transformed axis aligned box
+void TransformAABB(const glm::mat4& M, const glm::vec3& boxMin, const glm::vec3& boxMax, glm::vec3& outMin, glm::vec3& outMax);
+
 
 
 
@@ -1,5 +1,6 @@
 #include "UI.h"
 #include "PointLight.h"
+#include "ShaderCache.h"
 
 
 UI::UI(Engine& _engine)
@@ -36,6 +37,39 @@ void UI::sceneLighting_draw()
         ImGui::Text(" %.2f minDepth; %.2f dist;", engine.getWorld().minDepth, engine.getWorld().dist);
         ImGui::NewLine();
 
+        ImGui::Text(" %u frames readback latency;", engine.debug.readbackLatency);
+        ImGui::NewLine();
+
+        ImGui::Text(" %u draws; %u sub-meshes culled; %u entities culled;", engine.stats.drawCalls, 
+            engine.stats.subMeshesCulled, engine.stats.entitiesCulled);
+        ImGui::Text(" %u material uploads; %u material binds;", engine.stats.materialUploads, engine.stats.materialBinds);
+        ImGui::Text(" %u shaders from binary cache; %u compiled;", ShaderCache::getHits(), ShaderCache::getMisses());
+        ImGui::Text(" %u textures loading; %.1f MB uploaded;", engine.Resource().getTexturesLoading(), 
+            engine.Resource().getTextureBytesUploaded() / (1024.0 * 1024.0));
+        ImGui::Text(" %.1f / %.0f MB textures resident; %u waiting for mips;", engine.Resource().getTextureResidentBytes() / (1024.0 * 1024.0), 
+            engine.Resource().getTextureBudget() / (1024.0 * 1024.0), engine.Resource().getTextureStreamRequests());
+
+        int textureBudget = static_cast<int>(engine.Resource().getTextureBudget() / (1024 * 1024));
+        if (ImGui::SliderInt("Texture budget (MB)", &textureBudget, 32, 2048))
+            engine.Resource().setTextureBudget(static_cast<unsigned long long>(textureBudget) * 1024 * 1024);
+        ImGui::Text(" %u unused resources cached; %.1f / %.0f MB;", engine.Resource().getCachedCount(),
+            engine.Resource().getCachedBytes() / (1024.0 * 1024.0), engine.Resource().getCacheCapacity() / (1024.0 * 1024.0));
+        ImGui::Text(" %u shadow draws; %u shadow casters culled; %u static caches redrawn;", engine.stats.shadowDraws, 
+            engine.stats.shadowCastersCulled, engine.stats.staticShadowUpdates);
+        ImGui::Text(" %u point lights; %u cluster light refs; %u max per cluster;", 
+            static_cast<unsigned int>(engine.getWorld().pointLights.size()), engine.stats.clusterLightRefs, engine.stats.maxClusterLights);
+        ImGui::Text(" %u shadow faces drawn; %u forced;", engine.stats.shadowFacesUpdated, engine.stats.shadowFacesForced);
+        ImGui::SliderInt("Shadow face budget", &engine.debug.shadowFaceBudget, 1, 96);
+        ImGui::Text(" %.0f%% shadow atlas used; %.1f MB;", engine.stats.shadowAtlasOccupancy * 100.0f, 
+            engine.stats.shadowAtlasBytes / (1024.0 * 1024.0));
+
+        for (PointLight* light : engine.getWorld().pointLights)
+        {
+            ImGui::Text(" %s: %.3f priority; %u frames stale; %d tile;", light->getName().c_str(), light->shadowPriority, 
+                light->getShadowStaleness(), light->shadowTiles[0].size);
+        }
+        ImGui::NewLine();
+
         ImGui::SliderFloat("Light X: ", &engine.getWorld().lightPos.x, -70.0f, 70.0f);
         ImGui::SliderFloat("Light Y: ", &engine.getWorld().lightPos.y, -70.0f, 70.0f);
         ImGui::SliderFloat("Light Z: ", &engine.getWorld().lightPos.z, -70.0f, 70.0f);
@@ -167,6 +201,13 @@ void UI::transformComp_draw()
     if (ImGui::SliderFloat("scale Y: ", &transform->scl.y, -10.0f, 10.0f)) engine.onSelect = true;
     if (ImGui::SliderFloat("scale Z: ", &transform->scl.z, -10.0f, 10.0f)) engine.onSelect = true;
 
+    // Moving between the static and dynamic caster sets changes every shadow cache
+    if (ImGui::Checkbox("Static", &transform->isStatic))
+    {
+        for (PointLight* light : engine.getWorld().pointLights)
+            light->invalidateStaticShadows();
+    }
+
     ImGui::NewLine();
 }
 
@@ -192,13 +233,25 @@ void UI::pointLightComp_draw()
 
     ImGui::SliderFloat("Far Plane", &pnt->farPlane, 10.1f, 200.0f);
 
+    for (PointLight* light : engine.getWorld().pointLights)
+    {
+        if (light != engine.selectedEntity)
+            continue;
+
+        ImGui::NewLine();
+
+        ImGui::Text("Shadow staleness: %u frames", light->getShadowStaleness());
+
+        if (ImGui::Button("Update Shadows"))
+            light->forceShadowUpdate();
+    }
 }
 
 void UI::terrainComp_draw()
 {
     TerrainComponent* terrain = engine.selectedEntity->getComponent<TerrainComponent>();
     RenderComponent* render = engine.selectedEntity->getComponent<RenderComponent>();
-    MeshTerrain* mesh = reinterpret_cast<MeshTerrain*>(render->mesh);
+    MeshTerrain* mesh = static_cast<MeshTerrain*>(render->mesh.get());
 
     if (!mesh)
         return;
@@ -248,7 +301,7 @@ void UI::renderComp_draw()
         mat = render->materials[0];
 
         unsigned int nSlots = render->materials.size();
-        std::vector<Material*>& materials = render->materials;
+        std::vector<Handle<Material>>& materials = render->materials;
 
         ImGui::Text("Material Slots");
         
@@ -315,7 +368,8 @@ void UI::renderComp_draw()
         // Edit color parameters
         for (auto& it : mat->vColor)
         {
-            ImGui::ColorEdit3(it.first.c_str(), reinterpret_cast<float*>(&it.second));
+            if (ImGui::ColorEdit3(it.first.c_str(), reinterpret_cast<float*>(&it.second)))
+                mat->markDirty();
         }
 
         ImGui::NewLine();
@@ -325,9 +379,12 @@ void UI::renderComp_draw()
         {
             ImGui::Text(it.first.c_str());
 
-            ImGui::SliderFloat("X: ", &it.second.val.x, it.second.min.x, it.second.max.x);
-            ImGui::SliderFloat("Y: ", &it.second.val.y, it.second.min.y, it.second.max.y);
-            ImGui::SliderFloat("Z: ", &it.second.val.z, it.second.min.z, it.second.max.z);
+            bool changed = ImGui::SliderFloat("X: ", &it.second.val.x, it.second.min.x, it.second.max.x);
+            changed |= ImGui::SliderFloat("Y: ", &it.second.val.y, it.second.min.y, it.second.max.y);
+            changed |= ImGui::SliderFloat("Z: ", &it.second.val.z, it.second.min.z, it.second.max.z);
+
+            if (changed)
+                mat->markDirty();
         }
 
         ImGui::NewLine();
@@ -337,8 +394,11 @@ void UI::renderComp_draw()
         {
             ImGui::Text(it.first.c_str());
 
-            ImGui::SliderFloat("X: ", &it.second.val.x, it.second.min.x, it.second.max.x);
-            ImGui::SliderFloat("Y: ", &it.second.val.y, it.second.min.y, it.second.max.y);
+            bool changed = ImGui::SliderFloat("X: ", &it.second.val.x, it.second.min.x, it.second.max.x);
+            changed |= ImGui::SliderFloat("Y: ", &it.second.val.y, it.second.min.y, it.second.max.y);
+
+            if (changed)
+                mat->markDirty();
         }
 
         ImGui::NewLine();
@@ -348,8 +408,9 @@ void UI::renderComp_draw()
         {
             ImGui::Text(it.first.c_str());
 
-            std::string label = it.first;
-            ImGui::SliderFloat(label.c_str(), &it.second.val, it.second.min, it.second.max);
+            std::string label = it.first.str();
+            if (ImGui::SliderFloat(label.c_str(), &it.second.val, it.second.min, it.second.max))
+                mat->markDirty();
         }
 
 
@@ -360,7 +421,7 @@ void UI::renderComp_draw()
 
         for (auto& it : mat->vTexture)
         {
-            std::string slotName = it.first;
+            std::string slotName = it.first.str();
 
             ImGui::Text(slotName.c_str());
 
@@ -373,7 +434,8 @@ void UI::renderComp_draw()
                     if (ImGui::Selectable(it2.first.c_str(), is_selected))
                     {
                         it.second = it2.second;
-                        selectedTextureName = it2.first;
+                        selectedTextureName = it2.first.str();
+                        mat->markDirty();
 
                         if (slotName == "textureDiffuse")
                         {
@@ -403,6 +465,13 @@ void UI::componentTab_draw()
     {
         if (ImGui::BeginListBox(" ", ImVec2(390, 600)))
         {
+            // Removed before its components are drawn
+            if (engine.selectedEntity && ImGui::Button("Delete entity"))
+            {
+                engine.removeEntity(engine.selectedEntity);
+                sceneBrowser.selected = -1;
+            }
+
             if (engine.selectedEntity)
             {
                 TransformComponent* transform = nullptr;
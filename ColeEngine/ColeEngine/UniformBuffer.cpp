@@ -0,0 +1,59 @@
+#include "UniformBuffer.h"
+
+#include "glew.h"
+
+
+UniformBuffer::UniformBuffer()
+    : buffer(0), capacity(0)
+{
+    glGenBuffers(1, &buffer);
+}
+
+
+UniformBuffer::~UniformBuffer()
+{
+    glDeleteBuffers(1, &buffer);
+}
+
+
+void UniformBuffer::upload(const void* data, size_t size)
+{
+    glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+
+    if (size > capacity)
+    {
+        capacity = size;
+        glBufferData(GL_UNIFORM_BUFFER, capacity, data, GL_DYNAMIC_DRAW);
+    }
+    else
+    {
+        // Orphan the old storage so draws still reading it don't stall the upload
+        glBufferData(GL_UNIFORM_BUFFER, capacity, NULL, GL_DYNAMIC_DRAW);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, size, data);
+    }
+
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+
+void UniformBuffer::bind(unsigned int binding)
+{
+    glBindBufferBase(GL_UNIFORM_BUFFER, binding, buffer);
+}
+
+
+void UniformBuffer::bindRange(unsigned int binding, size_t offset, size_t size)
+{
+    glBindBufferRange(GL_UNIFORM_BUFFER, binding, buffer, offset, size);
+}
+
+
+size_t UniformBuffer::getOffsetAlignment()
+{
+    static GLint alignment = 0;
+
+    if (alignment == 0)
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+
+    return alignment > 0 ? static_cast<size_t>(alignment) : 256;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#ifndef _UNIFORM_BUFFER
+#define _UNIFORM_BUFFER
+
+#include <cstddef>
+
+#include <glm/glm.hpp>
+
+// Binding points shared by every program. Blocks are pointed at these by name when a program links
+#define FRAME_BLOCK_BINDING 0
+#define LIGHT_BLOCK_BINDING 1
+#define MATERIAL_BLOCK_BINDING 2
+
+
+// Matches FrameBlock (std140) in the shaders. Uploaded once per frame
+struct FrameUniforms
+{
+	glm::mat4 worldView;
+	glm::mat4 worldProj;
+	glm::mat4 worldInverse;
+
+	glm::vec3 viewPos;
+	float time;
+
+	glm::vec3 ambientColor;
+	int mode;
+
+	glm::vec3 sunPos;
+	int basicShading;
+
+	glm::vec3 mouseWorld;
+	float pad0;
+};
+
+
+// Matches LightBlock (std140) in the point light shadow shaders. One entry per light
+struct LightUniforms
+{
+	glm::mat4 shadowMatrices[6];
+
+	glm::vec3 lightPos;
+	float farPlane;
+
+	glm::ivec4 faceLayer[6]; // Only x is used, std140 pads int array elements to 16 bytes
+};
+
+
+// Uniform buffer object that is bound to one of the shared binding points
+class UniformBuffer
+{
+public:
+	UniformBuffer();
+	~UniformBuffer();
+
+	UniformBuffer(const UniformBuffer&) = delete;
+	UniformBuffer& operator=(const UniformBuffer&) = delete;
+
+	// Replace the contents. Storage only grows
+	void upload(const void* data, size_t size);
+
+	// Bind the whole buffer, or one entry of an array of blocks
+	void bind(unsigned int binding);
+	void bindRange(unsigned int binding, size_t offset, size_t size);
+
+	unsigned int get() const { return buffer; }
+
+	// Offsets given to bindRange must be a multiple of this
+	static size_t getOffsetAlignment();
+
+private:
+	unsigned int buffer;
+	size_t capacity;
+};
+
+#endif
@@ -25,28 +25,6 @@ World::~World()
 
 }
 
-static glm::vec3 getRayDirection(int screenWidth, int screenHeight, double mouseX, double mouseY, glm::mat4 viewMatrix, glm::mat4 projectionMatrix)
-{
-    // Convert mouse coordinates to NDC (Normalized Device Coordinates)
-    //float ndcX = (2.0f * mouseX) / (static_cast<float>(screenWidth) - 1.0f);
-    //float ndcY = 1.0f - (2.0f * mouseY) / static_cast<float>(screenHeight);
-    float ndcX = 0.0f;
-    float ndcY = 0.0f;
-    // Create a ray in clip space
-    glm::vec4 rayClip(ndcX, ndcY, 0.0f, 1.0f);
-
-    glm::mat4 viewProjectionInverse = glm::inverse(projectionMatrix * viewMatrix);
-
-    // Unproject the ray into view space
-    glm::vec4 rayView = viewProjectionInverse * rayClip;
-    rayView /= rayView.w;
-
-    // The ray direction is the vector from the camera position to the unprojected point
-    glm::vec3 rayDirection = glm::normalize(glm::vec3(rayView) - glm::vec3(viewMatrix[3]));
-
-    return rayDirection;
-}
-
 static Box3D* computeBV(std::vector<Box3D*>& objects)
 {
     Box3D* box = new Box3D();
@@ -104,9 +82,27 @@ static void sortObjects(Box3D* bv, std::vector<Box3D*>& objects)
 
 Mesh* World::importFBX(std::string path)
 {
-    // Load FBX mesh and material data
-    Mesh* mesh = new MeshFBX(path, true);
+    // Load mesh and material data, cooked if available
+    Mesh* mesh = resource.loadMesh(path);
+
+    return createMeshMaterials(mesh);
+}
 
+
+std::vector<Mesh*> World::importFBX(const std::vector<std::string>& paths)
+{
+    // Files are imported concurrently, materials are created here after all of them are done
+    std::vector<Mesh*> meshes = resource.loadMeshes(paths, threadPool);
+
+    for (Mesh* mesh : meshes)
+        createMeshMaterials(mesh);
+
+    return meshes;
+}
+
+
+Mesh* World::createMeshMaterials(Mesh* mesh)
+{
     if (mesh)
     {
         // Number of materials in the FBX
@@ -115,36 +111,38 @@ Mesh* World::importFBX(std::string path)
         // Create a material for every unique material in loaded FBX
         for (unsigned int i = 0; i < nMaterials; i++)
         {
+            StringID matName(mesh->matData[i].name);
+
             // Create new material
-            resource.createNewMaterial(mesh->matData[i].name, resource.shader("geometry_default"));
+            resource.createNewMaterial(matName, resource.shader("geometry_default"_sid));
 
-            Material* mat = resource.getMaterial(mesh->matData[i].name);
+            Material* mat = resource.getMaterial(matName);
 
             // Set material parameters
-            mat->vColor["diffuse"] = mesh->matData[i].diffuseColor; // Diffuse color
-            mat->vColor["specular"] = mesh->matData[i].specularColor; // Specular color
+            mat->vColor["diffuse"_sid] = mesh->matData[i].diffuseColor; // Diffuse color
+            mat->vColor["specular"_sid] = mesh->matData[i].specularColor; // Specular color
 
             // Texture scale
-            mat->vVec2["textureScale"] = Vec2Param(glm::vec2(5.0f, 5.0f), glm::vec2(0.0f, 0.0f), glm::vec2(20.0f, 20.0f));
+            mat->vVec2["textureScale"_sid] = Vec2Param(glm::vec2(5.0f, 5.0f), glm::vec2(0.0f, 0.0f), glm::vec2(20.0f, 20.0f));
 
             // Shininess
-            mat->vFloat["shininess"] = FloatParam(mesh->matData[i].shininess, 0.2f, 500.0f);
+            mat->vFloat["shininess"_sid] = FloatParam(mesh->matData[i].shininess, 0.2f, 500.0f);
 
             // Reflectivity
-            mat->vFloat["reflectivity"] = FloatParam(mesh->matData[i].shininess, 0.2f, 500.0f);
+            mat->vFloat["reflectivity"_sid] = FloatParam(mesh->matData[i].shininess, 0.2f, 500.0f);
 
             // Normal strength
-            mat->vFloat["normalStrength"] = FloatParam(20.1f, 0.0f, 60.5f);
+            mat->vFloat["normalStrength"_sid] = FloatParam(20.1f, 0.0f, 60.5f);
 
 
             mat->hasDiffuseTexture = false;
-            mat->vTexture["textureDiffuse"] = resource.getNullTexture();
+            mat->vTexture["textureDiffuse"_sid] = resource.getNullTexture();
 
             mat->hasNormalsTexture = false;
-            mat->vTexture["textureNormal"] = resource.getNullTexture();
+            mat->vTexture["textureNormal"_sid] = resource.getNullTexture();
 
             mat->hasSpecularTexture = false;
-            mat->vTexture["textureSpecular"] = resource.getNullTexture();
+            mat->vTexture["textureSpecular"_sid] = resource.getNullTexture();
 
 
             // Attempt to load diffuse texture if one exists
@@ -154,7 +152,7 @@ Mesh* World::importFBX(std::string path)
                 if (!mesh->matData[i].diffuseTexture.isEmbedded)
                 {
                     mat->hasDiffuseTexture = true;
-                    mat->vTexture["textureDiffuse"] = resource.getTexture(mesh->matData[i].diffuseTexture.texturePath);
+                    mat->vTexture["textureDiffuse"_sid] = resource.getTexture(StringID(mesh->matData[i].diffuseTexture.texturePath));
                 }
                 else  //Texture is embedded, load from raw data
                 {
@@ -167,10 +165,10 @@ Mesh* World::importFBX(std::string path)
                         mesh->matData[i].diffuseTexture.embeddedData.height
                     );
 
-                    std::string name = mesh->matData[i].name + " embedded diffuse";
+                    StringID name(mesh->matData[i].name + " embedded diffuse");
                     resource.addTexture(name, texture);
 
-                    mat->vTexture["textureDiffuse"] = resource.getTexture(name);
+                    mat->vTexture["textureDiffuse"_sid] = resource.getTexture(name);
                 }
                 
             }
@@ -183,7 +181,7 @@ Mesh* World::importFBX(std::string path)
                 if (!mesh->matData[i].normalTexture.isEmbedded)
                 {
                     mat->hasNormalsTexture = true;
-                    mat->vTexture["textureNormal"] = resource.getTexture(mesh->matData[i].normalTexture.texturePath);
+                    mat->vTexture["textureNormal"_sid] = resource.getTexture(StringID(mesh->matData[i].normalTexture.texturePath));
                 }
                 else if (mesh->matData[i].normalTexture.isEmbedded) //Texture is embedded, load from raw data
                 {
@@ -196,10 +194,10 @@ Mesh* World::importFBX(std::string path)
                         mesh->matData[i].normalTexture.embeddedData.height
                     );
 
-                    std::string name = mesh->matData[i].name + " embedded normals";
+                    StringID name(mesh->matData[i].name + " embedded normals");
                     resource.addTexture(name, texture);
 
-                    mat->vTexture["textureNormal"] = resource.getTexture(name);
+                    mat->vTexture["textureNormal"_sid] = resource.getTexture(name);
                 }
                 
             }
@@ -211,11 +209,12 @@ Mesh* World::importFBX(std::string path)
                 if (!mesh->matData[i].specularTexture.isEmbedded)
                 {
                     mat->hasSpecularTexture = true;
-                    mat->vTexture["textureSpecular"] = resource.getTexture(mesh->matData[i].normalTexture.texturePath);
+                    mat->vTexture["textureSpecular"_sid] = resource.getTexture(StringID(mesh->matData[i].normalTexture.texturePath));
                 }
 
             }
-            
+
+            mat->markDirty();
         }
 
         return mesh;
@@ -251,20 +250,28 @@ void World::initWorld()
     mouseWorldPos = { 0.0f, 0.0f, 0.0f };
 
     // Load all shaders
-    resource.loadShader("geometry_default", "geo_pass.frag", "geo_pass.vert");
-    resource.loadShader("lighting", "lighting.frag", "lighting.vert");
-    resource.loadShader("point_shadows_default", "PointLightShadow.frag", "PointLightShadow.vert", "PointLightShadow.geom");
-    resource.loadShader("post_process_default", "PostProcess.frag", "PostProcess.vert");
-    resource.loadShader("particles_default", "particles.frag", "particles.vert");
-
-    //  resource.loadShader("shadows_default", "shadow.frag", "shadow.vert");
-    //resource.loadShader("skydome", "skydome.frag", "skydome.vert");
+    resource.loadShader("geometry_default"_sid, "geo_pass.frag", "geo_pass.vert");
+    resource.loadShader("lighting"_sid, "lighting.frag", "lighting.vert");
+    resource.loadShader("point_shadows_default"_sid, "PointLightShadow.frag", "PointLightShadow.vert", "PointLightShadow.geom");
+    resource.loadShader("post_process_default"_sid, "PostProcess.frag", "PostProcess.vert");
+    resource.loadShader("particles_default"_sid, "particles.frag", "particles.vert");
+
+    //  resource.loadShader("shadows_default"_sid, "shadow.frag", "shadow.vert");
+    //resource.loadShader("skydome"_sid, "skydome.frag", "skydome.vert");
     
-    Mesh* guitarMesh = importFBX("assets/mesh/monkey.fbx");
-    Mesh* spheresMesh = importFBX("assets/mesh/sphere.fbx");
-    Mesh* spriteMesh = importFBX("assets/mesh/sprite_zUp.fbx");
-    Mesh* sponzaMesh = importFBX("assets/mesh/playground.fbx");
-    Mesh* skyMesh = importFBX("assets/mesh/skySphere.fbx");
+    std::vector<Mesh*> meshes = importFBX({
+        "assets/mesh/monkey.fbx",
+        "assets/mesh/sphere.fbx",
+        "assets/mesh/sprite_zUp.fbx",
+        "assets/mesh/playground.fbx",
+        "assets/mesh/skySphere.fbx"
+    });
+
+    Mesh* guitarMesh = meshes[0];
+    Mesh* spheresMesh = meshes[1];
+    Mesh* spriteMesh = meshes[2];
+    Mesh* sponzaMesh = meshes[3];
+    Mesh* skyMesh = meshes[4];
 
     
     Mesh* terrainMesh = new MeshTerrain(3000.0f, 128, 2.0f);
@@ -274,21 +281,23 @@ void World::initWorld()
     
 
     // Set sky texture
-    resource.setSkyTexture(resource.getTexture("assets/textures/hdri/kloofendal_43d_clear_2k.hdr"));
+    resource.setSkyTexture(resource.getTexture("assets/textures/hdri/kloofendal_43d_clear_2k.hdr"_sid));
 
     // Create concrete material
-    resource.createNewMaterial("mat_concrete", resource.shader("geometry_default"));
+    resource.createNewMaterial("mat_concrete"_sid, resource.shader("geometry_default"_sid));
+    Material* concrete = resource.getMaterial("mat_concrete"_sid);
 
     // Create concrete material's parameters
-    resource.getMaterial("mat_concrete")->vTexture["textureDiffuse"] = resource.getTexture("assets/textures/concrete_1.png");
-    resource.getMaterial("mat_concrete")->vTexture["textureNormal"] = resource.getTexture("assets/textures/concrete_1_NRM.png");
-    resource.getMaterial("mat_concrete")->vVec2["textureScale"] = Vec2Param(glm::vec2(5.0f, 5.0f), glm::vec2(0.0f, 0.0f), glm::vec2(20.0f, 20.0f));
-    resource.getMaterial("mat_concrete")->vFloat["shininess"] = FloatParam(120.0f, 0.2f, 500.0f);
-    resource.getMaterial("mat_concrete")->vFloat["normalStrength"] = FloatParam(48.0f, 0.0f, 60.5f);
-    resource.getMaterial("mat_concrete")->vColor["diffuse"] = Color4(1.0f, 1.0f, 1.0f, 1.0f); // Diffuse color
-    resource.getMaterial("mat_concrete")->vColor["specular"] = Color4(1.0f, 1.0f, 1.0f, 1.0f); // Specular color
-    resource.getMaterial("mat_concrete")->hasDiffuseTexture = true;
-    resource.getMaterial("mat_concrete")->hasNormalsTexture = true;
+    concrete->vTexture["textureDiffuse"_sid] = resource.getTexture("assets/textures/concrete_1.png"_sid);
+    concrete->vTexture["textureNormal"_sid] = resource.getTexture("assets/textures/concrete_1_NRM.png"_sid);
+    concrete->vVec2["textureScale"_sid] = Vec2Param(glm::vec2(5.0f, 5.0f), glm::vec2(0.0f, 0.0f), glm::vec2(20.0f, 20.0f));
+    concrete->vFloat["shininess"_sid] = FloatParam(120.0f, 0.2f, 500.0f);
+    concrete->vFloat["normalStrength"_sid] = FloatParam(48.0f, 0.0f, 60.5f);
+    concrete->vColor["diffuse"_sid] = Color4(1.0f, 1.0f, 1.0f, 1.0f); // Diffuse color
+    concrete->vColor["specular"_sid] = Color4(1.0f, 1.0f, 1.0f, 1.0f); // Specular color
+    concrete->hasDiffuseTexture = true;
+    concrete->hasNormalsTexture = true;
+    concrete->markDirty();
 
 
     // Create point light component 2
@@ -306,7 +315,7 @@ void World::initWorld()
     plTrn2->scl = { 1.0f, 1.0f, 1.0f };
 
     // Create point light 2
-    PointLight* light2 = new PointLight("Point light 2", 1024, 1024);
+    PointLight* light2 = new PointLight("Point light 2");
 
     light2->addComponent(plComp2);
     light2->addComponent(plTrn2);
@@ -329,7 +338,7 @@ void World::initWorld()
     plTrn1->scl = { 1.0f, 1.0f, 1.0f };
 
     // Create point light 2
-    PointLight* light1 = new PointLight("Point light 1", 1024, 1024);
+    PointLight* light1 = new PointLight("Point light 1");
 
     light1->addComponent(plComp1);
     light1->addComponent(plTrn1);
@@ -347,10 +356,11 @@ void World::initWorld()
     trTerrain->pos = glm::vec3(0.0f, 0.0f, 0.0f);
     //trTerrain->scl = glm::vec3(0.1f, 0.1f, 0.1f);
     trTerrain->scl = glm::vec3(1.0f, 1.0f, 1.0f);
+    trTerrain->isStatic = true;
     // Renderer for plane entity
     RenderComponent* rndrSponzaTerrain = new RenderComponent();
     rndrSponzaTerrain->mesh = terrainMesh;
-    rndrSponzaTerrain->setMaterial(resource.getMaterial("mat_concrete"), terrainEntity, 0);
+    rndrSponzaTerrain->setMaterial(concrete, terrainEntity, 0);
     //rndrSponzaTerrain->setMaterialsFromMesh(&resource);
 
     
@@ -373,8 +383,9 @@ void World::initWorld()
     
 
     // Particle system test
-    resource.createNewMaterial("mat_sprite", resource.shader("particles_default"));
-    resource.getMaterial("mat_sprite")->vTexture["sprite_texture"] = resource.getTexture("assets/textures/sprite.png");
+    resource.createNewMaterial("mat_sprite"_sid, resource.shader("particles_default"_sid));
+    resource.getMaterial("mat_sprite"_sid)->vTexture["sprite_texture"_sid] = resource.getTexture("assets/textures/sprite.png"_sid);
+    resource.getMaterial("mat_sprite"_sid)->markDirty();
 
     TransformComponent* trPart = new TransformComponent();
     trPart->pos = glm::vec3(0.0f, 0.0f, 4.5f);
@@ -385,7 +396,7 @@ void World::initWorld()
     
     ParticleEmitter* pSystem = new ParticleEmitter("particle system", 3, 100);
 
-    rndrPart->setMaterial(resource.getMaterial("mat_concrete"), pSystem, 0);
+    rndrPart->setMaterial(concrete, pSystem, 0);
 
     pSystem->addComponent(trPart);
     pSystem->addComponent(rndrPart);
@@ -394,7 +405,7 @@ void World::initWorld()
 
     particles.push_back(pSystem);
     
-    //Serialization::Serialize(resource.getMaterial("mat_concrete"), ObjectType::MATERIAL);
+    //Serialization::Serialize(resource.getMaterial("mat_concrete"_sid), ObjectType::MATERIAL);
     
 
 
@@ -407,12 +418,13 @@ void World::initWorld()
     TransformComponent* trSky = new TransformComponent();
     trSky->pos = glm::vec3(0.0f, 0.0f, 0.0f);
     trSky->scl = glm::vec3(50.0f, 50.0f, 50.0f);
+    trSky->isStatic = true;
 
     // Renderer for skybox entity
     RenderComponent* rndrSky = new RenderComponent();
     rndrSky->mesh = skyMesh;
     rndrSky->isSky = true;
-    rndrSky->setMaterial(resource.getMaterial("mat_concrete"), skyBox, 0);
+    rndrSky->setMaterial(concrete, skyBox, 0);
 
     // Add components to skybox entity
     skyBox->addComponent(rndrSky);
@@ -438,7 +450,7 @@ void World::initWorld()
 
     rndrMonk->setMaterialsFromMesh(&resource);
 
-   //rndrMonk->setMaterial(resource.getMaterial("mat_concrete"), monk, 0);
+   //rndrMonk->setMaterial(resource.getMaterial("mat_concrete"_sid), monk, 0);
     //rndrMonk->setMaterial(importMat, monk);
 
     monk->addComponent(trMonk);
@@ -473,6 +485,11 @@ void World::initWorld()
 
     //createBvhObjects();
 
+    buildSceneBVH();
+
+    // World bounds for culling
+    createAABBComponents();
+
     std::cout << "Number of triangle AABB's: " << objList.size() << "\n\n";
 
     if (objList.size() > 0)
@@ -483,6 +500,8 @@ void World::initWorld()
 
     //std::cout << "max leaf depth: " << maxLeafDepth << "\nmin leaf depth: " << minLeafDepth << "\n\n";
 
+    // Every material's shader variant is ready before the first frame
+    resource.warmUpShaders();
 }
 
 void World::updateTransforms(glm::vec3 eye, glm::vec3 center, float tilt, float spin)
@@ -508,6 +527,177 @@ void World::update()
     time += time_dx;
     last_time = now;
 
+    updateSceneBVH();
+    updateAABBs();
+}
+
+
+
+void World::buildSceneBVH()
+{
+    sceneBVH.clear();
+
+    for (Entity* e : entities)
+    {
+        TransformComponent* transformComp = e->getComponent<TransformComponent>();
+        RenderComponent* renderComp = e->getComponent<RenderComponent>();
+
+        if (!transformComp || !renderComp || !renderComp->mesh)
+            continue;
+
+        // Sky dome surrounds everything and would swallow every ray
+        if (renderComp->isSky)
+            continue;
+
+        // Build the mesh BVH if the mesh was made without one
+        if (!renderComp->mesh->bvh)
+            renderComp->mesh->buildBVH();
+
+        sceneBVH.addInstance(e, renderComp->mesh->bvh, transformComp->getModelMatrix());
+    }
+
+    sceneBVH.build();
+
+    Log::info("Scene BVH: " + std::to_string(sceneBVH.getInstances().size()) + " instances");
+}
+
+
+
+void World::removeEntity(Entity* entity)
+{
+    entities.erase(std::remove(entities.begin(), entities.end(), entity), entities.end());
+    pointLights.erase(std::remove(pointLights.begin(), pointLights.end(), entity), pointLights.end());
+    particles.erase(std::remove(particles.begin(), particles.end(), entity), particles.end());
+
+    if (playerEntity == entity)
+        playerEntity = nullptr;
+
+    // Render component handles are released with it
+    delete entity;
+
+    // Instances point at the entity and its mesh
+    buildSceneBVH();
+}
+
+
+
+void World::updateSceneBVH()
+{
+    std::vector<BVHInstance>& instances = sceneBVH.getInstances();
+
+    bool moved = false;
+
+    for (unsigned int i = 0; i < instances.size(); i++)
+    {
+        // Pick up finished background rebuilds of edited meshes
+        instances[i].blas->update();
+
+        TransformComponent* transformComp = instances[i].entity->getComponent<TransformComponent>();
+
+        glm::mat4 modelMatrix = transformComp->getModelMatrix();
+
+        // Moved, or its mesh was edited since the bounds were computed
+        if (modelMatrix != instances[i].transform || instances[i].blasVersion != instances[i].blas->getVersion())
+        {
+            sceneBVH.setTransform(i, modelMatrix);
+            moved = true;
+        }
+    }
+
+    // Refit the top level, it rebuilds itself in the background once it degrades
+    if (moved)
+        sceneBVH.refit();
+
+    sceneBVH.update();
+}
+
+
+
+Ray3D World::screenPointToRay(double x, double y) const
+{
+    // Window coordinates to NDC. Window y goes down, NDC y goes up
+    float ndcX = (2.0f * static_cast<float>(x)) / static_cast<float>(platform.width) - 1.0f;
+    float ndcY = 1.0f - (2.0f * static_cast<float>(y)) / static_cast<float>(platform.height);
+
+    glm::mat4 invViewProj = glm::inverse(worldProj * worldView);
+
+    // Unproject points on the near and far planes
+    glm::vec4 nearPoint = invViewProj * glm::vec4(ndcX, ndcY, -1.0f, 1.0f);
+    glm::vec4 farPoint = invViewProj * glm::vec4(ndcX, ndcY, 1.0f, 1.0f);
+
+    nearPoint /= nearPoint.w;
+    farPoint /= farPoint.w;
+
+    return Ray3D(glm::vec3(nearPoint), glm::normalize(glm::vec3(farPoint - nearPoint)));
+}
+
+
+
+bool World::castRay(const Ray3D& ray, RayHit* hit, RayQueryMode mode, RayQueryStats* stats)
+{
+    RayHit result;
+
+    bool found = sceneBVH.intersect(ray, result, mode, stats);
+
+    if (hit)
+        *hit = result;
+
+    return found;
+}
+
+
+// True if every ray points into the same octant, so they can be traced as one packet
+static bool isCoherent(const Ray3D* rays, unsigned int count)
+{
+    glm::bvec3 sign = glm::lessThan(rays[0].direction, glm::vec3(0.0f));
+
+    for (unsigned int i = 1; i < count; i++)
+    {
+        if (glm::lessThan(rays[i].direction, glm::vec3(0.0f)) != sign)
+            return false;
+    }
+
+    return true;
+}
+
+
+void World::castRays(const std::vector<Ray3D>& rays, std::vector<RayHit>& hits, RayQueryMode mode, RayQueryStats* stats)
+{
+    hits.assign(rays.size(), RayHit());
+
+    unsigned int nRays = static_cast<unsigned int>(rays.size());
+    unsigned int nPackets = (nRays + BVH_PACKET_SIZE - 1) / BVH_PACKET_SIZE;
+
+    std::mutex statsMutex;
+
+    // Each job takes a run of packets. Stats are kept per job and merged at the end
+    threadPool.parallelFor(nPackets, 8, [&](unsigned int begin, unsigned int end)
+    {
+        RayQueryStats local;
+
+        for (unsigned int p = begin; p < end; p++)
+        {
+            unsigned int first = p * BVH_PACKET_SIZE;
+            unsigned int count = std::min(static_cast<unsigned int>(BVH_PACKET_SIZE), nRays - first);
+
+            if (count > 1 && isCoherent(&rays[first], count))
+            {
+                sceneBVH.intersectPacket(&rays[first], &hits[first], count, mode, &local);
+            }
+            else
+            {
+                // Divergent rays would drag each other through the whole tree
+                for (unsigned int i = first; i < first + count; i++)
+                    sceneBVH.intersect(rays[i], hits[i], mode, &local);
+            }
+        }
+
+        if (stats)
+        {
+            std::lock_guard<std::mutex> lock(statsMutex);
+            stats->add(local);
+        }
+    });
 }
 
 
@@ -700,61 +890,106 @@ bool World::testRayAgainstNode(Ray3D ray, TreeNode* node, int depth, glm::vec3*
 
 void World::createAABBComponents()
 {
-    objList.clear();
+    for (Entity* e : entities)
+    {
+        TransformComponent* transformComp = e->getComponent<TransformComponent>();
+        RenderComponent* renderComp = e->getComponent<RenderComponent>();
 
-    triangleCount = 0;
+        if (!transformComp || !renderComp || !renderComp->mesh)
+            continue;
+
+        // Sky is always drawn
+        if (renderComp->isSky)
+            continue;
+
+        if (e->getComponent<AABBComponent>())
+            continue;
+
+        AABBComponent* aabb = new AABBComponent();
+
+        if (aabb)
+        {
+            aabb->box = new Box3D(glm::vec3(0.0f), glm::vec3(0.0f), reinterpret_cast<void*>(e));
+            e->addComponent(aabb);
+        }
+    }
+
+    updateAABBs();
+}
+
+
+
+void World::updateAABBs()
+{
     for (Entity* e : entities)
     {
+        AABBComponent* aabb = e->getComponent<AABBComponent>();
+
+        if (!aabb)
+            continue;
+
         TransformComponent* transformComp = e->getComponent<TransformComponent>();
         RenderComponent* renderComp = e->getComponent<RenderComponent>();
-        PlayerComponent* playerComp = e->getComponent<PlayerComponent>();
 
-        if (!renderComp)
+        if (!transformComp || !renderComp || !renderComp->mesh)
             continue;
 
-        glm::mat4 modelTr = glm::mat4(1.0f);
-        modelTr = glm::translate(modelTr, transformComp->pos);
-        modelTr = glm::rotate(modelTr, (transformComp->angle), transformComp->rot);
-        modelTr = glm::scale(modelTr, transformComp->scl * glm::vec3(0.01f, 0.01f, 0.01f));
+        Mesh* mesh = renderComp->mesh;
+
+        glm::mat4 modelMatrix = transformComp->getModelMatrix();
+
+        aabb->changed = false;
 
-        glm::vec3 minPoint = { 9999.0f, 9999.0f, 9999.0f };
-        glm::vec3 maxPoint = { -9999.0f, -9999.0f, -9999.0f };
-        glm::vec3 centerPoint = { 0.0f, 0.0f, 0.0f };
-        glm::vec3 dim = { 0.0f, 0.0f, 0.0f };
+        // Still valid
+        if (modelMatrix == aabb->modelMatrix && mesh->boundsVersion == aabb->boundsVersion)
+            continue;
+
+        // Keep old bounds so caches covering where the entity was can be invalidated
+        bool firstUpdate = aabb->subMin.empty();
+
+        aabb->prevMin = aabb->center - aabb->dim * 0.5f;
+        aabb->prevMax = aabb->center + aabb->dim * 0.5f;
 
-        //std::vector<std::vector<Vertex>>& vertices = renderComp->mesh->vertices;
-        //std::vector < std::vector<unsigned int>>& indices = renderComp->mesh->indices;
+        unsigned int nSubMeshes = static_cast<unsigned int>(mesh->meshData.size());
 
-        std::vector<std::vector<Vertex>> vertices;
-        std::vector < std::vector<unsigned int>> indices;
+        aabb->subMin.resize(nSubMeshes);
+        aabb->subMax.resize(nSubMeshes);
+        aabb->subVisible.resize(nSubMeshes, 1);
 
-        for (int i = 0; i < vertices.size(); i++)
+        glm::vec3 minPoint = glm::vec3(FLT_MAX);
+        glm::vec3 maxPoint = glm::vec3(-FLT_MAX);
+
+        for (unsigned int i = 0; i < nSubMeshes; i++)
         {
-            for (int j = 0; j < vertices[i].size(); j++)
-            {
-                glm::vec3& p = vertices[i][j].position;
-                glm::vec4 p4 = modelTr * glm::vec4(p.x, p.y, p.z, 1.0f);
+            TransformAABB(modelMatrix, mesh->meshData[i].boundsMin, mesh->meshData[i].boundsMax, aabb->subMin[i], aabb->subMax[i]);
 
-                minPoint = glm::min(glm::vec3(p4.x, p4.y, p4.z), minPoint);
-                maxPoint = glm::max(glm::vec3(p4.x, p4.y, p4.z), maxPoint);
-            }
+            minPoint = glm::min(minPoint, aabb->subMin[i]);
+            maxPoint = glm::max(maxPoint, aabb->subMax[i]);
         }
 
-        dim.x = glm::abs(maxPoint.x - minPoint.x);
-        dim.y = glm::abs(maxPoint.y - minPoint.y);
-        dim.z = glm::abs(maxPoint.z - minPoint.z);
+        if (nSubMeshes == 0)
+        {
+            minPoint = transformComp->pos;
+            maxPoint = transformComp->pos;
+        }
 
-        centerPoint = maxPoint - dim * 0.5f;
+        aabb->dim = maxPoint - minPoint;
+        aabb->center = (minPoint + maxPoint) * 0.5f;
 
-        Box3D* box = new Box3D(centerPoint, dim * 0.5f, reinterpret_cast<void*>(e));
+        if (aabb->box)
+        {
+            aabb->box->center = aabb->center;
+            aabb->box->extents = aabb->dim * 0.5f;
+        }
 
-        AABBComponent* aabb = new AABBComponent();
+        aabb->modelMatrix = modelMatrix;
+        aabb->boundsVersion = mesh->boundsVersion;
+        aabb->changed = true;
 
-        if (aabb)
+        if (firstUpdate)
         {
-            aabb->box = box;
-            e->addComponent(aabb);
+            aabb->prevMin = minPoint;
+            aabb->prevMax = maxPoint;
         }
     }
-
-}
\ No newline at end of file
+}
@@ -15,6 +15,8 @@
 #include "ResourceManager.h"
 #include "ParticleEmitter.h"
 #include "Mesh.h"
+#include "BVH.h"
+#include "ThreadPool.h"
 #include"geomlib.h"
 
 class ParticleEmitter;
@@ -51,6 +53,26 @@ public:
 	void updateTransforms(glm::vec3 eye, glm::vec3 center, float tilt, float spin);
 	void update();
 
+	// Build the top level BVH over every rendered entity
+	void buildSceneBVH();
+
+	// Recompute cached world bounds of entities that moved or whose mesh changed
+	void updateAABBs();
+
+	// World space ray through a point in window coordinates (e.g. the mouse)
+	Ray3D screenPointToRay(double x, double y) const;
+
+	// Trace a world space ray against the scene BVH
+	bool castRay(const Ray3D& ray, RayHit* hit, RayQueryMode mode = RayQueryMode::CLOSEST_HIT, RayQueryStats* stats = nullptr);
+
+	// Trace a batch of rays on the worker threads. hits is resized to match rays.
+	// Only reads CPU side data, so any system can call it between world updates
+	void castRays(const std::vector<Ray3D>& rays, std::vector<RayHit>& hits, RayQueryMode mode = RayQueryMode::CLOSEST_HIT, RayQueryStats* stats = nullptr);
+
+	// Delete an entity from any of the lists below. Its meshes and materials go back to the resource
+	// manager's cache once nothing else uses them. Use Engine::removeEntity, it clears the selection and systems first
+	void removeEntity(Entity* entity);
+
 	std::vector<Entity*> entities; // List of all entities in world
 	std::vector<PointLight*> pointLights; // Reference list of all point lights in world
 	std::vector<ParticleEmitter*> particles;  // Reference list of all particle systems in world
@@ -84,6 +106,12 @@ public:
 
 	Entity* playerEntity;
 
+	// Two level BVH. Instances point to the BVH of their mesh
+	SceneBVH sceneBVH;
+
+	// Workers for batched queries and other parallel jobs
+	ThreadPool threadPool;
+
 private:
 	Platform& platform;
 	ResourceManager& resource;
@@ -98,9 +126,18 @@ private:
 
 	Mesh* importFBX(std::string path);
 
+	// Import several files at once on the thread pool
+	std::vector<Mesh*> importFBX(const std::vector<std::string>& paths);
+
+	// Create a material for every material of an imported mesh
+	Mesh* createMeshMaterials(Mesh* mesh);
+
 	void createAABBComponents();
 	void createBvhObjects();
 
+	// Move scene BVH instances that changed transform since last frame
+	void updateSceneBVH();
+
 	
 
 	TreeNode* createBVH(std::vector<Box3D*>& objects, int depth);
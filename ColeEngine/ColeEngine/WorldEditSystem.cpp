@@ -30,7 +30,8 @@ void WorldEditSystem::update(Engine& engine)
     // On selection of new entity
     if (engine.onSelect)
     {
-        TerrainComponent* terrain = engine.selectedEntity->getComponent<TerrainComponent>();
+        // Nothing selected after clicking empty space
+        TerrainComponent* terrain = engine.selectedEntity ? engine.selectedEntity->getComponent<TerrainComponent>() : nullptr;
 
         // Check if entity is a terrain object
         if (terrain)
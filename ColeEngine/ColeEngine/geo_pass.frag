@@ -20,33 +20,55 @@ struct Color4
     vec4 c;
 };
 
+// Samplers only exist in the variants that read them
+#ifdef DIFFUSE_MAP
 uniform sampler2D textureDiffuse;
-uniform sampler2D textureNormal;
-uniform sampler2D textureSpecular;
-
+#endif
 
-uniform vec2 textureScale;
+#ifdef NORMAL_MAP
+uniform sampler2D textureNormal;
+#endif
 
-uniform Color4 diffuse;
-uniform Color4 specular;
 
-uniform float shininess;
-uniform float reflectivity;
-uniform float normalStrength;
+layout(std140) uniform MaterialBlock
+{
+    Color4 diffuse;
+    Color4 specular;
+    vec2 textureScale;
+    float shininess;
+    float reflectivity;
+    float normalStrength;
+};
 
 
 
 //WORLD
-uniform float time;
+layout(std140) uniform FrameBlock
+{
+    mat4 WorldView;
+    mat4 WorldProj;
+    mat4 WorldInverse;
+    vec3 viewPos;
+    float time;
+    vec3 ambientColor;
+    int mode;
+    vec3 sunPos;
+    bool basicShading;
+    vec3 mouseWorld;
+};
 
-uniform bool hasDiffuseTexture;
-uniform bool hasNormalsTexture;
+// Per draw color for mesh particles
+uniform bool hasDiffuseOverride;
+uniform vec4 diffuseOverride;
 //WORLD_END
 
 
+#ifdef NORMAL_MAP
 vec3 applyNormalMap(vec3 N, vec2 uv)
 {
-    vec3 d = 2.0*texture(textureNormal, uv).xyz - vec3(1);
+    // Only x and y are stored in compressed normal maps
+    vec2 xy = 2.0*texture(textureNormal, uv).xy - vec2(1);
+    vec3 d = vec3(xy, sqrt(max(1.0 - dot(xy, xy), 0.0)));
     vec3 T = normalize(cross(vec3(0., 1., 0.), N));
     vec3 B = cross(N, T);
     mat3 TBN = mat3(T, B, N);
@@ -54,6 +76,7 @@ vec3 applyNormalMap(vec3 N, vec2 uv)
 
     return normalize(N + worldSpaceNormal * -normalStrength);
 }
+#endif
 
 void main()
 {    
@@ -61,26 +84,21 @@ void main()
 
     gVertex = vec4(worldPos, depth);
     
-    if(hasNormalsTexture)
-    {
-        gNormal = applyNormalMap(normalVec, uv);
-    }
-    else
-    {
-        gNormal = normalVec;
-    }
-
-
-    if(hasDiffuseTexture)
-    {
-        gAlbedo.xyz = diffuse.c.xyz * texture(textureDiffuse, uv).xyz;
-        gAlbedo.w = diffuse.c.w;
-    }
-    else
-    {
-        gAlbedo.xyz = diffuse.c.xyz;
-        gAlbedo.w = diffuse.c.w;
-    }
+#ifdef NORMAL_MAP
+    gNormal = applyNormalMap(normalVec, uv);
+#else
+    gNormal = normalVec;
+#endif
+
+
+    vec4 baseColor = hasDiffuseOverride ? diffuseOverride : diffuse.c;
+
+#ifdef DIFFUSE_MAP
+    gAlbedo.xyz = baseColor.xyz * texture(textureDiffuse, uv).xyz;
+#else
+    gAlbedo.xyz = baseColor.xyz;
+#endif
+    gAlbedo.w = baseColor.w;
 
     gView = vec4(eyeVec, 1.0);
     
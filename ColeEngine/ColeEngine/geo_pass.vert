@@ -2,7 +2,21 @@
 
 precision highp float;
 
-uniform mat4 WorldView, WorldInverse, WorldProj, ModelTr, MVP;
+layout(std140) uniform FrameBlock
+{
+    mat4 WorldView;
+    mat4 WorldProj;
+    mat4 WorldInverse;
+    vec3 viewPos;
+    float time;
+    vec3 ambientColor;
+    int mode;
+    vec3 sunPos;
+    bool basicShading;
+    vec3 mouseWorld;
+};
+
+uniform mat4 ModelTr;
 
 layout(location = 0) in vec4 vertex; 
 layout(location = 1) in vec3 vertexNormal; 
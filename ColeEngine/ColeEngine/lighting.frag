@@ -19,11 +19,9 @@ struct Light
     float strength;
     float falloff;
     float farPlane;
+    vec4 tiles[6]; // Atlas tile per cube face: xy texel offset, z size (0 = no shadows), w layer
 };
 
-// Number of point lights
-const int NR_LIGHTS = 2;
-
 uniform sampler2D gPosition;
 uniform sampler2D gNormal;
 uniform sampler2D gAlbedo;
@@ -31,33 +29,116 @@ uniform sampler2D gSpecular;
 //uniform sampler2D gView; // 4
 uniform sampler2D skyTexture; // 5
 
-uniform samplerCube shadowMapPoint[NR_LIGHTS]; // 4, 5
-
-uniform Light lights[NR_LIGHTS];
-
-uniform bool basicShading;
+uniform sampler2DArray shadowAtlas; // 5
+uniform float shadowAtlasSize;
 
-uniform vec3 viewPos;
-uniform vec3 ambientColor;
-uniform vec3 sunPos;
+// Clustered light tables
+uniform samplerBuffer lightData; // 6, 9 texels per light
+uniform usamplerBuffer clusterGrid; // 7, offset and count per cluster
+uniform usamplerBuffer lightIndices; // 8
 
+uniform ivec3 clusterDims;
+uniform vec2 clusterDepth; // Depth range of the exponential slices
+uniform vec2 screenSize;
 
-uniform int mode;
-uniform vec3 mouseWorld;
+layout(std140) uniform FrameBlock
+{
+    mat4 WorldView;
+    mat4 WorldProj;
+    mat4 WorldInverse;
+    vec3 viewPos;
+    float time;
+    vec3 ambientColor;
+    int mode;
+    vec3 sunPos;
+    bool basicShading;
+    vec3 mouseWorld;
+};
 
 const float metallic = 0.5;
 const float roughness = 0.5;
 const float ao = 0.5;
 
-float pointShadowCalculation(vec3 worldPos, vec3 pos, float far, int i)
+Light getLight(int index)
+{
+    int base = index * 9;
+
+    vec4 posRange = texelFetch(lightData, base);
+    vec4 colorStrength = texelFetch(lightData, base + 1);
+
+    Light light;
+    light.pos = posRange.xyz;
+    light.farPlane = posRange.w;
+    light.color = colorStrength.rgb;
+    light.strength = colorStrength.w;
+    light.falloff = texelFetch(lightData, base + 2).x;
+
+    for (int f = 0; f < 6; f++)
+        light.tiles[f] = texelFetch(lightData, base + 3 + f);
+
+    return light;
+}
+
+// Offset and count of the lights touching this pixel's cluster
+uvec2 getCluster(vec3 worldPos)
+{
+    float depth = -(WorldView * vec4(worldPos, 1.0)).z;
+
+    int slice = 0;
+    if (depth > clusterDepth.x)
+        slice = int(log(depth / clusterDepth.x) / log(clusterDepth.y / clusterDepth.x) * float(clusterDims.z));
+
+    slice = clamp(slice, 0, clusterDims.z - 1);
+
+    ivec2 tile = clamp(ivec2(gl_FragCoord.xy / screenSize * vec2(clusterDims.xy)), ivec2(0), clusterDims.xy - 1);
+
+    return texelFetch(clusterGrid, (slice * clusterDims.y + tile.y) * clusterDims.x + tile.x).xy;
+}
+
+float pointShadowCalculation(vec3 worldPos, Light light)
 {
-    vec3 fragToLight = worldPos - pos;
+    vec3 fragToLight = worldPos - light.pos;
+    vec3 a = abs(fragToLight);
+
+    // pick the cube face and its 2D coordinates the same way a cube map lookup does
+    int face;
+    float ma;
+    vec2 sc;
+
+    if (a.x >= a.y && a.x >= a.z)
+    {
+        ma = a.x;
+        face = fragToLight.x > 0.0 ? 0 : 1;
+        sc = fragToLight.x > 0.0 ? vec2(-fragToLight.z, -fragToLight.y) : vec2(fragToLight.z, -fragToLight.y);
+    }
+    else if (a.y >= a.z)
+    {
+        ma = a.y;
+        face = fragToLight.y > 0.0 ? 2 : 3;
+        sc = fragToLight.y > 0.0 ? vec2(fragToLight.x, fragToLight.z) : vec2(fragToLight.x, -fragToLight.z);
+    }
+    else
+    {
+        ma = a.z;
+        face = fragToLight.z > 0.0 ? 4 : 5;
+        sc = fragToLight.z > 0.0 ? vec2(fragToLight.x, -fragToLight.y) : vec2(-fragToLight.x, -fragToLight.y);
+    }
+
+    vec4 tile = light.tiles[face];
+
+    // light didn't get room in the atlas
+    if (tile.z == 0.0)
+        return 0.0;
+
+    // face coordinates to atlas texels, kept half a texel inside the tile
+    vec2 uv = sc / ma * 0.5 + 0.5;
+    vec2 texel = tile.xy + clamp(uv * tile.z, vec2(0.5), vec2(tile.z - 0.5));
 
     // use the light to fragment vector to sample from the depth map    
-    float closestDepth = texture(shadowMapPoint[i], fragToLight).r;
+    float closestDepth = texture(shadowAtlas, vec3(texel / shadowAtlasSize, tile.w)).r;
 
     // it is currently in linear range between [0,1]. Re-transform back to original value
-    closestDepth *= far;
+    closestDepth *= light.farPlane;
 
     // now get current linear depth as the length between the fragment and light position
     float currentDepth = length(fragToLight);
@@ -76,25 +157,27 @@ vec3 lighting_pointLights(vec3 worldPos, vec3 normal, vec3 albedo, vec4 specular
     vec3 viewDir = normalize(viewPos - worldPos);
     vec3 lighting = ambientColor;
 
-    for(int i = 0; i < NR_LIGHTS; i++)
+    uvec2 cluster = getCluster(worldPos);
+
+    for(uint c = 0u; c < cluster.y; c++)
     {
-        float pointShadow = pointShadowCalculation(worldPos, lights[i].pos,  lights[i].farPlane, i);  
+        Light light = getLight(int(texelFetch(lightIndices, int(cluster.x + c)).r));
+
+        float pointShadow = pointShadowCalculation(worldPos, light);  
 
         // diffuse
-        vec3 lightDir = normalize(lights[i].pos - worldPos);
+        vec3 lightDir = normalize(light.pos - worldPos);
         vec3 halfwayDir = normalize(lightDir + viewDir);  
-        float lightDist = length(lights[i].pos - worldPos);
-        float falloff = lights[i].strength / pow(lightDist, lights[i].falloff);
+        float lightDist = length(light.pos - worldPos);
+        float falloff = light.strength / pow(lightDist, light.falloff);
 
         float dif = max(dot(n, lightDir), 0.0);
         float spec = pow(max(dot(n, halfwayDir), 0.0), specular.w);
 
-        vec3 objCol = (1.0 - pointShadow) * (dif + spec*specular.rgb) * albedo * falloff * lights[i].color; 
+        vec3 objCol = (1.0 - pointShadow) * (dif + spec*specular.rgb) * albedo * falloff * light.color; 
         //vec3 objCol = (ambientColor + (1.0 - pointShadow) * (dif + spec*Specular.rgb)) * Albedo * falloff * lights[i].color; 
         lighting += objCol;
     }
-    
-    lighting /= float(NR_LIGHTS);
 
     return 1.0 - exp(-lighting);
 }
@@ -150,15 +233,19 @@ vec3 lighting_pointLights_BRDF(vec3 worldPos, vec3 normal, vec3 albedo, vec4 spe
     vec3 F0 = vec3(0.04); 
     F0 = mix(F0, albedo, metallic);
 
-    for(int i = 0; i < NR_LIGHTS; i++)
+    uvec2 cluster = getCluster(worldPos);
+
+    for(uint c = 0u; c < cluster.y; c++)
     {
-        float pointShadow = pointShadowCalculation(worldPos, lights[i].pos,  lights[i].farPlane, i);  
+        Light light = getLight(int(texelFetch(lightIndices, int(cluster.x + c)).r));
+
+        float pointShadow = pointShadowCalculation(worldPos, light);  
 
-        vec3 lightDir = normalize(lights[i].pos - worldPos);
-        float lightDist = length(lights[i].pos - worldPos);
+        vec3 lightDir = normalize(light.pos - worldPos);
+        float lightDist = length(light.pos - worldPos);
         vec3 H = normalize(viewDir + lightDir);
-        float falloff = lights[i].strength / pow(lightDist, lights[i].falloff);
-        vec3 radiance = lights[i].color * falloff;
+        float falloff = light.strength / pow(lightDist, light.falloff);
+        vec3 radiance = light.color * falloff;
 
         vec3 F  = fresnelSchlick(max(dot(H, viewDir), 0.0), F0);
 
@@ -235,7 +322,7 @@ void main()
     vec2 tc = vec2(-atan(rd.y, rd.x)/(2.*pi), acos(-rd.z) / pi);
 
     if(depth > 500.0)
-        col = texture(skyTexture, tc).xyz;
+        col = pow(clamp(texture(skyTexture, tc).xyz, 0.0, 1.0), vec3(1.0/2.2)); // Linear HDR, same curve stb_image used to load it as 8 bit
 
 
 
@@ -44,7 +44,9 @@ float checkers(vec2 p, float k)
 
 vec3 applyNormalMap(vec3 N, vec2 uv)
 {
-    vec3 d = (texture(textureNormal, uv).xyz*2.) - vec3(1);
+    // Only x and y are stored in compressed normal maps
+    vec2 xy = 2.0*texture(textureNormal, uv).xy - vec2(1);
+    vec3 d = vec3(xy, sqrt(max(1.0 - dot(xy, xy), 0.0)));
     vec3 T = normalize(tanVec);
     vec3 B = normalize(cross(T, N));
 
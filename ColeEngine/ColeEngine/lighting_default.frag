@@ -70,7 +70,9 @@ float checkers(vec2 p, float k){
 
 
 vec3 applyNormalMap_old(vec3 N, vec2 uv){
-    vec3 d = 2.0*texture(textureNormal, uv).xyz - vec3(1);
+    // Only x and y are stored in compressed normal maps
+    vec2 xy = 2.0*texture(textureNormal, uv).xy - vec2(1);
+    vec3 d = vec3(xy, sqrt(max(1.0 - dot(xy, xy), 0.0)));
     vec3 T = normalize(tanVec);
     vec3 B = normalize(cross(T, N));
 
@@ -78,7 +80,9 @@ vec3 applyNormalMap_old(vec3 N, vec2 uv){
 }
 
 vec3 applyNormalMap(vec3 N, vec2 uv){
-    vec3 d = 2.0*texture(textureNormal, uv).xyz - vec3(1);
+    // Only x and y are stored in compressed normal maps
+    vec2 xy = 2.0*texture(textureNormal, uv).xy - vec2(1);
+    vec3 d = vec3(xy, sqrt(max(1.0 - dot(xy, xy), 0.0)));
     vec3 T = normalize(cross(vec3(0., 1., 0.), N));
     vec3 B = cross(N, T);
     mat3 TBN = mat3(T, B, N);
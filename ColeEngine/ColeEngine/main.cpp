@@ -23,6 +23,7 @@
 #include "Engine.h"
 
 #include "PlayerSystem.h"
+#include "PickingSystem.h"
 #include "RenderSystem.h"
 #include "WorldEditSystem.h"
 
@@ -63,6 +64,13 @@ int main()
 
     // Handles player movement 
     PlayerSystem playerSystem(engine);
+
+    // Handles mouse picking
+    PickingSystem pickingSystem(engine);
+
+    engine.addSystem(&renderSystem);
+    engine.addSystem(&playerSystem);
+    engine.addSystem(&pickingSystem);
     
    // WorldEditSystem worldEditSystem(engine);
     
@@ -80,6 +88,12 @@ int main()
         // Update player system
         playerSystem.update(engine);
 
+        // Pick entity and world position under the mouse
+        pickingSystem.update(engine);
+
+        // Upload textures that finished loading in the background
+        resourceManager.updateTextures();
+
         // Update render system (draws renderable entities)
         renderSystem.update(engine);
         